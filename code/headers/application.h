@@ -1,8 +1,14 @@
 #pragma once
 
 #include <string>
+#include <vector>
 #include <iostream>
+#include <thread>
+#include <atomic>
+#include "utils.h"
 #include "volumeReader.h"
+#include "cpuRayCaster.h"
+#include "camera.h"
 
 class Application
 {
@@ -10,9 +16,70 @@ private:
 	std::string volumePath="";
 
 	VolumeReader volReader;
-	GLFCameraWindow* w_handle;
+	BrickGrid brickGrid;
+	GLFCameraWindow* w_handle = nullptr;
+
+	// Interactive sessions load on a background thread: the file is mapped (LoadMapped, the GPU upload can start),
+	// then the brick grid (LoadBricked), the mip pyramid (LoadPyramid) and the gradients are built (LoadDone)
+	enum LoadStage { LoadReading, LoadMapped, LoadBricked, LoadPyramid, LoadDone, LoadFailed };
+	std::thread loader;
+	std::atomic<int> loadStage{ LoadReading };
+	int appliedStage = LoadReading;         // Last stage the render thread acted on
+	glm::vec2 valueRange = glm::vec2(0.0f);
+	void loadVolume(bool notify);
+	void pollLoading();
+
+	// Mip pyramid for level of detail sampling, -mip none skips building it
+	VolumePyramid pyramid;
+	bool buildPyramid = true;
+	MipFilter mipFilter = MipFilter::Average;
+	bool levelOfDetail = false;
+	float lodBias = 0.0f;
+
+	// Ray step in voxels (-stepSize), pre-integrated transfer function lookups (-preIntegration) and adaptive
+	// stepping driven by the occupancy grid (-adaptive)
+	float stepSize = 1.0f;
+	bool preIntegration = false;
+	bool adaptiveStepping = false;
+
+	// -gradients precomputes packed gradients for shading, -gradientOpacity sets the magnitude modulation
+	GradientVolume gradients;
+	bool buildGradients = false;
+	float gradientOpacity = 0.0f;
+
+	// Out-of-core rendering: a .vbrk volume streams into a brick atlas of streamingBudgetMB.
+	// -writeBricked converts the loaded volume to that format and exits.
+	BrickedVolume bricked;
+	int streamingBudgetMB = 1024;
+	std::string brickedOutputPath = "";
+	int brickedBrickSize = 32;
+	void openBrickedVolume(bool halfFloat);
+
+	// Headless batch mode: every camera pose is rendered with every transfer function into outputDir
+	bool headless = false;
+	std::string cameraPath = "";
+	std::vector<std::string> transferFunctionPaths;
+	std::string outputDir = ".";
+	std::string imageFormat = "png";
+	int imageWidth = WIDTH, imageHeight = HEIGHT;
+
+	// -cpu renders the batch with the CPU reference ray caster instead of OpenGL
+	bool cpuRender = false;
+	int cpuThreads = 0;
+	int cpuPacketWidth = 0;                 // 0 picks the widest SIMD packet the CPU supports
+	CPURayCaster* cpuRayCaster = nullptr;
+	OccupancyGrid cpuOccupancy;
+	glm::vec2 cpuWindow = glm::vec2(0, 1);
+	glm::vec3 cpuVolumeSize = glm::vec3(1);
+
+	void applyCPUTransferFunction(const std::vector<TransferFunctionPoint>& controlPoints);
+	CPURenderParams cpuRenderParams(const CameraPose& pose) const;
 public:
 	Application(int argc, char** argv);
+	~Application();
 
 	bool run ();
-};
\ No newline at end of file
+
+	bool isHeadless() const { return headless; }
+	bool runBatch();
+};
@@ -0,0 +1,70 @@
+#pragma once
+
+#include <vector>
+#include "voxelType.h"
+#include "voxelLayout.h"
+
+// Coarse grid of per-brick value ranges used for empty space skipping.
+// Each brick covers brickSize^3 voxels; its range also includes the one voxel apron that trilinear
+// filtering reads, so a brick whose range maps to all zero RGBA texels can be skipped without changing the image.
+// Zero opacity alone is not enough: samples add their colour times the scalar even where the alpha is 0.
+// Values are stored in normalized texture units, i.e. what the shader samples from the volume texture.
+class BrickGrid
+{
+private:
+	int brickSize = 16;
+	int volumeDims[3] = { 0, 0, 0 };
+	int gridDims[3] = { 0, 0, 0 };
+	std::vector<float> minMax;  // Interleaved (min, max) per brick, x fastest
+
+	template<typename T>
+	void buildTyped(const VoxelAccessor<T>& volume);
+
+public:
+	void build(const void* volume, VoxelType type, const VoxelLayout& layout, int brickSize = 16);
+	// Takes ranges computed elsewhere, e.g. stored with a bricked volume
+	void assign(const int* dims, int brickSize, const std::vector<float>& ranges);
+
+	bool isEmpty() const { return minMax.empty(); }
+	int getBrickSize() const { return brickSize; }
+	const int* getGridDims() const { return gridDims; }
+	const int* getVolumeDims() const { return volumeDims; }
+	size_t getBrickCount() const { return size_t(gridDims[0]) * gridDims[1] * gridDims[2]; }
+	const float* getMinMax() const { return minMax.data(); }
+};
+
+// Per brick upper bound of the sample opacity (LUT alpha times scalar) the brick can reach through the current
+// transfer function, quantized to 8 bits: 0 exactly when every sample in the brick reads an all zero RGBA texel,
+// so the brick can be skipped, and at least 1 otherwise (also for colour at zero opacity). Adaptive stepping derives the step length from it.
+// The transfer function texels each brick touches only depend on the window, so they are cached; a summed-area
+// table over the "any channel > 0" flags of the 256 entry LUT and a sparse max table over the opacities then answer
+// each brick in O(1). Edits are detected on all four channels, since colour alone keeps a brick visible.
+class OccupancyGrid
+{
+private:
+	const BrickGrid* grid = nullptr;
+	std::vector<unsigned char> occupancy;   // Maximum opacity * 255, rounded up; 0 when the brick can be skipped
+	std::vector<short> texelRange;          // Per brick [lo, hi] of LUT texels, -1 / 256 stand for the GL_REPEAT wrap
+	float window[2] = { 0, 0 };
+	bool texelRangeValid = false;
+
+	float lut[256 * 4] = {};                // RGBA of the last update, to detect edits
+	bool visible[256] = {};                 // Any of the texel's RGBA channels is non-zero
+	int visibleSum[257] = {};               // visibleSum[i] = number of visible texels before i
+	float opacityMax[9][256] = {};          // opacityMax[k][i] = highest opacity of texels [i, i + 2^k)
+	bool lutValid = false;
+
+	float maxOpacity(int lo, int hi) const;
+
+	void computeTexelRanges(float windowMin, float windowMax);
+
+public:
+	void setBrickGrid(const BrickGrid* brickGrid);
+
+	// Refreshes the grid for the 256 entry RGBA transfer function and the window (normalized texture units).
+	// Returns true when any brick changed; [dirtyZBegin, dirtyZEnd) are the brick layers that need re-uploading.
+	bool update(const float* transferFunction, float windowMin, float windowMax, int& dirtyZBegin, int& dirtyZEnd);
+
+	const unsigned char* getOccupancy() const { return occupancy.data(); }
+	const BrickGrid* getBrickGrid() const { return grid; }
+};
\ No newline at end of file
@@ -0,0 +1,95 @@
+#pragma once
+
+#include <vector>
+#include <deque>
+#include <list>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+#include "glm/glm.hpp"
+#include "brickedVolume.h"
+
+struct StreamingStats {
+	int slots = 0;                  // Bricks the atlas holds
+	int resident = 0;
+	int requested = 0;              // Bricks the current view asked for
+	int pending = 0;                // Requested bricks not resident yet (queued, being read or waiting for upload)
+	int uploadedLastFrame = 0;
+	size_t bytesRead = 0;
+	size_t evictions = 0;
+};
+
+// Keeps the bricks the current view needs resident in a fixed number of atlas slots. The renderer hands over
+// the visible bricks once per view change (request), a background thread reads them from disk into a bounded
+// pool of staging buffers, and the render thread places them in atlas slots (collect) under a per-frame byte
+// budget. When the atlas is full the least recently requested brick is evicted; bricks of the current request
+// never are. The page table has one RGBA8 entry per brick: the atlas slot in xyz and 255 in w once resident.
+// Nothing here touches GL, uploading is the caller's job.
+class BrickStreamer
+{
+private:
+	enum BrickState : unsigned char { Absent, Queued, Loading, Loaded, Resident };
+	struct Staged {
+		int brick;
+		int buffer;
+	};
+
+	BrickedVolume* volume = nullptr;
+	int slotDims[3] = { 0, 0, 0 };
+
+	std::vector<unsigned char> pageTable;
+	std::vector<int> brickSlot;                 // -1 when not resident
+	std::vector<unsigned> brickRequest;         // Last request number that asked for the brick
+	std::vector<int> slotBrick;                 // -1 when free
+	std::vector<unsigned> slotUsed;             // Request number that last asked for the slot's brick
+	std::list<int> lru;                         // Slots, least recently requested at the back
+	std::vector<std::list<int>::iterator> lruPosition;
+	unsigned requestNumber = 0;
+	bool pageTableDirty = false;
+
+	// Shared with the I/O thread
+	std::thread ioThread;
+	std::mutex mutex;
+	std::condition_variable wake;
+	bool stopping = false;
+	std::vector<unsigned char> state;
+	std::deque<int> queue;
+	std::vector<int> requested;                 // The current request, truncated to the slot count
+	std::vector<std::vector<unsigned char>> staging;
+	std::vector<int> freeBuffers;
+	std::vector<Staged> loaded;
+	std::function<void()> onLoaded;
+	StreamingStats stats;
+
+	void ioLoop();
+	void touch(int slot);
+	void place(int slot, int brick);
+
+public:
+	~BrickStreamer() { stop(); }
+
+	// onLoaded is called from the I/O thread whenever a brick is ready for collect(), e.g. to wake the event loop
+	void start(BrickedVolume* volume, const int* slotDims, int stagingBuffers, std::function<void()> onLoaded);
+	void stop();
+
+	// Bricks the view needs, most important first; replaces the previous request. Anything past the slot count is
+	// dropped, the atlas could not hold it at the same time anyway.
+	void request(const std::vector<int>& bricks);
+
+	// Places loaded bricks in atlas slots, calling upload(slot, voxels) for each, until byteBudget is spent.
+	// Returns true when the page table changed.
+	bool collect(size_t byteBudget, const std::function<void(int slot, const void* voxels)>& upload);
+
+	// True when every brick of the current request is resident (or did not fit)
+	bool isIdle();
+
+	void getSlotPosition(int slot, int& x, int& y, int& z) const;
+	const unsigned char* getPageTable() const { return pageTable.data(); }
+	StreamingStats getStats();
+};
+
+// Bricks of `volume` that intersect the view frustum of fshader11's ray camera (90 degree vertical field of
+// view at cameraPos, looking at the origin) and can contribute according to the occupancy flags, nearest first.
+// volumeSize is the world space extent of the volume, centered on the origin.
+std::vector<int> visibleBricks(const BrickedVolume& volume, const unsigned char* occupancy, glm::vec3 cameraPos, glm::vec3 volumeSize, float aspect);
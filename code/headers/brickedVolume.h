@@ -0,0 +1,61 @@
+#pragma once
+
+#include <cstdio>
+#include <cstdint>
+#include <string>
+#include <vector>
+#include <mutex>
+#include "glm/glm.hpp"
+#include "voxelType.h"
+#include "voxelLayout.h"
+
+class BrickGrid;
+
+// Bricked on-disk volume (.vbrk) for data sets that do not fit in host or GPU memory. A fixed size header is
+// followed by the (min, max) range of every brick, in the normalized units BrickGrid uses, and then by the
+// bricks themselves, x fastest. Each brick holds brickSize^3 voxels plus a one voxel apron on every side, so
+// a brick placed anywhere in an atlas filters exactly like the full volume; apron voxels outside the volume
+// are 0, like the GL_CLAMP border. All values are little endian.
+class BrickedVolume
+{
+private:
+	FILE* file = nullptr;
+	std::mutex fileMutex;
+	uint64_t bricksOffset = 0;
+	int dims[3] = { 0, 0, 0 };
+	int gridDims[3] = { 0, 0, 0 };
+	int brickSize = 0;
+	VoxelType voxelType = VoxelType::Unknown;
+	glm::vec3 spacing = glm::vec3(1.0f);
+	glm::vec2 valueRange = glm::vec2(0.0f);    // In file units
+	std::vector<float> minMax;
+
+public:
+	~BrickedVolume() { close(); }
+
+	// Converts an in-memory volume, brickSize should be a multiple of the occupancy grid's brick size
+	static bool write(const std::string& path, const void* volume, VoxelType type, const VoxelLayout& layout, glm::vec3 spacing, int brickSize = 32);
+
+	// Reads the header and brick ranges, the bricks are read on demand
+	bool open(const std::string& path);
+	void close();
+
+	// Copies brick `brick` (paddedBrickSize^3 voxels) to out. Safe to call from any thread.
+	bool readBrick(size_t brick, void* out);
+
+	// Fills grid with the stored ranges so empty space skipping works without touching the bricks
+	void fillBrickGrid(BrickGrid& grid) const;
+
+	bool isOpen() const { return file != nullptr; }
+	const int* getDims() const { return dims; }
+	const int* getGridDims() const { return gridDims; }
+	size_t getBrickCount() const { return size_t(gridDims[0]) * gridDims[1] * gridDims[2]; }
+	int getBrickSize() const { return brickSize; }
+	int getPaddedBrickSize() const { return brickSize + 2; }
+	size_t getBrickBytes() const { return size_t(brickSize + 2) * (brickSize + 2) * (brickSize + 2) * voxelTypeSize(voxelType); }
+	VoxelType getVoxelType() const { return voxelType; }
+	glm::vec3 getSpacing() const { return spacing; }
+	glm::vec2 getValueRange() const { return valueRange; }
+
+	static bool isBrickedPath(const std::string& path);
+};
@@ -0,0 +1,21 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <glm/glm.hpp>
+
+// One camera pose: position, look-at point and up vector
+struct CameraPose {
+	glm::vec3 position;
+	glm::vec3 at = glm::vec3(0.0f);
+	glm::vec3 up = glm::vec3(0.0f, 1.0f, 0.0f);
+};
+
+// Transformations shared by the OpenGL renderer and the CPU ray caster, so both draw the same image.
+// The model transform centres a volume of volumeSize voxels on the origin.
+glm::mat4 volumeModelMatrix(const glm::vec3& volumeSize);
+glm::mat4 cameraViewMatrix(const CameraPose& pose);
+glm::mat4 cameraProjectionMatrix(float aspect);
+
+// One pose per line: "px py pz [ax ay az [ux uy uz]]", '#' starts a comment
+bool readCameraPoses(const std::string& fileName, std::vector<CameraPose>& poses);
@@ -0,0 +1,76 @@
+#pragma once
+
+#include <vector>
+#include <glm/glm.hpp>
+#include "voxelType.h"
+#include "voxelLayout.h"
+#include "volumePyramid.h"
+#include "brickGrid.h"
+#include "parallel.h"
+#include "tileScheduler.h"
+
+// Everything fshader11 reads from uniforms and fixed function state for one frame
+struct CPURenderParams {
+	int width = 0, height = 0;
+	glm::vec3 cameraPos = glm::vec3(0, 0, 280);
+	glm::mat4 modelViewProjection = glm::mat4(1.0f);  // Transform of the bounding box draw; decides which pixels are shaded
+	glm::vec3 volumeSize = glm::vec3(1.0f);           // ExtentMax - ExtentMin in world space
+	float stepSize = 1.0f;
+	float stepRatio = 1.0f;
+	float windowMin = 0.0f, windowMax = 1.0f;         // Normalized texture units
+	bool emptySpaceSkipping = false;
+	bool adaptiveStepping = false;                    // Longer steps through bricks of low opacity, see raycast::adaptiveStepScale
+	float adaptiveOpacity = 0.05f;
+	float maxStepScale = 4.0f;
+	bool levelOfDetail = false;                       // Sample coarser pyramid levels where a pixel covers several voxels
+	float lodBias = 0.0f;
+	glm::vec4 clearColor = glm::vec4(1.0f);
+};
+
+// CPU implementation of the fshader11 ray caster, used to render without a GPU and as the golden reference
+// for image comparisons. It follows the shader step by step: the same camera basis and pixel offsets, slab
+// test, sample lattice and empty space skipping, trilinear filtering with GL_CLAMP (zero border) addressing,
+// the GL_RGBA8 / GL_REPEAT transfer function lookup, compositing with the 0.95 cutoff, and finally the
+// GL_SRC_ALPHA blend over the clear colour restricted to the pixels the bounding box covers.
+// The image is split into tiles which a work-stealing scheduler balances across the pool using the previous
+// frame's per-tile costs; within a tile, coherent primary rays are traced in SIMD packets, with each lane
+// following exactly the scalar sequence of steps.
+class CPURayCaster
+{
+private:
+	const void* volume = nullptr;
+	VoxelType volumeType = VoxelType::UInt8;
+	VoxelLayout layout;
+
+	float transferFunction[256 * 4] = {};   // Quantized to 8 bits like the GL_RGBA8 texture
+	const OccupancyGrid* occupancy = nullptr;
+	const VolumePyramid* pyramid = nullptr;
+
+	ThreadPool pool;
+	TileScheduler scheduler;
+	int tileSize = 32;
+	int packetWidth = 1;
+
+public:
+	explicit CPURayCaster(int threads = 0) : pool(threads) { setPacketWidth(0); }
+
+	// `data` holds the voxels in `layout` (see VolumeReader::getCPUVolume)
+	void setVolume(const void* data, VoxelType type, const VoxelLayout& layout);
+	void setTransferFunction(const float* rgba256);
+	void setOccupancyGrid(const OccupancyGrid* grid) { occupancy = grid; }
+	// Coarse levels for level of detail sampling; level 0 stays the volume given to setVolume
+	void setPyramid(const VolumePyramid* volumePyramid) { pyramid = volumePyramid; }
+	void setTileSize(int size) { tileSize = std::max(1, size); }
+
+	// Rays traced together by the SIMD kernels: 1 (scalar reference), 4 (SSE4.1), 8 (AVX2) or 16 (AVX-512).
+	// Requests are rounded down to what the CPU supports; 0 picks the widest.
+	void setPacketWidth(int width);
+	int getPacketWidth() const { return packetWidth; }
+	static int getSupportedPacketWidth();
+
+	// Renders bottom-up RGBA rows, the layout glReadPixels returns
+	void render(const CPURenderParams& params, std::vector<unsigned char>& rgba);
+
+	int getThreadCount() const { return pool.getThreadCount(); }
+	const TileStats& getTileStats() const { return scheduler.getStats(); }
+};
\ No newline at end of file
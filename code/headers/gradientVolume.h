@@ -0,0 +1,34 @@
+#pragma once
+
+#include <vector>
+#include <cstdint>
+#include "glm/glm.hpp"
+#include "voxelType.h"
+#include "voxelLayout.h"
+
+// Per voxel gradient of the scalar field for shading, packed so the shader needs a single extra fetch per sample.
+// Each texel is GL_RGB10_A2: the gradient direction octahedral-encoded in the first two channels and the
+// magnitude, relative to the largest in the volume, in the third. Gradients are central differences of the
+// normalized value over world space voxel sizes (anisotropic spacing included), clamped at the volume faces.
+class GradientVolume
+{
+private:
+	int dims[3] = { 0, 0, 0 };
+	float maxMagnitude = 0.0f;
+	std::vector<uint32_t> texels;   // x fastest
+
+	template<typename T>
+	void buildTyped(const VoxelAccessor<T>& volume, glm::vec3 voxelSize);
+
+public:
+	void build(const void* volume, VoxelType type, const VoxelLayout& layout, glm::vec3 spacing);
+	void clear();
+
+	bool isEmpty() const { return texels.empty(); }
+	const int* getDims() const { return dims; }
+	const uint32_t* getTexels() const { return texels.data(); }
+	float getMaxMagnitude() const { return maxMagnitude; }
+
+	static uint32_t pack(glm::vec3 gradient, float magnitudeScale);
+	static glm::vec3 unpackNormal(uint32_t texel);
+};
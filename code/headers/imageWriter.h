@@ -0,0 +1,13 @@
+#pragma once
+
+#include <string>
+
+// Writers for 8-bit RGBA images read back from OpenGL. Rows are given bottom-up (glReadPixels order)
+// and are flipped to the top-down order of the file formats.
+bool writePPM(const std::string& fileName, int width, int height, const unsigned char* rgba);
+
+// Uncompressed (stored deflate blocks) PNG, so no zlib dependency is needed
+bool writePNG(const std::string& fileName, int width, int height, const unsigned char* rgba);
+
+// Picks the writer from the file extension (.png or .ppm)
+bool writeImage(const std::string& fileName, int width, int height, const unsigned char* rgba);
\ No newline at end of file
@@ -0,0 +1,42 @@
+#pragma once
+
+#include <string>
+#include <cstddef>
+
+// View of a file region backed by the OS page cache (mmap / MapViewOfFile).
+// The bytes are never copied into the heap; pages are faulted in on first access.
+// A copy-on-write mapping can be requested when the data has to be patched in place (e.g. byte swapping),
+// only the touched pages are then privately duplicated and the file itself is never modified.
+class MappedFile
+{
+private:
+	void* mappedBase = nullptr;       // Page aligned start of the mapping
+	size_t mappedLength = 0;
+	unsigned char* data = nullptr;          // Requested offset inside the mapping
+	bool copyOnWrite = false;
+	size_t length = 0;
+
+#ifdef _WIN32
+	void* fileHandle = nullptr;
+	void* mappingHandle = nullptr;
+#endif
+
+public:
+	MappedFile() = default;
+	MappedFile(const MappedFile&) = delete;
+	MappedFile& operator=(const MappedFile&) = delete;
+	~MappedFile() {
+		close();
+	}
+
+	static bool fileSize(const std::string& path, size_t& size);
+
+	// Maps `length` bytes starting at `offset`; length 0 maps up to the end of the file.
+	bool open(const std::string& path, size_t offset = 0, size_t length = 0, bool copyOnWrite = false);
+	void close();
+
+	bool isOpen() const { return data != nullptr; }
+	const unsigned char* getData() const { return data; }
+	unsigned char* getMutableData() const { return copyOnWrite ? data : nullptr; }
+	size_t getLength() const { return length; }
+};
\ No newline at end of file
@@ -0,0 +1,41 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <functional>
+
+// Minimal benchmark harness in the spirit of Google Benchmark, without the dependency: each benchmark body is
+// repeated until it has run for at least minSeconds (and minIterations times), then the mean and fastest time
+// per iteration and the throughput in the benchmark's unit are printed as one row and kept for the JSON report.
+class MicroBenchmarkRunner
+{
+public:
+	struct Result {
+		std::string name;
+		int iterations = 0;
+		double meanMs = 0.0, minMs = 0.0;
+		double throughput = 0.0;      // Work per second, based on the mean time
+		std::string unit;
+	};
+
+private:
+	std::string filter;
+	double minSeconds = 0.5;
+	int minIterations = 3;
+	std::vector<Result> results;
+
+public:
+	// Only benchmarks whose name contains `substring` run
+	void setFilter(const std::string& substring) { filter = substring; }
+	void setMinTime(double seconds) { minSeconds = seconds; }
+
+	bool matches(const std::string& name) const { return filter.empty() || name.find(filter) != std::string::npos; }
+
+	// `work` is what one call of `body` processes, in `unit` (e.g. megabytes for "MB/s", megapixels for "Mpix/s").
+	// `setup` runs before every iteration, outside the timed part.
+	void run(const std::string& name, double work, const char* unit, const std::function<void()>& body,
+		const std::function<void()>& setup = nullptr);
+
+	const std::vector<Result>& getResults() const { return results; }
+	bool writeJson(const std::string& path) const;
+};
@@ -0,0 +1,129 @@
+#pragma once
+
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+// Splits [begin, end) into contiguous chunks and runs func(chunkBegin, chunkEnd) on all hardware threads.
+// Used by the load time preprocessing passes, which are all embarrassingly parallel over slabs of the volume.
+template<typename F>
+void parallelFor(int begin, int end, F&& func)
+{
+	int count = end - begin;
+	if (count <= 0) return;
+
+	int threads = std::min<int>(count, std::max(1u, std::thread::hardware_concurrency()));
+	if (threads == 1) {
+		func(begin, end);
+		return;
+	}
+
+	std::vector<std::thread> workers;
+	workers.reserve(threads - 1);
+	for (int i = 1; i < threads; i++) {
+		int chunkBegin = begin + int((long long)count * i / threads);
+		int chunkEnd = begin + int((long long)count * (i + 1) / threads);
+		workers.emplace_back([&func, chunkBegin, chunkEnd]() { func(chunkBegin, chunkEnd); });
+	}
+	func(begin, begin + count / threads);
+
+	for (auto& worker : workers) {
+		worker.join();
+	}
+}
+
+// Persistent worker threads for work that is dispatched every frame, where spawning threads per call
+// (as parallelFor does) would cost more than the work itself. run() hands out task indices from a shared
+// counter, so threads that finish cheap tasks early keep pulling the remaining ones.
+class ThreadPool
+{
+private:
+	std::vector<std::thread> workers;
+	std::mutex mutex;
+	std::condition_variable wake, done;
+	std::function<void(int task, int thread)> job;
+	std::atomic<int> nextTask{ 0 };
+	int taskCount = 0;
+	int busyWorkers = 0;
+	unsigned generation = 0;
+	bool stopping = false;
+
+	void drain(int thread)
+	{
+		for (int task = nextTask++; task < taskCount; task = nextTask++) {
+			job(task, thread);
+		}
+	}
+
+	void workerLoop(int thread)
+	{
+		unsigned seen = 0;
+		for (;;) {
+			{
+				std::unique_lock<std::mutex> lock(mutex);
+				wake.wait(lock, [&]() { return stopping || generation != seen; });
+				if (stopping) return;
+				seen = generation;
+			}
+			drain(thread);
+			{
+				std::lock_guard<std::mutex> lock(mutex);
+				if (--busyWorkers == 0) done.notify_one();
+			}
+		}
+	}
+
+public:
+	explicit ThreadPool(int threads = 0)
+	{
+		if (threads <= 0) threads = std::max(1u, std::thread::hardware_concurrency());
+		for (int i = 1; i < threads; i++) {
+			workers.emplace_back([this, i]() { workerLoop(i); });
+		}
+	}
+
+	~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			stopping = true;
+		}
+		wake.notify_all();
+		for (auto& worker : workers) {
+			worker.join();
+		}
+	}
+
+	ThreadPool(const ThreadPool&) = delete;
+	ThreadPool& operator=(const ThreadPool&) = delete;
+
+	// Number of threads taking part in run(), including the calling thread (index 0)
+	int getThreadCount() const { return int(workers.size()) + 1; }
+
+	// Calls func(task, thread) for every task in [0, tasks) and returns when all of them are done
+	template<typename F>
+	void run(int tasks, F&& func)
+	{
+		if (tasks <= 0) return;
+
+		{
+			std::lock_guard<std::mutex> lock(mutex);
+			job = std::forward<F>(func);
+			taskCount = tasks;
+			nextTask = 0;
+			busyWorkers = int(workers.size());
+			generation++;
+		}
+		wake.notify_all();
+
+		drain(0);
+
+		std::unique_lock<std::mutex> lock(mutex);
+		done.wait(lock, [&]() { return busyWorkers == 0; });
+		job = nullptr;
+	}
+};
@@ -0,0 +1,58 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include "utils.h"
+#include "volumeReader.h"
+#include "camera.h"
+
+// Frame time statistics of one benchmark configuration, as written to the JSON report
+struct PathBenchmarkResult {
+	int width = 0, height = 0;
+	float stepSize = 1.0f;
+	int frames = 0;
+	double minMs = 0, meanMs = 0, medianMs = 0, p95Ms = 0, p99Ms = 0, maxMs = 0;
+	double gpuMedianMs = 0, gpuP95Ms = 0;     // Timestamp queries around the frame, 0 without timer queries
+	double nominalSamples = 0;                // Per frame, see PathBenchmark
+	double samplesPerSecond = 0;
+};
+
+// Replays a scripted camera path (one orbit around the volume while zooming in and out twice) at every
+// combination of the requested resolutions and step sizes, offscreen, and reports the frame times.
+// Frames are timed from the start of the ray casting pass to glFinish, so every frame is complete and the
+// numbers do not depend on vsync or on the event loop. Samples per second count the nominal ray samples: the
+// length of every pixel's ray through the volume box divided by the step size, before empty space skipping,
+// adaptive stepping and early ray termination, so they compare how fast the same work gets done.
+// With a baseline report, configurations whose median or p95 frame time got slower by more than the tolerance
+// are reported as regressions and make run() fail.
+class PathBenchmark
+{
+private:
+	std::string volumePath;
+	std::string tfPath = "TransferFunctions/TF1.dat";
+	std::string outputPath = "benchmark.json";
+	std::string baselinePath;
+	float tolerance = 0.10f;
+	std::vector<std::pair<int, int>> sizes = { { 1280, 720 }, { 1920, 1080 } };
+	std::vector<float> stepSizes = { 1.0f, 2.0f };
+	int frames = 240;
+	int warmupFrames = 10;
+	bool adaptiveStepping = false;
+	bool preIntegration = false;
+
+	VolumeReader volReader;
+	BrickGrid brickGrid;
+	GLFCameraWindow* w_handle = nullptr;
+
+	CameraPose pathPose(int frame, float distance) const;
+	double nominalSamples(float stepSize) const;
+	bool runConfiguration(int width, int height, float stepSize, PathBenchmarkResult& result);
+	bool writeReport(const std::vector<PathBenchmarkResult>& results) const;
+	bool compareWithBaseline(const std::vector<PathBenchmarkResult>& results) const;
+
+public:
+	PathBenchmark(int argc, char** argv);
+	~PathBenchmark();
+
+	bool run();
+};
@@ -0,0 +1,101 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <mutex>
+#include <chrono>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Stages of GLFWindow::Run() and the work that happens between frames
+enum ProfileStage {
+	ProfileFrame,             // Run() without the idle wait for events
+	ProfileImGuiBuild,        // NewFrame and the GUI windows
+	ProfileUploads,           // Volume, gradient and brick uploads
+	ProfileSetUniforms,
+	ProfileVolumeDraw,        // Ray casting pass, including SetUniforms
+	ProfileImGuiRender,
+	ProfileSwap,
+	ProfileTransferFunction,  // LUT, pre-integration table and occupancy rebuilds
+	ProfileStageCount
+};
+
+const char* profileStageName(int stage);
+
+// Rolling CPU and GPU timings of the frame stages. CPU times come from scoped timers; GPU times from a ring of
+// GL_TIMESTAMP query pairs per stage, read back a few frames later without stalling. Timestamps rather than
+// GL_TIME_ELAPSED because elapsed queries cannot nest, and the volume pass already runs one for the
+// refinement scheduler. Stages and collect() must be used on the thread that owns the GL context;
+// recordEvent() may be called from any thread, e.g. by the loader.
+class Profiler
+{
+public:
+	static constexpr int historySize = 240;
+
+	struct Stats {
+		float last = 0.0f, mean = 0.0f, p50 = 0.0f, p95 = 0.0f, p99 = 0.0f, max = 0.0f;
+		int count = 0;
+	};
+
+private:
+	static constexpr int queryLatency = 4;  // Frames a GPU timing may take to arrive
+
+	struct History {
+		float values[historySize] = {};
+		int count = 0, next = 0;
+		void push(float value);
+	};
+
+	struct Stage {
+		History cpu, gpu;
+		std::chrono::steady_clock::time_point cpuStart;
+		bool gpuTimed = false;              // Whether the running scope issued a GPU query
+		GLuint queries[queryLatency][2] = {};
+		bool pending[queryLatency] = {};
+		int queryIndex = 0;
+	};
+
+	Stage stages[ProfileStageCount];
+	bool gpuTimers = false;
+	bool initialized = false;
+
+	std::mutex eventMutex;
+	std::vector<std::pair<std::string, float>> events;
+
+	void readQuery(Stage& stage, int slot);
+
+public:
+	// Creates the queries; call once the GL context is current
+	void init();
+	void release();
+
+	void begin(ProfileStage stage, bool gpu = true);
+	void end(ProfileStage stage);
+
+	// Picks up the GPU timings that have arrived, once per frame
+	void collect();
+
+	// One-off durations such as load stages, listed below the rolling stages
+	void recordEvent(const std::string& name, float ms);
+
+	Stats getStats(ProfileStage stage, bool gpu) const;
+	bool hasGpuTimers() const { return gpuTimers; }
+
+	// Profiler section of the Information window: percentiles per stage and the history of one of them
+	void drawGui();
+};
+
+// Times the enclosing scope as one stage
+class ProfileScope
+{
+private:
+	Profiler& profiler;
+	ProfileStage stage;
+
+public:
+	ProfileScope(Profiler& owner, ProfileStage timedStage, bool gpu = true) : profiler(owner), stage(timedStage) { profiler.begin(stage, gpu); }
+	~ProfileScope() { profiler.end(stage); }
+	ProfileScope(const ProfileScope&) = delete;
+	ProfileScope& operator=(const ProfileScope&) = delete;
+};
@@ -0,0 +1,94 @@
+#pragma once
+
+#include <glm/glm.hpp>
+#include "voxelType.h"
+#include "voxelLayout.h"
+
+// Per frame constants of the CPU ray caster, derived once from CPURenderParams and shared by all tiles.
+// Names follow fshader11.fs.
+struct RayCastFrame {
+	int width = 0, height = 0;
+	unsigned char* image = nullptr;           // Bottom-up RGBA rows
+
+	// Camera basis and constants the shader computes at global scope
+	glm::vec3 cameraPos, u, v, w;
+	float aspect = 1.0f, focalDistance = 0.5f;
+
+	// Bounding box draw, used to find the pixels that receive a fragment
+	glm::mat4 inverseMVP;
+	glm::vec3 boxMin, boxMax;
+
+	glm::vec3 extentMin, extentMax, extent;
+	float stepSize = 1.0f, stepRatio = 1.0f;
+	float windowMin = 0.0f, windowMax = 1.0f;
+	glm::vec4 clearColor;
+
+	const float* transferFunction = nullptr;  // 256 RGBA entries, quantized to 8 bits
+	// Level 0 is the volume, coarser ones come from the VolumePyramid
+	struct Level {
+		const void* volume = nullptr;
+		const VoxelLayout* layout = nullptr;  // Read through VoxelAccessor
+		const size_t* offsets[3] = {};        // The layout's per axis tables, for the packet kernels
+		bool linear = true;
+		int dims[3] = { 0, 0, 0 };
+	};
+	static constexpr int maxLevels = 8;
+	Level levels[maxLevels];
+	int levelCount = 1;
+	VoxelType volumeType = VoxelType::UInt8;
+
+	// Level of detail: voxels per unit of ray distance covered by one pixel, see raycast::selectLevel
+	bool levelOfDetail = false;
+	float lodBias = 0.0f;
+	float footprintScale = 0.0f;
+
+	// Empty space skipping, occupied == nullptr when disabled
+	const unsigned char* occupied = nullptr;
+	glm::vec3 brickGridScale = glm::vec3(1.0f);
+	int gridDims[3] = { 1, 1, 1 };
+	int lastBrick[3] = { 0, 0, 0 };
+
+	// Adaptive stepping, maxOpacity == nullptr when disabled: the occupancy grid values, maximum opacity * 255
+	const unsigned char* maxOpacity = nullptr;
+	float adaptiveOpacity = 0.05f, maxStepScale = 4.0f;
+};
+
+// Renders the pixels [x0, x1) x [y0, y1) of the frame
+using RayCastTileFunc = void (*)(const RayCastFrame& frame, int x0, int y0, int x1, int y1);
+
+void renderTileScalar(const RayCastFrame& frame, int x0, int y0, int x1, int y1);
+
+// Ray packet kernels, each compiled in its own translation unit with the matching instruction set enabled.
+// Only call them after checking the CPU supports the instruction set.
+void renderTileSSE4(const RayCastFrame& frame, int x0, int y0, int x1, int y1);
+void renderTileAVX2(const RayCastFrame& frame, int x0, int y0, int x1, int y1);
+void renderTileAVX512(const RayCastFrame& frame, int x0, int y0, int x1, int y1);
+
+// Per pixel helpers shared by all kernels. They are compiled once, without any instruction set flags, so
+// the packet translation units never provide (and the linker never picks) an AVX build of shared code.
+namespace raycast {
+
+// Whether the culled bounding box draw produces a fragment at the pixel centre
+bool boxCoversPixel(const RayCastFrame& frame, int px, int py);
+
+void writeClear(const RayCastFrame& frame, int px, int py);
+
+// glBlendFunc(GL_SRC_ALPHA, GL_ONE_MINUS_SRC_ALPHA) of the shader output over the cleared target
+void writeBlended(const RayCastFrame& frame, int px, int py, float r, float g, float b, float a);
+
+// Mip level a ray entering the volume at distance tentry samples: the coarsest one whose voxels are no larger
+// than the pixel footprint there. The ray's step size and opacity correction scale with 2^level.
+int selectLevel(const RayCastFrame& frame, float tentry);
+
+// Opacity corrected sample weight for step sizes other than the base step (stepRatio != 1), continuous at zero
+// opacity where it becomes scalar * stepRatio
+float correctedWeight(float scalar, float srcAlpha, float stepRatio);
+
+// Multiple of the step size a ray takes after a sample in a brick with the given maximum opacity (0-255): steps
+// grow until the brick's most opaque sample would reach adaptiveOpacity, up to maxStepScale. The caller also
+// stops at the first sample past the brick, so steps never reach into the next brick. A maximum opacity of 0 means
+// every texel the brick reaches is all zero, so its long steps composite nothing, exactly as when it is skipped;
+// bricks with colour at zero opacity are stored as 1 and weighted by correctedWeight's zero opacity limit.
+float adaptiveStepScale(const RayCastFrame& frame, unsigned char maxOpacity);
+
+}
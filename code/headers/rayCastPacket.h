@@ -0,0 +1,344 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <cstddef>
+#include <type_traits>
+#include "rayCastKernels.h"
+#include "simd.h"
+
+// Ray packet version of renderTileScalar for one SIMD wrapper S (see simd.h). Each lane traces one pixel of a
+// small block (2x2, 4x2 or 4x4) and performs exactly the operations of the scalar loop, in the same order, so
+// the images are identical; lanes that leave the volume or saturate are masked off and the packet finishes
+// when all lanes are done. Everything here is a member of PacketKernel<S>, so no code is shared between
+// translation units built for different instruction sets.
+template<typename S>
+struct PacketKernel {
+	using F = typename S::F;
+	using I = typename S::I;
+	using M = typename S::M;
+	static constexpr int W = S::width;
+	static constexpr int columns = W == 4 ? 2 : 4;
+	static constexpr int rows = W / columns;
+
+	struct Vec3 {
+		F x, y, z;
+	};
+
+	template<typename T>
+	static float normalize(T v)
+	{
+		if (std::is_same<T, int16_t>::value) {
+			float f = v * (1.0f / 32767.0f);
+			return f < -1.0f ? -1.0f : f;
+		}
+		return std::is_same<T, float>::value ? float(v) : v * (1.0f / VoxelTraits<T>::scale);
+	}
+
+	// GL_LINEAR volume lookup with GL_CLAMP addressing for the lanes in `active`. Lane i reads pyramid level
+	// level[i]; uniformLevel is that level when all lanes agree, -1 otherwise.
+	template<typename T>
+	static F sampleVolume(const RayCastFrame& frame, const int* level, int uniformLevel, const Vec3& texPos, M active)
+	{
+		F dims[3];
+		if (uniformLevel >= 0) {
+			for (int axis = 0; axis < 3; axis++) dims[axis] = S::set1(float(frame.levels[uniformLevel].dims[axis]));
+		}
+		else {
+			alignas(64) float laneDims[3][W];
+			for (int lane = 0; lane < W; lane++) {
+				for (int axis = 0; axis < 3; axis++) laneDims[axis][lane] = float(frame.levels[level[lane]].dims[axis]);
+			}
+			for (int axis = 0; axis < 3; axis++) dims[axis] = S::load(laneDims[axis]);
+		}
+
+		F base[3], f[3];
+		const F* coords[3] = { &texPos.x, &texPos.y, &texPos.z };
+		for (int axis = 0; axis < 3; axis++) {
+			F clamped = S::min(S::max(*coords[axis], S::set1(0.0f)), S::set1(1.0f));
+			F u = S::sub(S::mul(clamped, dims[axis]), S::set1(0.5f));
+			base[axis] = S::floor(u);
+			f[axis] = S::sub(u, base[axis]);
+		}
+
+		bool gatherFloats = false;
+		if (std::is_same<T, float>::value && uniformLevel >= 0) {
+			const RayCastFrame::Level& source = frame.levels[uniformLevel];
+			gatherFloats = source.linear && size_t(source.dims[0]) * source.dims[1] * source.dims[2] < (size_t(1) << 31);
+		}
+
+		F c[8];
+		if (gatherFloats) {
+			// Linear float volumes below 2^31 voxels: hardware gathers, border texels masked off
+			const RayCastFrame::Level& source = frame.levels[uniformLevel];
+			for (int corner = 0; corner < 8; corner++) {
+				F x = S::add(base[0], S::set1(float(corner & 1)));
+				F y = S::add(base[1], S::set1(float((corner >> 1) & 1)));
+				F z = S::add(base[2], S::set1(float(corner >> 2)));
+				M inside = S::mand(active, S::mand(S::mand(S::ge(x, S::set1(0.0f)), S::lt(x, dims[0])),
+					S::mand(S::mand(S::ge(y, S::set1(0.0f)), S::lt(y, dims[1])),
+						S::mand(S::ge(z, S::set1(0.0f)), S::lt(z, dims[2])))));
+				I index = S::addi(S::muli(S::addi(S::muli(S::truncate(z), S::seti(source.dims[1])), S::truncate(y)), S::seti(source.dims[0])), S::truncate(x));
+				c[corner] = S::gather(static_cast<const float*>(source.volume), index, inside);
+			}
+		}
+		else {
+			// Narrower voxels are fetched lane by lane (a 32 bit gather could read past the end of the mapping),
+			// as are swizzled layouts, whose per axis offset tables would need three more gathers per corner
+			alignas(64) float lanes[3][W];
+			alignas(64) float values[8][W];
+			for (int axis = 0; axis < 3; axis++) S::store(lanes[axis], base[axis]);
+			int activeBits = S::bits(active);
+			for (int lane = 0; lane < W; lane++) {
+				if (!((activeBits >> lane) & 1)) {
+					for (int corner = 0; corner < 8; corner++) values[corner][lane] = 0.0f;
+					continue;
+				}
+				const RayCastFrame::Level& source = frame.levels[level[lane]];
+				const T* voxels = static_cast<const T*>(source.volume);
+				const int* size = source.dims;
+				int x0 = int(lanes[0][lane]), y0 = int(lanes[1][lane]), z0 = int(lanes[2][lane]);
+				for (int corner = 0; corner < 8; corner++) {
+					int x = x0 + (corner & 1), y = y0 + ((corner >> 1) & 1), z = z0 + (corner >> 2);
+					bool inside = x >= 0 && y >= 0 && z >= 0 && x < size[0] && y < size[1] && z < size[2];
+					values[corner][lane] = inside ? normalize(voxels[source.offsets[0][x] + source.offsets[1][y] + source.offsets[2][z]]) : 0.0f;
+				}
+			}
+			for (int corner = 0; corner < 8; corner++) c[corner] = S::load(values[corner]);
+		}
+
+		F one = S::set1(1.0f);
+		F fx = f[0], gx = S::sub(one, fx);
+		F c00 = S::add(S::mul(c[0], gx), S::mul(c[1], fx));
+		F c10 = S::add(S::mul(c[2], gx), S::mul(c[3], fx));
+		F c01 = S::add(S::mul(c[4], gx), S::mul(c[5], fx));
+		F c11 = S::add(S::mul(c[6], gx), S::mul(c[7], fx));
+		F c0 = S::add(S::mul(c00, S::sub(one, f[1])), S::mul(c10, f[1]));
+		F c1 = S::add(S::mul(c01, S::sub(one, f[1])), S::mul(c11, f[1]));
+		return S::add(S::mul(c0, S::sub(one, f[2])), S::mul(c1, f[2]));
+	}
+
+	template<typename T>
+	static void renderTile(const RayCastFrame& frame, int x0, int y0, int x1, int y1)
+	{
+		const float screenWidth = float(frame.width), screenHeight = float(frame.height);
+		const F zero = S::set1(0.0f), one = S::set1(1.0f);
+		const F extentX = S::set1(frame.extent.x), extentY = S::set1(frame.extent.y), extentZ = S::set1(frame.extent.z);
+		const F halfX = S::set1(frame.extent.x / 2.0f), halfY = S::set1(frame.extent.y / 2.0f), halfZ = S::set1(frame.extent.z / 2.0f);
+		const F windowMin = S::set1(frame.windowMin), windowRange = S::set1(frame.windowMax - frame.windowMin);
+		const Vec3 cam = { S::set1(frame.cameraPos.x), S::set1(frame.cameraPos.y), S::set1(frame.cameraPos.z) };
+		const Vec3 scale = { S::set1(frame.brickGridScale.x), S::set1(frame.brickGridScale.y), S::set1(frame.brickGridScale.z) };
+
+		alignas(64) float fragX[W], fragY[W];
+		alignas(64) float outR[W], outG[W], outB[W], outA[W];
+		alignas(64) int brick[3][W];
+		alignas(64) float lane0[W], lane1[W], lane2[W];
+		alignas(64) int level[W];
+		alignas(64) float levelScale[W];
+		alignas(64) float stepScales[W];
+
+		for (int py0 = y0; py0 < y1; py0 += rows) {
+			for (int px0 = x0; px0 < x1; px0 += columns) {
+				int covered = 0;
+				for (int lane = 0; lane < W; lane++) {
+					int px = px0 + lane % columns, py = py0 + lane / columns;
+					fragX[lane] = px + 0.5f;           // gl_FragCoord is the pixel centre
+					fragY[lane] = py + 0.5f;
+					if (px >= x1 || py >= y1) continue;
+					if (raycast::boxCoversPixel(frame, px, py)) covered |= 1 << lane;
+					else raycast::writeClear(frame, px, py);
+				}
+				if (!covered) continue;
+
+				// Primary rays
+				F xw = S::div(S::mul(S::set1(frame.aspect), S::add(S::sub(S::load(fragX), S::set1(screenWidth / 2.0f)), S::set1(0.5f))), S::set1(screenWidth));
+				F yw = S::div(S::add(S::sub(S::load(fragY), S::set1(screenHeight / 2.0f)), S::set1(0.5f)), S::set1(screenHeight));
+				Vec3 dir = {
+					S::sub(S::add(S::mul(S::set1(frame.u.x), xw), S::mul(S::set1(frame.v.x), yw)), S::set1(frame.focalDistance * frame.w.x)),
+					S::sub(S::add(S::mul(S::set1(frame.u.y), xw), S::mul(S::set1(frame.v.y), yw)), S::set1(frame.focalDistance * frame.w.y)),
+					S::sub(S::add(S::mul(S::set1(frame.u.z), xw), S::mul(S::set1(frame.v.z), yw)), S::set1(frame.focalDistance * frame.w.z))
+				};
+				F inverseLength = S::div(one, S::sqrt(S::add(S::add(S::mul(dir.x, dir.x), S::mul(dir.y, dir.y)), S::mul(dir.z, dir.z))));
+				dir.x = S::mul(dir.x, inverseLength);
+				dir.y = S::mul(dir.y, inverseLength);
+				dir.z = S::mul(dir.z, inverseLength);
+
+				// Slab test, same comparisons as rayintersection()
+				F tentry, texit;
+				M hit;
+				{
+					F toMinX = S::set1(frame.extentMin.x - frame.cameraPos.x), toMaxX = S::set1(frame.extentMax.x - frame.cameraPos.x);
+					F toMinY = S::set1(frame.extentMin.y - frame.cameraPos.y), toMaxY = S::set1(frame.extentMax.y - frame.cameraPos.y);
+					F toMinZ = S::set1(frame.extentMin.z - frame.cameraPos.z), toMaxZ = S::set1(frame.extentMax.z - frame.cameraPos.z);
+
+					M negative = S::lt(S::div(one, dir.x), zero);
+					tentry = S::select(negative, S::div(toMaxX, dir.x), S::div(toMinX, dir.x));
+					texit = S::select(negative, S::div(toMinX, dir.x), S::div(toMaxX, dir.x));
+
+					negative = S::lt(S::div(one, dir.y), zero);
+					F tymin = S::select(negative, S::div(toMaxY, dir.y), S::div(toMinY, dir.y));
+					F tymax = S::select(negative, S::div(toMinY, dir.y), S::div(toMaxY, dir.y));
+					M miss = S::mor(S::gt(tentry, tymax), S::gt(tymin, texit));
+					tentry = S::select(S::gt(tymin, tentry), tymin, tentry);
+					texit = S::select(S::lt(tymax, texit), tymax, texit);
+
+					negative = S::lt(S::div(one, dir.z), zero);
+					F tzmin = S::select(negative, S::div(toMaxZ, dir.z), S::div(toMinZ, dir.z));
+					F tzmax = S::select(negative, S::div(toMinZ, dir.z), S::div(toMaxZ, dir.z));
+					tentry = S::select(S::gt(tzmin, tentry), tzmin, tentry);
+					texit = S::select(S::lt(tzmax, texit), tzmax, texit);
+
+					hit = S::mandnot(S::mand(S::gt(texit, zero), S::lt(tentry, texit)), miss);
+					tentry = S::select(S::lt(tentry, zero), zero, tentry);
+				}
+
+				M active = S::mand(hit, S::fromBits(covered));
+
+				// Per lane mip level, step size and opacity correction
+				int uniformLevel = 0;
+				for (int lane = 0; lane < W; lane++) level[lane] = 0;
+				if (frame.levelOfDetail && S::bits(active)) {
+					int activeBits = S::bits(active), first = -1;
+					S::store(lane0, tentry);
+					for (int lane = 0; lane < W; lane++) {
+						if (!((activeBits >> lane) & 1)) continue;
+						level[lane] = raycast::selectLevel(frame, lane0[lane]);
+						if (first < 0) first = level[lane];
+						if (level[lane] != first) uniformLevel = -1;
+					}
+					for (int lane = 0; lane < W; lane++) {
+						if (!((activeBits >> lane) & 1)) level[lane] = first;
+					}
+					if (uniformLevel == 0) uniformLevel = first;
+				}
+				bool correction = false;
+				for (int lane = 0; lane < W; lane++) {
+					levelScale[lane] = float(1 << level[lane]);
+					correction |= frame.stepRatio * levelScale[lane] != 1.0f;
+				}
+				const F stepSize = S::mul(S::set1(frame.stepSize), S::load(levelScale));
+				const F stepRatio = S::mul(S::set1(frame.stepRatio), S::load(levelScale));
+				F dstR = zero, dstG = zero, dstB = zero, dstA = zero;
+				F t = tentry;
+
+				Vec3 brickDir = { S::mul(S::div(dir.x, extentX), scale.x), S::mul(S::div(dir.y, extentY), scale.y), S::mul(S::div(dir.z, extentZ), scale.z) };
+				F* brickDirs[3] = { &brickDir.x, &brickDir.y, &brickDir.z };
+				for (int axis = 0; axis < 3; axis++) {
+					F d = *brickDirs[axis];
+					*brickDirs[axis] = S::mul(S::max(S::abs(d), S::set1(1e-6f)), S::select(S::ge(d, zero), one, S::set1(-1.0f)));
+				}
+
+				while (S::bits(active)) {
+					Vec3 texPos = {
+						S::div(S::add(S::add(cam.x, S::mul(dir.x, t)), halfX), extentX),
+						S::div(S::add(S::add(cam.y, S::mul(dir.y, t)), halfY), extentY),
+						S::div(S::add(S::add(cam.z, S::mul(dir.z, t)), halfZ), extentZ)
+					};
+
+					M sampling = active;
+					F advance = stepSize, sampleRatio = stepRatio;
+					bool longSteps = false;         // Some lane steps further than stepSize
+					if (frame.occupied || frame.maxOpacity) {
+						Vec3 brickPos = { S::mul(texPos.x, scale.x), S::mul(texPos.y, scale.y), S::mul(texPos.z, scale.z) };
+						S::storei(brick[0], S::mini(S::maxi(S::truncate(brickPos.x), S::seti(0)), S::seti(frame.lastBrick[0])));
+						S::storei(brick[1], S::mini(S::maxi(S::truncate(brickPos.y), S::seti(0)), S::seti(frame.lastBrick[1])));
+						S::storei(brick[2], S::mini(S::maxi(S::truncate(brickPos.z), S::seti(0)), S::seti(frame.lastBrick[2])));
+
+						int activeBits = S::bits(active), emptyBits = 0;
+						for (int lane = 0; lane < W; lane++) {
+							stepScales[lane] = 1.0f;
+							if (!((activeBits >> lane) & 1)) continue;
+							size_t index = (size_t(brick[2][lane]) * frame.gridDims[1] + brick[1][lane]) * frame.gridDims[0] + brick[0][lane];
+							if (frame.occupied && frame.occupied[index] == 0) emptyBits |= 1 << lane;
+							if (frame.maxOpacity) stepScales[lane] = raycast::adaptiveStepScale(frame, frame.maxOpacity[index]);
+							longSteps |= stepScales[lane] > 1.0f;
+						}
+
+						if (emptyBits || longSteps) {
+							// Distance to the first sample past the brick, on the same lattice of t values
+							const F* positions[3] = { &brickPos.x, &brickPos.y, &brickPos.z };
+							F tBrick = S::set1(INFINITY);
+							for (int axis = 0; axis < 3; axis++) {
+								F p = *positions[axis], d = *brickDirs[axis];
+								F boundary = S::add(S::floor(p), S::select(S::ge(d, zero), one, zero));
+								tBrick = S::min(tBrick, S::div(S::sub(boundary, p), d));
+							}
+							F pastBrick = S::mul(S::max(S::ceil(S::div(tBrick, stepSize)), one), stepSize);
+							if (longSteps) {
+								advance = S::min(S::mul(stepSize, S::load(stepScales)), pastBrick);
+								sampleRatio = S::mul(stepRatio, S::div(advance, stepSize));
+							}
+							if (emptyBits) {
+								M empty = S::fromBits(emptyBits);
+								t = S::select(empty, S::add(t, pastBrick), t);
+								active = S::mandnot(active, S::mand(empty, S::gt(t, texit)));
+								sampling = S::mandnot(active, empty);
+							}
+						}
+					}
+
+					if (S::bits(sampling)) {
+						F value = sampleVolume<T>(frame, level, uniformLevel, texPos, sampling);
+						F scalar = S::min(S::max(S::div(S::sub(value, windowMin), windowRange), zero), one);
+
+						// GL_LINEAR lookup in the GL_REPEAT transfer function
+						F u = S::sub(S::mul(scalar, S::set1(256.0f)), S::set1(0.5f));
+						F base = S::floor(u);
+						F f = S::sub(u, base);
+						I i0 = S::truncate(base);
+						I texel0 = S::muli(S::andi(i0, S::seti(255)), S::seti(4));
+						I texel1 = S::muli(S::andi(S::addi(i0, S::seti(1)), S::seti(255)), S::seti(4));
+						F src[4];
+						for (int channel = 0; channel < 4; channel++) {
+							F a = S::gather(frame.transferFunction + channel, texel0, sampling);
+							F b = S::gather(frame.transferFunction + channel, texel1, sampling);
+							src[channel] = S::add(a, S::mul(f, S::sub(b, a)));
+						}
+
+						F weight = scalar;
+						if (correction || longSteps) {
+							S::store(lane0, scalar);
+							S::store(lane1, src[3]);
+							S::store(lane2, sampleRatio);
+							for (int lane = 0; lane < W; lane++) {
+								if (lane2[lane] != 1.0f) lane0[lane] = raycast::correctedWeight(lane0[lane], lane1[lane], lane2[lane]);
+							}
+							weight = S::load(lane0);
+						}
+
+						F transmittance = S::sub(one, dstA);
+						dstR = S::select(sampling, S::add(dstR, S::mul(S::mul(transmittance, src[0]), weight)), dstR);
+						dstG = S::select(sampling, S::add(dstG, S::mul(S::mul(transmittance, src[1]), weight)), dstG);
+						dstB = S::select(sampling, S::add(dstB, S::mul(S::mul(transmittance, src[2]), weight)), dstB);
+						dstA = S::select(sampling, S::add(dstA, S::mul(S::mul(transmittance, src[3]), weight)), dstA);
+
+						t = S::select(sampling, S::add(t, advance), t);
+						M finished = S::mor(S::gt(t, texit), S::gt(dstA, S::set1(0.95f)));
+						active = S::mandnot(active, S::mand(sampling, finished));
+					}
+				}
+
+				S::store(outR, dstR);
+				S::store(outG, dstG);
+				S::store(outB, dstB);
+				S::store(outA, dstA);
+				for (int lane = 0; lane < W; lane++) {
+					if ((covered >> lane) & 1) {
+						raycast::writeBlended(frame, px0 + lane % columns, py0 + lane / columns, outR[lane], outG[lane], outB[lane], outA[lane]);
+					}
+				}
+			}
+		}
+	}
+
+	static void render(const RayCastFrame& frame, int x0, int y0, int x1, int y1)
+	{
+		switch (frame.volumeType) {
+		case VoxelType::UInt8: renderTile<uint8_t>(frame, x0, y0, x1, y1); break;
+		case VoxelType::UInt16: renderTile<uint16_t>(frame, x0, y0, x1, y1); break;
+		case VoxelType::Int16: renderTile<int16_t>(frame, x0, y0, x1, y1); break;
+		case VoxelType::Float32: renderTile<float>(frame, x0, y0, x1, y1); break;
+		default: break;
+		}
+	}
+};
\ No newline at end of file
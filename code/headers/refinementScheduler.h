@@ -0,0 +1,69 @@
+#pragma once
+
+#include <vector>
+
+// One ray casting pass chosen by the RefinementScheduler: rows [rowBegin, rowEnd) of the image of `level`
+struct RefinementPass {
+	int level = 0;
+	float resolutionScale = 1.0f;  // Fraction of the window resolution
+	float stepScale = 1.0f;        // Multiple of the base step size
+	int width = 0, height = 0;     // Size of the level's image
+	int rowBegin = 0, rowEnd = 0;
+	bool completesLevel = false;
+};
+
+// Decides what to ray cast each frame so that the frame time stays within a budget.
+// While the view changes, the finest level whose predicted cost fits the interactive budget is rendered whole.
+// Once the view has been still for `settleDelay` seconds, the finer levels are rendered in bands of rows,
+// as many rows per frame as the refinement budget allows, until the full resolution / base step image is done.
+// The cost model is a running estimate of GPU milliseconds per (pixel x sample step), fed by measured pass times.
+class RefinementScheduler
+{
+public:
+	struct Level {
+		float resolutionScale;
+		float stepScale;
+	};
+
+private:
+	std::vector<Level> levels = { { 0.25f, 4.0f }, { 0.5f, 2.0f }, { 0.5f, 1.0f }, { 1.0f, 1.0f } };
+
+	double msPerUnit = -1.0;       // < 0 until the first measurement arrives
+	int displayedLevel = -1;       // Finest level whose complete image is displayed, -1 when stale
+	int workLevel = -1;            // Level currently being refined in bands
+	int workRow = 0;
+	bool viewChanged = true;
+	double lastChangeTime = 0.0;
+
+	double passUnits(const RefinementPass& pass) const;
+	void makePass(int level, int windowWidth, int windowHeight, RefinementPass& pass) const;
+
+public:
+	float interactiveBudgetMs = 12.0f;
+	float refinementBudgetMs = 12.0f;
+	float settleDelay = 0.1f;
+	bool enabled = true;
+
+	// The view, transfer function or window changed; the current image is stale
+	void invalidate(double now);
+
+	// Fills `pass` with the work for this frame; returns false when there is nothing to render now
+	bool nextPass(double now, int windowWidth, int windowHeight, RefinementPass& pass);
+
+	// Whole image at full resolution and base step size
+	void finalPass(int windowWidth, int windowHeight, RefinementPass& pass) const { makePass(int(levels.size()) - 1, windowWidth, windowHeight, pass); }
+
+	// Marks a pass as rendered (before its timing is known)
+	void passRendered(const RefinementPass& pass);
+
+	// Feeds back the measured GPU time of a pass
+	void passTimed(const RefinementPass& pass, double gpuMs);
+
+	// Seconds until refinement may start, 0 when work can be done right now, < 0 when converged
+	double timeUntilWork(double now) const;
+
+	bool isConverged() const { return !viewChanged && displayedLevel == int(levels.size()) - 1; }
+	int getDisplayedLevel() const { return displayedLevel; }
+	int getLevelCount() const { return int(levels.size()); }
+	double getMsPerMegaSample() const { return msPerUnit * 1e6; }
+};
\ No newline at end of file
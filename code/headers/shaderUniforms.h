@@ -0,0 +1,46 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <glm/glm.hpp>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Uniform locations of one linked program, resolved once after linking, plus a shadow copy of the
+// last value sent to each uniform. Per frame updates only reach the driver when a value changed.
+// Handles are indices into the name table passed to resolve(); the program must be current when setting.
+class ShaderUniforms
+{
+private:
+	struct Slot {
+		const char* name = "";
+		GLint location = -1;
+		float value[16] = {};
+		bool hasValue = false;
+	};
+
+	GLuint program = 0;
+	std::vector<Slot> slots;
+	int uploads = 0;
+
+	bool changed(int handle, const float* data, int count);
+
+public:
+	// Looks up every name in `names`; uniforms missing from the program are reported unless listed in `optional`
+	bool resolve(GLuint program, const char* const* names, int count, const std::vector<int>& optional = {});
+
+	GLuint getProgram() const { return program; }
+	GLint location(int handle) const { return slots[handle].location; }
+
+	// Forgets the shadow values, e.g. after something else wrote the uniforms directly
+	void invalidate();
+
+	void set(int handle, float value);
+	void set(int handle, int value);
+	void set(int handle, const glm::vec3& value);
+	void set(int handle, const glm::mat4& value);
+
+	// Number of glUniform calls actually issued since the last call
+	int takeUploadCount();
+};
\ No newline at end of file
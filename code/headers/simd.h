@@ -0,0 +1,174 @@
+#pragma once
+
+#include <immintrin.h>
+
+// Thin wrappers giving SSE4.1, AVX2 and AVX-512 the same interface, so kernels are written once as templates
+// over the wrapper and instantiated in translation units compiled for the matching instruction set.
+// Only include this from those translation units. Masks compare per lane; select(m, a, b) takes a where m is set.
+// Gathers only read lanes whose mask is set; unset lanes return 0.
+
+#if defined(VOLREN_SIMD_SSE4)
+struct SimdSSE4 {
+	static constexpr int width = 4;
+	using F = __m128;
+	using I = __m128i;
+	using M = __m128;
+
+	static F set1(float v) { return _mm_set1_ps(v); }
+	static F load(const float* p) { return _mm_loadu_ps(p); }
+	static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+	static I seti(int v) { return _mm_set1_epi32(v); }
+	static void storei(int* p, I v) { _mm_storeu_si128(reinterpret_cast<__m128i*>(p), v); }
+
+	static F add(F a, F b) { return _mm_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm_div_ps(a, b); }
+	static F min(F a, F b) { return _mm_min_ps(a, b); }
+	static F max(F a, F b) { return _mm_max_ps(a, b); }
+	static F sqrt(F a) { return _mm_sqrt_ps(a); }
+	static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+	static F floor(F a) { return _mm_floor_ps(a); }
+	static F ceil(F a) { return _mm_ceil_ps(a); }
+
+	static I truncate(F a) { return _mm_cvttps_epi32(a); }
+	static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+	static I addi(I a, I b) { return _mm_add_epi32(a, b); }
+	static I muli(I a, I b) { return _mm_mullo_epi32(a, b); }
+	static I mini(I a, I b) { return _mm_min_epi32(a, b); }
+	static I maxi(I a, I b) { return _mm_max_epi32(a, b); }
+	static I andi(I a, I b) { return _mm_and_si128(a, b); }
+
+	static M lt(F a, F b) { return _mm_cmplt_ps(a, b); }
+	static M le(F a, F b) { return _mm_cmple_ps(a, b); }
+	static M gt(F a, F b) { return _mm_cmpgt_ps(a, b); }
+	static M ge(F a, F b) { return _mm_cmpge_ps(a, b); }
+	static M neq(F a, F b) { return _mm_cmpneq_ps(a, b); }
+	static M mand(M a, M b) { return _mm_and_ps(a, b); }
+	static M mor(M a, M b) { return _mm_or_ps(a, b); }
+	static M mandnot(M a, M b) { return _mm_andnot_ps(b, a); }   // a & ~b
+	static M fromBits(int bits)
+	{
+		const __m128i lanes = _mm_setr_epi32(1, 2, 4, 8);
+		return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(_mm_set1_epi32(bits), lanes), lanes));
+	}
+	static int bits(M m) { return _mm_movemask_ps(m); }
+	static F select(M m, F a, F b) { return _mm_blendv_ps(b, a, m); }
+
+	static F gather(const float* base, I index, M m)
+	{
+		alignas(16) int lanes[4];
+		alignas(16) float values[4];
+		storei(lanes, index);
+		int active = bits(m);
+		for (int i = 0; i < 4; i++) values[i] = (active >> i) & 1 ? base[lanes[i]] : 0.0f;
+		return _mm_load_ps(values);
+	}
+};
+#endif
+
+#if defined(VOLREN_SIMD_AVX2)
+struct SimdAVX2 {
+	static constexpr int width = 8;
+	using F = __m256;
+	using I = __m256i;
+	using M = __m256;
+
+	static F set1(float v) { return _mm256_set1_ps(v); }
+	static F load(const float* p) { return _mm256_loadu_ps(p); }
+	static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+	static I seti(int v) { return _mm256_set1_epi32(v); }
+	static void storei(int* p, I v) { _mm256_storeu_si256(reinterpret_cast<__m256i*>(p), v); }
+
+	static F add(F a, F b) { return _mm256_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm256_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm256_div_ps(a, b); }
+	static F min(F a, F b) { return _mm256_min_ps(a, b); }
+	static F max(F a, F b) { return _mm256_max_ps(a, b); }
+	static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+	static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+	static F floor(F a) { return _mm256_floor_ps(a); }
+	static F ceil(F a) { return _mm256_ceil_ps(a); }
+
+	static I truncate(F a) { return _mm256_cvttps_epi32(a); }
+	static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+	static I addi(I a, I b) { return _mm256_add_epi32(a, b); }
+	static I muli(I a, I b) { return _mm256_mullo_epi32(a, b); }
+	static I mini(I a, I b) { return _mm256_min_epi32(a, b); }
+	static I maxi(I a, I b) { return _mm256_max_epi32(a, b); }
+	static I andi(I a, I b) { return _mm256_and_si256(a, b); }
+
+	static M lt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+	static M le(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+	static M gt(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+	static M ge(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+	static M neq(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_NEQ_UQ); }
+	static M mand(M a, M b) { return _mm256_and_ps(a, b); }
+	static M mor(M a, M b) { return _mm256_or_ps(a, b); }
+	static M mandnot(M a, M b) { return _mm256_andnot_ps(b, a); }
+	static M fromBits(int bits)
+	{
+		const __m256i lanes = _mm256_setr_epi32(1, 2, 4, 8, 16, 32, 64, 128);
+		return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(_mm256_set1_epi32(bits), lanes), lanes));
+	}
+	static int bits(M m) { return _mm256_movemask_ps(m); }
+	static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+
+	static F gather(const float* base, I index, M m)
+	{
+		return _mm256_mask_i32gather_ps(_mm256_setzero_ps(), base, index, m, 4);
+	}
+};
+#endif
+
+#if defined(VOLREN_SIMD_AVX512)
+struct SimdAVX512 {
+	static constexpr int width = 16;
+	using F = __m512;
+	using I = __m512i;
+	using M = __mmask16;
+
+	static F set1(float v) { return _mm512_set1_ps(v); }
+	static F load(const float* p) { return _mm512_loadu_ps(p); }
+	static void store(float* p, F v) { _mm512_storeu_ps(p, v); }
+	static I seti(int v) { return _mm512_set1_epi32(v); }
+	static void storei(int* p, I v) { _mm512_storeu_si512(p, v); }
+
+	static F add(F a, F b) { return _mm512_add_ps(a, b); }
+	static F sub(F a, F b) { return _mm512_sub_ps(a, b); }
+	static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+	static F div(F a, F b) { return _mm512_div_ps(a, b); }
+	static F min(F a, F b) { return _mm512_min_ps(a, b); }
+	static F max(F a, F b) { return _mm512_max_ps(a, b); }
+	static F sqrt(F a) { return _mm512_sqrt_ps(a); }
+	static F abs(F a) { return _mm512_abs_ps(a); }
+	static F floor(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_NEG_INF | _MM_FROUND_NO_EXC); }
+	static F ceil(F a) { return _mm512_roundscale_ps(a, _MM_FROUND_TO_POS_INF | _MM_FROUND_NO_EXC); }
+
+	static I truncate(F a) { return _mm512_cvttps_epi32(a); }
+	static F toFloat(I a) { return _mm512_cvtepi32_ps(a); }
+	static I addi(I a, I b) { return _mm512_add_epi32(a, b); }
+	static I muli(I a, I b) { return _mm512_mullo_epi32(a, b); }
+	static I mini(I a, I b) { return _mm512_min_epi32(a, b); }
+	static I maxi(I a, I b) { return _mm512_max_epi32(a, b); }
+	static I andi(I a, I b) { return _mm512_and_si512(a, b); }
+
+	static M lt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+	static M le(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+	static M gt(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+	static M ge(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+	static M neq(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_NEQ_UQ); }
+	static M mand(M a, M b) { return M(a & b); }
+	static M mor(M a, M b) { return M(a | b); }
+	static M mandnot(M a, M b) { return M(a & ~b); }
+	static M fromBits(int bits) { return M(bits); }
+	static int bits(M m) { return int(m); }
+	static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+
+	static F gather(const float* base, I index, M m)
+	{
+		return _mm512_mask_i32gather_ps(_mm512_setzero_ps(), m, index, base, 4);
+	}
+};
+#endif
\ No newline at end of file
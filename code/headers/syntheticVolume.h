@@ -0,0 +1,31 @@
+#pragma once
+
+#include <cmath>
+#include <cstdint>
+#include <algorithm>
+#include <glm/glm.hpp>
+#include "voxelType.h"
+#include "parallel.h"
+
+// Concentric shells inside a sphere plus a little hashed noise: a mix of empty bricks, homogeneous regions and
+// sharp boundaries, similar to what empty space skipping and the gradients see in a CT scan. Shared by the
+// micro-benchmarks and the core tests; `voxels` is n^3, x fastest.
+template<typename T>
+void fillSyntheticVolume(T* voxels, int n)
+{
+	parallelFor(0, n, [&](int zBegin, int zEnd) {
+		const float center = 0.5f * (n - 1);
+		for (int z = zBegin; z < zEnd; z++) {
+			for (int y = 0; y < n; y++) {
+				for (int x = 0; x < n; x++) {
+					glm::vec3 p = (glm::vec3(float(x), float(y), float(z)) - center) / (0.5f * n);
+					float r = glm::length(p);
+					uint32_t hash = uint32_t(x) * 73856093u ^ uint32_t(y) * 19349663u ^ uint32_t(z) * 83492791u;
+					float noise = float((hash * 2654435761u) >> 24) / 255.0f;
+					float value = r < 0.95f ? 0.25f + 0.5f * (0.5f + 0.5f * std::cos(r * 24.0f)) + 0.05f * noise : 0.0f;
+					voxels[(size_t(z) * n + y) * n + x] = T(std::min(value, 1.0f) * VoxelTraits<T>::scale);
+				}
+			}
+		}
+	});
+}
@@ -0,0 +1,63 @@
+#pragma once
+
+#include <vector>
+#include <atomic>
+#include <memory>
+#include <cstdint>
+#include <functional>
+#include "parallel.h"
+
+// What the last frame's tiles cost, for profiling the CPU render path
+struct TileStats {
+	int tiles = 0;                      // Screen tiles of tileSize x tileSize pixels
+	int workItems = 0;                  // Tiles plus the pieces expensive tiles were split into
+	int splitTiles = 0;
+	int steals = 0;                     // Work items a thread took from another thread's queue
+	double frameMs = 0.0;
+	double minItemMs = 0.0, maxItemMs = 0.0, meanItemMs = 0.0;
+	double imbalance = 1.0;             // Busiest thread's busy time over the mean busy time
+	std::vector<double> threadBusyMs;   // Per pool thread
+};
+
+// Work-stealing scheduler over screen tiles. Each tile remembers what it cost in the previous frame; tiles
+// that cost several times a fair share are split into quarters, and the work items are dealt to per-thread
+// queues most expensive first, always to the least loaded thread (longest processing time first). Owners pop
+// from the expensive end of their queue, idle threads steal from the cheap end of another, so prediction
+// errors (the camera moved, a tile turned out dense) are evened out at the end of the frame.
+// Queues are filled before the frame starts and only shrink afterwards, so each one is a single atomic word
+// holding [head, tail).
+class TileScheduler
+{
+private:
+	struct WorkItem {
+		int x0, y0, x1, y1;
+		int tile;
+		float predictedCost;
+	};
+	struct alignas(64) WorkQueue {
+		std::atomic<uint64_t> range{ 0 };
+	};
+
+	int width = 0, height = 0, tileSize = 0;
+	int tilesX = 0, tilesY = 0;
+	std::vector<float> tileCost;        // Seconds spent on each tile last frame, empty before the first frame
+	std::vector<WorkItem> items;        // Grouped by queue
+	std::vector<float> itemCost;        // Measured seconds per item
+	std::unique_ptr<WorkQueue[]> queues;
+	int queueCount = 0;
+	TileStats stats;
+
+	void plan(int threads);
+	bool pop(int queue, int& item);
+	bool steal(int thief, int& item);
+	void collectStats(int threads, const std::vector<double>& busy, const std::vector<int>& steals, double frameSeconds);
+
+public:
+	// Calls renderTile(x0, y0, x1, y1) for rectangles covering [0, width) x [0, height) on all threads of the pool
+	void run(ThreadPool& pool, int width, int height, int tileSize, const std::function<void(int, int, int, int)>& renderTile);
+
+	// Forgets the per-tile costs, e.g. when the volume or transfer function changes completely
+	void reset() { tileCost.clear(); }
+
+	const TileStats& getStats() const { return stats; }
+};
@@ -0,0 +1,48 @@
+#pragma once
+
+#include <string>
+#include <chrono>
+
+// Event tracing for hitch reports: scopes on any thread are recorded as complete events into a buffer owned by
+// that thread, without locks, and written as Chrome trace JSON (chrome://tracing, ui.perfetto.dev) on demand or
+// at exit. Recording is off until start() is called, and costs one relaxed atomic load per scope until then.
+// Event names are not copied: pass string literals or other strings that outlive the trace.
+namespace trace {
+
+using Clock = std::chrono::steady_clock;
+
+// Enables recording; write() without a path writes to `path`
+void start(const std::string& path);
+bool isEnabled();
+
+// Names the calling thread in the trace, e.g. at the top of a worker thread
+void setThreadName(const char* name);
+
+void record(const char* name, Clock::time_point begin, Clock::time_point end);
+
+// Writes everything recorded so far, from all threads, while they keep recording
+bool write();
+bool write(const std::string& path);
+
+}
+
+// Records the enclosing scope as one event
+class TraceScope
+{
+private:
+	const char* name;
+	trace::Clock::time_point begin;
+	bool active;
+
+public:
+	explicit TraceScope(const char* eventName) : name(eventName), active(trace::isEnabled())
+	{
+		if (active) begin = trace::Clock::now();
+	}
+	~TraceScope()
+	{
+		if (active) trace::record(name, begin, trace::Clock::now());
+	}
+	TraceScope(const TraceScope&) = delete;
+	TraceScope& operator=(const TraceScope&) = delete;
+};
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <vector>
+#include <string>
+#include <glm/vec4.hpp>
+
+struct TransferFunctionPoint {
+	float position; // 0.0 to 1.0 (Normalized)
+	glm::vec4 color;   // RGBA
+};
+
+// Linear ramp from transparent black to opaque white
+inline std::vector<TransferFunctionPoint> defaultTransferFunction()
+{
+	return { {0.0f, glm::vec4(0, 0, 0, 0)}, {1.0f, glm::vec4(1, 1, 1, 1)} };
+}
+
+// Samples the piecewise linear control points into a 256 entry RGBA lookup table
+void buildTransferFunctionLUT(const std::vector<TransferFunctionPoint>& controlPoints, float* rgba256);
+
+// Pre-integrated segment table for buildTransferFunctionLUT's output: entry (front, back), front fastest, covers a
+// ray segment of one base step over which the windowed scalar goes linearly from front/255 to back/255. Samples are
+// weighted as in fshader11 (opacity = LUT alpha * scalar). Alpha holds the mean extinction -ln(1 - opacity) per
+// base step, so a segment of r steps has opacity 1 - exp(-r * alpha); rgb is the colour per unit opacity,
+// extinction-weighted over the segment. Built in O(256^2) from prefix sums.
+void buildPreIntegrationTable(const float* rgba256, float* table256x256);
+
+// Binary format: point count (size_t), then position (float) and colour (4 floats) per point
+bool saveTransferFunction(const std::string& fileName, const std::vector<TransferFunctionPoint>& controlPoints);
+bool loadTransferFunction(const std::string& fileName, std::vector<TransferFunctionPoint>& controlPoints);
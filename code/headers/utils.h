@@ -18,6 +18,18 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 
+#include "voxelType.h"
+#include "transferFunction.h"
+#include "brickGrid.h"
+#include "volumePyramid.h"
+#include "brickedVolume.h"
+#include "brickStreamer.h"
+#include "volumeUploader.h"
+#include "gradientVolume.h"
+#include "shaderUniforms.h"
+#include "refinementScheduler.h"
+#include "profiler.h"
+
 // [Win32] Our example includes a copy of glfw3.lib pre-compiled with VS2010 to maximize ease of testing and compatibility with old VS compilers.
 // To link with VS2010-era libraries, VS2015+ requires linking with legacy_stdio_definitions.lib, which we do using this pragma.
 // Your own project should not be affected, as you are likely to link with a newer binary of GLFW that is adequate for your version of Visual Studio.
@@ -29,15 +41,11 @@
 #define HEIGHT 1080
 #define WINDOWNAME "Volume Rendering"
 
-struct TransferFunctionPoint {
-	float position; // 0.0 to 1.0 (Normalized)
-	ImVec4 color;   // RGBA
-};
-
 class GLFWindow {
 private:
 	int Width, Height;
 	std::string WindowName;
+	bool headless;                         // Hidden window without GUI, used by the batch renderer
 
 	GLFWwindow* Window;
 
@@ -56,32 +64,121 @@ private:
 	float step_size = 1;
 	glm::vec3 VolumeSize;
 
-	GLint vModel_uniform, vView_uniform, vProjection_uniform;
+	VoxelType volumeType = VoxelType::UInt8;
+	float volumeTypeScale = 255.0f;        // File units per sampled texture unit (UNORM/SNORM/float)
+	glm::vec2 dataRange = glm::vec2(0, 255);
+	glm::vec2 windowRange = glm::vec2(0, 255);  // Values mapped onto [0, 1] of the transfer function, in file units
+
 	GLint vColor_uniform;
 
-	GLuint VAO, tfTex, volumeTex;
-	GLfloat* TransferFun = new GLfloat[256 * 4];
+	ShaderUniforms uniforms;
+	int uniformUploads = 0;                // glUniform calls issued by the last SetUniforms()
+	void BindUniforms();
+
+	// Cached ray cast image, composited under the GUI every frame and only re-rendered when something changed
+	GLuint volumeFBO = 0, volumeColorTex = 0, volumeDepthRB = 0;
+	int fboWidth = 0, fboHeight = 0;
+	int volumeFrames = 0;
+	int guiFramesPending = 0;
+	void CreateVolumeFramebuffer(int width, int height);
+
+	// Progressive refinement: passes are ray cast into refineFBO at the scheduled resolution and step size,
+	// completed levels are upscaled into volumeFBO. Pass GPU times feed the scheduler's cost model.
+	RefinementScheduler refinement;
+	GLuint refineFBO = 0, refineColorTex = 0, refineDepthRB = 0;
+	bool timerQueriesSupported = false;
+	GLuint passQueries[2] = { 0, 0 };
+	RefinementPass queryPasses[2];
+	bool queryPending[2] = { false, false };
+	int queryIndex = 0;
+	float lastPassTime = 0.0f;
+	void RenderVolumePass(const RefinementPass& pass);
+	void CollectPassTimings();
+
+	GLuint VAO, tfTex = 0, volumeTex = 0;
+	GLint volumeInternalFormat = GL_R8;
+	GLenum volumeDataType = GL_UNSIGNED_BYTE;
+	int volumeLevels = 1;                  // Mip levels of volumeTex
+	bool levelOfDetail = false;
+	float lodBias = 0.0f;
+	MipFilter mipFilter = MipFilter::Average;
+	GLuint tfPixelBuffers[2] = { 0, 0 };
+	int tfPixelBufferIndex = 0;
+	bool useTransferFunctionPBO = false;
+	void UploadTransferFunction();
+	GLfloat* TransferFun = new GLfloat[256 * 4]();
+
+	// Pre-integrated (front, back) segment table of the transfer function (unit 6), rebuilt with it
+	GLuint preIntegrationTex = 0;
+	std::vector<float> preIntegrationTable = std::vector<float>(256 * 256 * 4);
+	void UploadPreIntegrationTable();
+
+	const BrickGrid* brickGrid = nullptr;
+	GLuint occupancyTex = 0;
+	OccupancyGrid occupancyGrid;
+	bool emptySpaceSkipping = true;
+	float occupancyUpdateTime = 0.0f;     // Milliseconds spent in the last occupancy refresh
+
+	// Out-of-core volumes: bricks stream into an atlas texture (unit 4) and are found through a page table with
+	// one texel per brick (unit 3); the occupancy grid uses the same bricks
+	BrickedVolume* brickedVolume = nullptr;
+	BrickStreamer streamer;
+	GLuint brickAtlasTex = 0, pageTableTex = 0;
+	size_t streamingUploadBudget = size_t(32) << 20;  // Bytes uploaded per frame
+	bool streamingRequestsStale = true;
+	void UpdateStreaming();
+	void FinishStreaming();
+
+	// Asynchronous volume upload, see BeginVolumeUpload
+	VolumeUploader volumeUploader;
+	double uploadStartTime = 0.0;
+	float uploadTime = 0.0f;               // Milliseconds from BeginVolumeUpload to the last slab
+	bool uploadPersistent = false;
+
+	// Packed gradients for shading (unit 5), uploaded like the volume
+	GLuint gradientTex = 0;
+	VolumeUploader gradientUploader;
+	bool shading = false;
+	float gradientOpacity = 0.0f;         // 0 keeps the transfer function opacity, 1 scales it by the gradient magnitude
+	bool GradientsReady() const { return gradientTex != 0 && !gradientUploader.isActive() && brickedVolume == nullptr; }
+
+	void SetVolumeFormat(VoxelType type, glm::vec2 valueRange);
+	void AllocateVolumeTexture(const void* volume, int x, int y, int z);
+	void SetVolumeGeometry(glm::vec3 dims, glm::vec3 spacing);
+
+	glm::vec2 GetNormalizedWindow();
 	int selectedControlPoint = 0;
 
 	ImVec4 clearColor = ImVec4(1.0f, 1.0f, 1.0f, 1.00f);
 
-	std::vector<TransferFunctionPoint> controlPoints = {
-		{0.0f, ImVec4(0, 0, 0, 0)},
-		{1.0f, ImVec4(1, 1, 1, 1)}
-	};
+	std::vector<TransferFunctionPoint> controlPoints = defaultTransferFunction();
 
 	char TfFileName[256] = "";
 	std::string tfFolderPath = "../TransferFunctions/";
 	bool showTFSelector = false;
 	bool SaveTransferFunction(std::string fileName);
-	bool LoadTransferFunction(std::string fileName);
 	void ShowTransferFunctionSelector();
 
 public:
-	GLFWindow(int width = WIDTH, int height = HEIGHT, std::string name = WINDOWNAME);
+	enum UniformId {
+		U_CAM_POSITION, U_STEP_SIZE, U_EXTENT_MIN, U_EXTENT_MAX, U_WINDOW_MIN, U_WINDOW_MAX,
+		U_TEXTURE3D, U_TRANSFERFUN, U_EMPTY_SPACE_SKIPPING, U_OCCUPANCY_GRID, U_BRICK_GRID_SCALE,
+		U_MODEL, U_VIEW, U_PROJECTION, U_SCREEN_WIDTH, U_SCREEN_HEIGHT, U_STEP_RATIO,
+		U_LEVEL_OF_DETAIL, U_LOD_BIAS, U_MAX_LOD,
+		U_OUT_OF_CORE, U_PAGE_TABLE, U_BRICK_ATLAS, U_PAGE_BRICK_SIZE, U_VOLUME_DIMS,
+		U_SHADING, U_GRADIENT_VOLUME, U_GRADIENT_OPACITY,
+		U_PRE_INTEGRATED, U_PRE_INTEGRATION_TABLE,
+		U_ADAPTIVE_STEPPING, U_ADAPTIVE_OPACITY, U_MAX_STEP_SCALE,
+		U_COUNT
+	};
+
+	GLFWindow(int width = WIDTH, int height = HEIGHT, std::string name = WINDOWNAME, bool headless = false);
 	GLFWwindow* setupWindow();
+	GLFWwindow* createOffscreenContext();
 
-	bool renderParamsChanged = false;
+	bool renderParamsChanged = true;      // The volume image is stale and has to be ray cast again
+	bool renderOnDemand = true;           // Sleep in glfwWaitEvents while nothing changes
+	bool inputReceived = false;
 	float currentFrameTime = 0.0f, lastFrameTime = 0.0f, deltaTime = 0.0f;
 	glm::vec3 camposition = glm::vec3(0, 0, 280.0);
 	glm::vec3 camup = glm::vec3(0.0, 1.0, 0.0);
@@ -99,28 +196,67 @@ public:
 	void DrawTransferFunctionEditor();
 	void RenderGUI();
 
-	void SetUniforms();
+	void SetUniforms(float stepScale = 1.0f, int viewportWidth = 0, int viewportHeight = 0);
 
 	void SetupViewTransformation();
+	void SetCamera(const glm::vec3& position, const glm::vec3& at, const glm::vec3& up);
 	void SetupModelTransformation();
 	void SetupProjectionTransformation();
 	glm::vec3 getTrackBallVector(double x, double y);
 
-	void Create3DVolumeTexture(GLubyte*, float x_size, float y_size, float z_size);
+	bool halfFloatVolume = false;          // Store float volumes as GL_R16F instead of GL_R32F
+	bool preIntegration = false;           // Composite ray segments from the pre-integrated table instead of point samples
+	// Longer steps through bricks whose maximum opacity (from the occupancy grid) is low, up to maxStepScale steps
+	bool adaptiveStepping = false;
+	float adaptiveOpacity = 0.05f;
+	float maxStepScale = 4.0f;
+	Profiler profiler;                     // Frame stage timings, shown in the Information window
+	// Ray step in world units (the finest voxel is one unit long); opacity is corrected for steps other than 1
+	void SetStepSize(float size) { step_size = size; renderParamsChanged = true; }
+
+	void Create3DVolumeTexture(const void*, VoxelType type, float x_size, float y_size, float z_size, glm::vec3 spacing = glm::vec3(1.0f), glm::vec2 valueRange = glm::vec2(0, 255));
+	// Allocates the volume texture and fills it slab by slab from a background thread while the render loop keeps
+	// running; the volume is drawn once the last slab is on the GPU. `volume` must stay valid until then.
+	void BeginVolumeUpload(const void* volume, VoxelType type, int x_size, int y_size, int z_size, glm::vec3 spacing, glm::vec2 valueRange);
+	void FinishVolumeUpload();
+	std::string loadingStatus;             // Shown in the Information window while the application is still loading
 	void Create1DTransferFunction();
+	// Uploads levels 1.. of the pyramid as the mipmaps of the volume texture and enables level of detail
+	void SetVolumePyramid(const VolumePyramid* pyramid, bool enableLevelOfDetail, float bias = 0.0f);
+
+	// Uploads packed gradients in the background and enables shading once they are on the GPU; `gradients` must
+	// stay valid until then. Not used for out-of-core volumes.
+	void SetGradientVolume(const GradientVolume* gradients, bool enableShading, float opacityModulation = 0.0f);
+
+	// Streams the bricks of an out-of-core volume instead of uploading a volume texture; budgetBytes bounds the atlas.
+	// Call SetBrickGrid with the volume's brick ranges afterwards.
+	bool SetOutOfCoreVolume(BrickedVolume* volume, size_t budgetBytes);
+
+	void SetBrickGrid(const BrickGrid* grid);
+	void UpdateOccupancyGrid();
 
 	void CreateBoundingBox();
 
 	bool Run();
 
+	bool LoadTransferFunction(std::string fileName);
+
+	// Ray casts the full resolution image offscreen, with every upload and streamed brick in place first
+	bool RenderFrame();
+	// RenderFrame and read the image back as bottom-up RGBA rows
+	bool RenderToImage(std::vector<unsigned char>& rgba);
+	int GetWidth() const { return Width; }
+	int GetHeight() const { return Height; }
+	glm::vec3 GetVolumeSize() const { return VolumeSize; }
+
 	void ResizeWindow(int width, int height);
 
 	void cleanup();
 };
 
 struct GLFCameraWindow : public GLFWindow {
-	GLFCameraWindow(int width, int height, std::string title)
-		: GLFWindow(width, height, title)
+	GLFCameraWindow(int width, int height, std::string title, bool headless = false)
+		: GLFWindow(width, height, title, headless)
 	{
 		glm::vec3 camera_from = camposition;
 		glm::vec3 camera_at = glm::vec3(0, 0, 0);
@@ -228,6 +364,8 @@ struct GLFCameraWindow : public GLFWindow {
 			camup = glm::vec3(0, 1, 0);
 			SetupViewTransformation();
 
+			renderParamsChanged = true;
+
 			lastX = xPos;
 			lastY = yPos;
 		}
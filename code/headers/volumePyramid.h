@@ -0,0 +1,40 @@
+#pragma once
+
+#include <vector>
+#include "voxelType.h"
+#include "voxelLayout.h"
+
+enum class MipFilter {
+	Average,    // Box filter, what GL mipmaps hold
+	Max         // Keeps thin bright structures (vessels, bone edges) visible in coarse levels
+};
+
+const char* mipFilterName(MipFilter filter);
+
+// Downsampled copies of the volume for level of detail sampling. Level 0 is the volume itself, level n + 1
+// halves every axis of level n (rounding down, never below one voxel) like a GL mip chain, so levels 1.. can be
+// uploaded as the mipmaps of the volume texture. Coarse levels are stored x fastest and built in parallel, each
+// from the one before, through VoxelAccessor so level 0 may use any layout.
+class VolumePyramid
+{
+private:
+	VoxelType voxelType = VoxelType::UInt8;
+	MipFilter filter = MipFilter::Average;
+	std::vector<const void*> levels;
+	std::vector<VoxelLayout> layouts;
+	std::vector<std::vector<unsigned char>> storage;   // Levels 1..
+
+	template<typename T>
+	void downsample(const VoxelAccessor<T>& source, T* target, const int* dims) const;
+
+public:
+	// Builds up to maxLevels levels in total (including level 0), stopping early at a single voxel
+	void build(const void* volume, VoxelType type, const VoxelLayout& layout, MipFilter filter, int maxLevels = 5);
+
+	int getLevelCount() const { return int(levels.size()); }
+	const void* getLevel(int level) const { return levels[level]; }
+	const VoxelLayout& getLayout(int level) const { return layouts[level]; }
+	const int* getDims(int level) const { return layouts[level].getDims(); }
+	VoxelType getVoxelType() const { return voxelType; }
+	MipFilter getFilter() const { return filter; }
+};
@@ -1,12 +1,21 @@
 #pragma once
 
 #include <string>
-#include "utils.h"
+#include <iostream>
+#include <glm/glm.hpp>
+#include "mappedFile.h"
+#include "voxelType.h"
+#include "voxelLayout.h"
+#include <vector>
 
 struct MHDHeader {
-	int dims[3]; // Dimensions for the image (NDims x DimSize)
+	int dims[3] = { 0, 0, 0 }; // Dimensions for the image (NDims x DimSize)
+	float spacing[3] = { 1, 1, 1 }; // ElementSpacing
 	std::string elementType;
 	std::string elementDataFile;
+	long long headerSize = 0; // Bytes to skip in the data file, -1 means the payload sits at the end of the file
+	bool byteOrderMSB = false;
+	size_t localDataOffset = 0; // Offset of the payload when ElementDataFile = LOCAL (.mha)
 };
 
 class VolumeReader
@@ -14,22 +23,68 @@ class VolumeReader
 private:
 	std::string filePath;
 
-	float x_size = 256;
-	float y_size = 256;
-	float z_size = 256;
-	const int vol_size = x_size * y_size * z_size;
-	unsigned char* volume = new unsigned char[vol_size];
+	int x_size = 0;
+	int y_size = 0;
+	int z_size = 0;
+	size_t vol_size = 0;
+	float spacing[3] = { 1, 1, 1 };
+	VoxelType voxelType = VoxelType::UInt8;
+	bool voxelTypeGiven = false;
+	bool valueRangeValid = false;
+	float valueRange[2] = { 0, 0 };
+
+	MappedFile volumeFile;                  // Voxels stay in the page cache and are handed straight to glTexImage3D
+
+	VoxelOrder layoutOrder = VoxelOrder::Linear;
+	int layoutTileSize = 8;
+	VoxelLayout layout;
+	std::vector<unsigned char> swizzled;    // Copy in `layout` for the CPU-side consumers, empty for the linear order
+
+	bool inferDimensions(const std::string& Path, size_t fileSize);
+	bool readRawVolume(const std::string& Path);
+	bool readMHDVolume(const std::string& Path);
+	bool mapPayload(const std::string& Path, size_t offset, bool swapBytes);
+
+	template<typename T>
+	void computeValueRange();
 
 public:
-	~VolumeReader() {
-		delete[] volume;
-	}
+	// Dimensions for headerless volumes that do not encode them in the file name (e.g. "head_256x256x225.raw")
+	void setVolumeDimensions(int x, int y, int z);
+	// Element type of headerless volumes, otherwise taken from a "uint16"/"int16"/"float32" token in the file name
+	void setVoxelType(VoxelType type);
+
+	// Order of the voxels the CPU-side consumers read (getCPUVolume), converted at load time
+	void setVoxelLayout(VoxelOrder order, int tileSize = 8);
+
+	static bool readMHDHeader(const std::string& Path, MHDHeader& header);
 
 	bool readVolume(std::string Path);
 
-	unsigned char* getVolume();
+	const void* getVolume();
+	VoxelType getVoxelType();
+
+	// Typed view of the voxels, nullptr when T does not match the file's element type
+	template<typename T>
+	const T* getVolumeAs() {
+		return VoxelTraits<T>::type == voxelType ? static_cast<const T*>(getVolume()) : nullptr;
+	}
+
+	// Voxels in the layout chosen with setVoxelLayout; the mapped file itself when that is the linear order.
+	// Everything that reads voxels on the CPU goes through these, the GPU upload keeps using getVolume().
+	const void* getCPUVolume();
+	const VoxelLayout& getCPULayout() { return layout; }
+
+	template<typename T>
+	VoxelAccessor<T> getAccessor() {
+		return VoxelTraits<T>::type == voxelType ? VoxelAccessor<T>(getCPUVolume(), layout) : VoxelAccessor<T>();
+	}
+
+	// Value range in file units. 8-bit volumes report the full [0, 255] range without scanning the data.
+	void getValueRange(float& minValue, float& maxValue);
 
 	float getVolumeDimensionX();
 	float getVolumeDimensionY();
 	float getVolumeDimensionZ();
-};
+	glm::vec3 getVolumeSpacing();
+};
\ No newline at end of file
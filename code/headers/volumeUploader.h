@@ -0,0 +1,71 @@
+#pragma once
+
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <functional>
+
+#define GLEW_STATIC
+#include <GL/glew.h>
+
+// Fills level 0 of an allocated 3D texture slab by slab without blocking the render loop. A reader thread copies
+// slabs of z layers from the source (typically a memory mapped file, so this is where the disk is read) into a
+// ring of pixel buffers; the render thread calls update() once per frame, which issues glTexSubImage3D for
+// every filled buffer and recycles the buffers the GPU has finished reading.
+// With ARB_buffer_storage the buffers are mapped once, persistently, and guarded by fences. Otherwise each
+// buffer is re-mapped (orphaned) by the render thread before it is handed back to the reader.
+class VolumeUploader
+{
+private:
+	enum SlotState { Free, Filling, Filled, InFlight };
+	struct Slot {
+		GLuint buffer = 0;
+		void* mapped = nullptr;
+		GLsync fence = nullptr;
+		SlotState state = Free;
+		int zBegin = 0, zEnd = 0;
+	};
+
+	GLuint texture = 0;
+	GLenum format = GL_RED, dataType = GL_UNSIGNED_BYTE;
+	int dims[3] = { 0, 0, 0 };
+	size_t layerBytes = 0;
+	int slabLayers = 1;
+	int slabCount = 0;
+	int nextUpload = 0;                 // Slab the render thread uploads next, slabs are uploaded in order
+	int uploadedSlabs = 0;
+	bool persistent = false;
+	std::vector<Slot> slots;
+
+	std::thread reader;
+	std::mutex mutex;
+	std::condition_variable slotFreed;
+	bool stopping = false;
+	const unsigned char* source = nullptr;
+	std::function<void()> onFilled;
+
+	void readerLoop();
+	void mapSlot(Slot& slot);
+	void releaseBuffers();
+
+public:
+	~VolumeUploader() { stop(); }
+
+	// Starts filling `texture` (already allocated with the given size) from `voxels`, which must stay valid until
+	// isDone(). onFilled is called from the reader thread whenever a slab is ready, e.g. to wake the event loop.
+	void start(GLuint texture, const void* voxels, int x, int y, int z, size_t voxelBytes, GLenum format, GLenum dataType,
+		std::function<void()> onFilled, size_t slabBytes = size_t(16) << 20, int ringSize = 4);
+
+	// Uploads the slabs the reader has filled, on the thread that owns the GL context. Returns true when the
+	// last slab was submitted by this call.
+	bool update();
+
+	// Waits for and uploads everything that is left
+	void finish();
+	void stop();
+
+	bool isActive() const { return slabCount > 0 && uploadedSlabs < slabCount; }
+	bool isPersistent() const { return persistent; }
+	float getProgress() const { return slabCount > 0 ? float(uploadedSlabs) / float(slabCount) : 1.0f; }
+};
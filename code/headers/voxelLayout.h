@@ -0,0 +1,65 @@
+#pragma once
+
+#include <string>
+#include <vector>
+#include <cstddef>
+#include "voxelType.h"
+
+// Order of the voxels in memory for the CPU-side consumers. The GPU always receives the file's x fastest order.
+enum class VoxelOrder {
+	Linear,     // x fastest, as stored in the file
+	Tiled,      // tileSize^3 bricks in linear order, each holding its voxels in linear order
+	Morton      // Z-order curve over the whole volume; axes are padded to powers of two
+};
+
+const char* voxelOrderName(VoxelOrder order);
+
+// Maps voxel coordinates to storage indices with one table per axis: index = x[i] + y[j] + z[k].
+// Any separable order (linear, bricked, Morton) is expressed that way, so consumers only ever see VoxelAccessor
+// and never depend on the order. Neighbouring voxels along every axis of a tile / curve cell share cache lines,
+// which is what rays that do not travel along x need.
+class VoxelLayout
+{
+private:
+	VoxelOrder order = VoxelOrder::Linear;
+	int tileSize = 1;
+	int dims[3] = { 0, 0, 0 };
+	size_t storageSize = 0;                 // Elements including padding
+	std::vector<size_t> offsets[3];
+
+public:
+	void build(VoxelOrder order, int x_size, int y_size, int z_size, int tileSize = 8);
+
+	// Copies x fastest voxels of `type` into `out` (getStorageSize() elements) in this layout, padding with zeros.
+	// Runs in parallel over slabs of the volume.
+	void swizzle(const void* linear, VoxelType type, void* out) const;
+
+	VoxelOrder getOrder() const { return order; }
+	int getTileSize() const { return tileSize; }
+	const int* getDims() const { return dims; }
+	size_t getStorageSize() const { return storageSize; }
+	const size_t* getOffsets(int axis) const { return offsets[axis].data(); }
+	std::string describe() const;
+
+	size_t index(int x, int y, int z) const { return offsets[0][x] + offsets[1][y] + offsets[2][z]; }
+};
+
+// Typed view of a volume stored in any VoxelLayout. Cheap to copy; the layout and voxels must outlive it.
+template<typename T>
+struct VoxelAccessor {
+	const T* voxels = nullptr;
+	const size_t* x = nullptr;
+	const size_t* y = nullptr;
+	const size_t* z = nullptr;
+	int dims[3] = { 0, 0, 0 };
+
+	VoxelAccessor() = default;
+	VoxelAccessor(const void* data, const VoxelLayout& layout)
+		: voxels(static_cast<const T*>(data)), x(layout.getOffsets(0)), y(layout.getOffsets(1)), z(layout.getOffsets(2))
+	{
+		for (int axis = 0; axis < 3; axis++) dims[axis] = layout.getDims()[axis];
+	}
+
+	T operator()(int i, int j, int k) const { return voxels[x[i] + y[j] + z[k]]; }
+	bool inside(int i, int j, int k) const { return i >= 0 && j >= 0 && k >= 0 && i < dims[0] && j < dims[1] && k < dims[2]; }
+};
@@ -0,0 +1,111 @@
+#pragma once
+
+#include <cstdint>
+#include <cstddef>
+#include <string>
+#include <algorithm>
+
+enum class VoxelType {
+	UInt8,
+	UInt16,
+	Int16,
+	Float32,
+	Unknown
+};
+
+inline size_t voxelTypeSize(VoxelType type)
+{
+	switch (type) {
+	case VoxelType::UInt8: return 1;
+	case VoxelType::UInt16: return 2;
+	case VoxelType::Int16: return 2;
+	case VoxelType::Float32: return 4;
+	default: return 0;
+	}
+}
+
+inline const char* voxelTypeName(VoxelType type)
+{
+	switch (type) {
+	case VoxelType::UInt8: return "uint8";
+	case VoxelType::UInt16: return "uint16";
+	case VoxelType::Int16: return "int16";
+	case VoxelType::Float32: return "float32";
+	default: return "unknown";
+	}
+}
+
+inline VoxelType voxelTypeFromName(const std::string& name)
+{
+	for (VoxelType type : { VoxelType::UInt8, VoxelType::UInt16, VoxelType::Int16, VoxelType::Float32 }) {
+		if (name == voxelTypeName(type)) return type;
+	}
+	if (name == "float") return VoxelType::Float32;
+	return VoxelType::Unknown;
+}
+
+// Element type token of a headerless volume's file name, e.g. "ct_512x512x300_int16.raw". Only whole tokens between
+// '_', '.' and the ends of the name count, so "uint16" is not mistaken for "int16". UInt8 when there is none.
+inline VoxelType voxelTypeFromFileName(const std::string& fileName)
+{
+	std::string name = fileName.substr(fileName.find_last_of("/\\") + 1);
+	size_t begin = 0;
+	while (begin <= name.size()) {
+		size_t end = std::min(name.find_first_of("_.", begin), name.size());
+		VoxelType type = voxelTypeFromName(name.substr(begin, end - begin));
+		if (type != VoxelType::Unknown) return type;
+		begin = end + 1;
+	}
+	return VoxelType::UInt8;
+}
+
+// Per element type information. `normalize` returns the value the shader reads when sampling the
+// texture (UNORM / SNORM / float), `scale` converts that sampled value back to file units.
+template<typename T> struct VoxelTraits;
+
+template<> struct VoxelTraits<uint8_t> {
+	static constexpr VoxelType type = VoxelType::UInt8;
+	static constexpr float scale = 255.0f;
+	static float normalize(uint8_t v) { return v * (1.0f / 255.0f); }
+};
+
+template<> struct VoxelTraits<uint16_t> {
+	static constexpr VoxelType type = VoxelType::UInt16;
+	static constexpr float scale = 65535.0f;
+	static float normalize(uint16_t v) { return v * (1.0f / 65535.0f); }
+};
+
+template<> struct VoxelTraits<int16_t> {
+	static constexpr VoxelType type = VoxelType::Int16;
+	static constexpr float scale = 32767.0f;
+	static float normalize(int16_t v) { return std::max(v * (1.0f / 32767.0f), -1.0f); }
+};
+
+template<> struct VoxelTraits<float> {
+	static constexpr VoxelType type = VoxelType::Float32;
+	static constexpr float scale = 1.0f;
+	static float normalize(float v) { return v; }
+};
+
+inline float voxelTypeScale(VoxelType type)
+{
+	switch (type) {
+	case VoxelType::UInt8: return VoxelTraits<uint8_t>::scale;
+	case VoxelType::UInt16: return VoxelTraits<uint16_t>::scale;
+	case VoxelType::Int16: return VoxelTraits<int16_t>::scale;
+	default: return 1.0f;
+	}
+}
+
+// Calls f(T()) with the C++ element type that matches `type`, so CPU-side consumers are written once as templates
+template<typename F>
+void dispatchVoxelType(VoxelType type, F&& f)
+{
+	switch (type) {
+	case VoxelType::UInt8: f(uint8_t()); break;
+	case VoxelType::UInt16: f(uint16_t()); break;
+	case VoxelType::Int16: f(int16_t()); break;
+	case VoxelType::Float32: f(float()); break;
+	default: break;
+	}
+}
\ No newline at end of file
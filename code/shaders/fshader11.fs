@@ -7,10 +7,59 @@ in vec3 ExtentMin;
 
 
 uniform float stepSize;
+uniform float stepRatio = 1.0;      // stepSize relative to the base step the transfer function was designed for
+
+// Pre-integration: each step composites the segment from the previous sample to this one, looked up in a table of
+// (front, back) scalars holding colour per unit opacity (rgb) and mean extinction per base step (a)
+uniform bool preIntegrated = false;
+uniform sampler2D preIntegrationTable;
+
+// Window of sampled values (normalized texture units) mapped onto the transfer function
+uniform float windowMin = 0.0;
+uniform float windowMax = 1.0;
 
 uniform sampler1D transferfun;
 uniform sampler3D texture3d;
 
+// Empty space skipping: one texel per brick, 0 where the brick's value range maps to all zero RGBA texels
+uniform bool emptySpaceSkipping = false;
+uniform sampler3D occupancyGrid;
+uniform vec3 brickGridScale;        // volume dimensions / brick size
+
+// Adaptive stepping: the occupancy texel is the brick's maximum sample opacity, steps grow until that would reach
+// adaptiveOpacity (up to maxStepScale) but stop at the first sample past the brick. Same as raycast::adaptiveStepScale.
+// Only bricks without any visible texel read 0; colour at zero opacity reads at least 1/255 and keeps its weight
+// per unit length on long steps (scalar*sampleRatio below).
+uniform bool adaptiveStepping = false;
+uniform float adaptiveOpacity = 0.05;
+uniform float maxStepScale = 4.0;
+
+// Level of detail: each ray samples the mip level whose voxels match the pixel footprint where it enters the
+// volume, with the step size (and opacity correction) scaled to that level's voxel size
+uniform bool levelOfDetail = false;
+uniform float lodBias = 0.0;
+uniform float maxLod = 0.0;
+
+// Out-of-core volumes: a page table with one texel per brick holds the brick's slot in the atlas (xyz) and
+// whether it is resident (w); each slot stores the brick plus a one voxel apron, so filtering stays inside it.
+// Bricks that are not resident yet are skipped like empty ones.
+uniform bool outOfCore = false;
+uniform usampler3D pageTable;
+uniform sampler3D brickAtlas;
+uniform float pageBrickSize;
+uniform vec3 volumeDims;
+
+// Precomputed gradients, one RGB10A2 texel per voxel: octahedral-encoded direction in rg, magnitude relative to the
+// volume's largest in b. Shading is a Blinn-Phong headlight; gradientOpacity fades out samples with weak gradients.
+uniform bool shading = false;
+uniform sampler3D gradientVolume;
+uniform float gradientOpacity = 0.0;
+
+const float ambient = 0.3;
+const float diffuse = 0.7;
+const float specular = 0.3;
+const float shininess = 24.0;
+
 uniform float screen_width = 640;
 uniform float screen_height = 640;
 
@@ -39,6 +88,16 @@ float tmax = distance + radius;
 
 out vec4 outColor;
 
+vec3 decodeNormal(vec2 encoded)
+{
+    // Inverse of GradientVolume::pack
+    vec2 f = encoded * 2.0 - 1.0;
+    vec3 n = vec3(f, 1.0 - abs(f.x) - abs(f.y));
+    float t = max(-n.z, 0.0);
+    n.xy += mix(vec2(t), vec2(-t), greaterThanEqual(n.xy, vec2(0.0)));
+    return normalize(n);
+}
+
 bool rayintersection(vec3 position, vec3 dir)
 {
     float tymin, tymax, tzmin, tzmax;
@@ -110,22 +169,119 @@ void main()
             return;
     }
 
+    float lod = 0.0;
+    if(levelOfDetail){
+        vec3 voxelSize = (ExtentMax - ExtentMin) / vec3(textureSize(texture3d, 0));
+        float footprint = tentry * (1.0 / (screen_height * focalDistance)) / min(voxelSize.x, min(voxelSize.y, voxelSize.z));
+        lod = clamp(floor(log2(max(footprint, 1.0)) + lodBias), 0.0, maxLod);
+    }
+    float rayStep = stepSize * exp2(lod);
+    float rayStepRatio = stepRatio * exp2(lod);
+
     dst = vec4(0,0,0,0);
     int i = 0;
     float t = tentry;
     curren_pos = position + t*direction;
+    vec3 brickDir = direction / (ExtentMax - ExtentMin) * brickGridScale;
+    brickDir = max(abs(brickDir), vec3(1e-6)) * (step(0.0, brickDir) * 2.0 - 1.0);
+    ivec3 lastBrick = textureSize(occupancyGrid, 0) - 1;
+    float frontScalar = -1.0;           // Scalar of the previous sample, none at the entry and after skipped bricks
+    float segmentRatio = rayStepRatio;  // Length of the step that led to this sample, in base steps
     for(i=0;;i+=1){
-        value = texture(texture3d, (curren_pos+((ExtentMax - ExtentMin)/2))/(ExtentMax-ExtentMin));
-        scalar = value.r;
-        vec4 src = texture(transferfun,scalar);
+        vec3 texPos = (curren_pos+((ExtentMax - ExtentMin)/2))/(ExtentMax-ExtentMin);
+        ivec3 brick = ivec3(0);
+        uvec4 page = uvec4(0u);
+        float advance = rayStep;
+        float sampleRatio = rayStepRatio;
+        if(emptySpaceSkipping || outOfCore || adaptiveStepping){
+            vec3 brickPos = texPos * brickGridScale;
+            brick = clamp(ivec3(brickPos), ivec3(0), lastBrick);
+            float maxOpacity = texelFetch(occupancyGrid, brick, 0).r;
+            bool skip = emptySpaceSkipping && maxOpacity == 0.0;
+            if(outOfCore){
+                page = texelFetch(pageTable, brick, 0);
+                skip = skip || page.w == 0u;
+            }
+            float stepScale = 1.0;
+            if(adaptiveStepping){
+                stepScale = maxOpacity > 0.0 ? clamp(adaptiveOpacity / maxOpacity, 1.0, maxStepScale) : maxStepScale;
+            }
+            if(skip || stepScale > 1.0){
+                // Distance to the first sample past the brick, staying on the same lattice of t values as without skipping
+                vec3 tAxis = (floor(brickPos) + step(0.0, brickDir) - brickPos) / brickDir;
+                float tBrick = min(tAxis.x, min(tAxis.y, tAxis.z));
+                float pastBrick = max(ceil(tBrick / rayStep), 1.0) * rayStep;
+                if(skip){
+                    t += pastBrick;
+                    curren_pos = position + direction*t;
+                    frontScalar = -1.0;
+                    segmentRatio = rayStepRatio;
+                    if(t>texit){
+                        break;
+                    }
+                    continue;
+                }
+                advance = min(rayStep * stepScale, pastBrick);
+                sampleRatio = rayStepRatio * (advance / rayStep);
+            }
+        }
 
-        dst.rgb = dst.rgb + (1.0 - dst.a)*src.rgb*scalar;
-        dst.a = dst.a + (1.0 - dst.a)*src.a*scalar;
+        if(outOfCore){
+            // Voxel i of the brick sits at i + 1 in its slot, the apron voxel before it at 0
+            vec3 local = clamp(texPos, 0.0, 1.0) * volumeDims - vec3(brick) * pageBrickSize;
+            vec3 atlasPos = vec3(page.xyz) * (pageBrickSize + 2.0) + 1.0 + local;
+            value = textureLod(brickAtlas, atlasPos / vec3(textureSize(brickAtlas, 0)), 0.0);
+        }
+        else{
+            value = textureLod(texture3d, texPos, lod);
+        }
+        scalar = clamp((value.r - windowMin) / (windowMax - windowMin), 0.0, 1.0);
+        vec4 src;
+        if(preIntegrated){
+            vec2 segment = vec2(frontScalar < 0.0 ? scalar : frontScalar, scalar);
+            vec4 integral = texture(preIntegrationTable, (segment*255.0 + 0.5)/256.0);
+            src = vec4(integral.rgb, 1.0 - exp(-integral.a*segmentRatio));
+            frontScalar = scalar;
+        }
+        else{
+            src = texture(transferfun,scalar);
+        }
+
+        if(shading || gradientOpacity > 0.0){
+            vec4 gradient = textureLod(gradientVolume, texPos, 0.0);
+            if(shading){
+                // Light and eye both sit at the camera, so the half vector is the view vector. Two-sided, and
+                // faded in with the magnitude since the direction of a near-zero gradient is noise
+                float ndl = abs(dot(decodeNormal(gradient.rg), direction));
+                vec3 lit = src.rgb*(ambient + diffuse*ndl) + specular*pow(ndl, shininess);
+                src.rgb = mix(src.rgb, lit, clamp(gradient.b*16.0, 0.0, 1.0));
+            }
+            float modulation = mix(1.0, gradient.b, gradientOpacity);
+            src *= preIntegrated ? vec4(1.0, 1.0, 1.0, modulation) : vec4(modulation);
+        }
 
-        t += stepSize;
+        if(preIntegrated){
+            // The segment opacity already accounts for the step length
+            dst.rgb = dst.rgb + (1.0 - dst.a)*src.rgb*src.a;
+            dst.a = dst.a + (1.0 - dst.a)*src.a;
+        }
+        else{
+            // Opacity correction keeps coarse preview passes (stepRatio > 1) as opaque as the full quality image
+            float weight = scalar;
+            if(sampleRatio != 1.0){
+                float alpha = src.a*scalar;
+                weight = alpha > 0.0 ? scalar*(1.0 - pow(1.0 - min(alpha, 0.9999), sampleRatio))/alpha : scalar*sampleRatio;
+            }
+
+            dst.rgb = dst.rgb + (1.0 - dst.a)*src.rgb*weight;
+            dst.a = dst.a + (1.0 - dst.a)*src.a*weight;
+        }
+
+        t += advance;
+        segmentRatio = sampleRatio;
         curren_pos = position + direction*t;
         if(t>texit){
-            return;
+            break;
         }
         if(dst.a > 0.95){
             break;
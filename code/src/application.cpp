@@ -1,28 +1,468 @@
 #include "application.h"
+#include "imageWriter.h"
+#include "trace.h"
+#include <filesystem>
+#include <sstream>
+#include <chrono>
+#include <cstdio>
+
+namespace fs = std::filesystem;
 
 Application::Application(int argc, char** argv)
 {
+	bool halfFloat = false;
 	for (int i = 1; i < argc; i++)
 	{
-		if (strcmp(argv[i], "-volumePath") == 0) {
+		if (strcmp(argv[i], "-volumePath") == 0 && i + 1 < argc) {
 			volumePath = argv[i + 1];
 		}
+		if (strcmp(argv[i], "-dims") == 0 && i + 3 < argc) {
+			volReader.setVolumeDimensions(atoi(argv[i + 1]), atoi(argv[i + 2]), atoi(argv[i + 3]));
+		}
+		if (strcmp(argv[i], "-type") == 0 && i + 1 < argc) {
+			VoxelType type = voxelTypeFromName(argv[i + 1]);
+			if (type == VoxelType::Unknown) {
+				std::cout << "Unknown voxel type " << argv[i + 1] << ", expected uint8, uint16, int16 or float32" << std::endl;
+				exit(EXIT_FAILURE);
+			}
+			volReader.setVoxelType(type);
+		}
+		if (strcmp(argv[i], "-layout") == 0 && i + 1 < argc) {
+			// linear, morton or tiled<N> (N^3 bricks, tiled = tiled8)
+			std::string layout = argv[i + 1];
+			if (layout == "linear") volReader.setVoxelLayout(VoxelOrder::Linear);
+			else if (layout == "morton") volReader.setVoxelLayout(VoxelOrder::Morton);
+			else if (layout.compare(0, 5, "tiled") == 0 && (layout.size() == 5 || atoi(layout.c_str() + 5) > 0)) {
+				volReader.setVoxelLayout(VoxelOrder::Tiled, layout.size() == 5 ? 8 : atoi(layout.c_str() + 5));
+			}
+			else {
+				std::cout << "Unknown voxel layout " << layout << ", expected linear, morton or tiled<N>" << std::endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (strcmp(argv[i], "-mip") == 0 && i + 1 < argc) {
+			std::string filter = argv[i + 1];
+			buildPyramid = filter != "none";
+			if (filter == "max") mipFilter = MipFilter::Max;
+			else if (filter != "average" && filter != "none") {
+				std::cout << "Unknown mip filter " << filter << ", expected average, max or none" << std::endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (strcmp(argv[i], "-lod") == 0) {
+			levelOfDetail = true;
+		}
+		if (strcmp(argv[i], "-lodBias") == 0 && i + 1 < argc) {
+			lodBias = float(atof(argv[i + 1]));
+		}
+		if (strcmp(argv[i], "-gradients") == 0) {
+			buildGradients = true;
+		}
+		if (strcmp(argv[i], "-gradientOpacity") == 0 && i + 1 < argc) {
+			gradientOpacity = glm::clamp(float(atof(argv[i + 1])), 0.0f, 1.0f);
+		}
+		if (strcmp(argv[i], "-stepSize") == 0 && i + 1 < argc) {
+			stepSize = float(atof(argv[i + 1]));
+			if (stepSize <= 0.0f) {
+				std::cout << "The step size must be positive" << std::endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (strcmp(argv[i], "-adaptive") == 0) {
+			adaptiveStepping = true;
+		}
+		if (strcmp(argv[i], "-preIntegration") == 0) {
+			preIntegration = true;
+		}
+		if (strcmp(argv[i], "-halfFloat") == 0) {
+			halfFloat = true;
+		}
+		if (strcmp(argv[i], "-headless") == 0) {
+			headless = true;
+		}
+		if (strcmp(argv[i], "-camera") == 0 && i + 1 < argc) {
+			cameraPath = argv[i + 1];
+		}
+		if (strcmp(argv[i], "-tf") == 0 && i + 1 < argc) {
+			// Repeatable, and each value may hold a comma separated list
+			std::stringstream list(argv[i + 1]);
+			std::string path;
+			while (std::getline(list, path, ',')) {
+				if (!path.empty()) transferFunctionPaths.push_back(path);
+			}
+		}
+		if (strcmp(argv[i], "-out") == 0 && i + 1 < argc) {
+			outputDir = argv[i + 1];
+		}
+		if (strcmp(argv[i], "-format") == 0 && i + 1 < argc) {
+			imageFormat = argv[i + 1];
+			if (imageFormat != "png" && imageFormat != "ppm") {
+				std::cout << "Unknown image format " << imageFormat << ", expected png or ppm" << std::endl;
+				exit(EXIT_FAILURE);
+			}
+		}
+		if (strcmp(argv[i], "-cpu") == 0) {
+			cpuRender = true;
+			headless = true;
+		}
+		if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+			cpuThreads = atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-packet") == 0 && i + 1 < argc) {
+			cpuPacketWidth = atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-writeBricked") == 0 && i + 1 < argc) {
+			brickedOutputPath = argv[i + 1];
+		}
+		if (strcmp(argv[i], "-brickSize") == 0 && i + 1 < argc) {
+			brickedBrickSize = atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-budget") == 0 && i + 1 < argc) {
+			streamingBudgetMB = atoi(argv[i + 1]);
+		}
+		if (strcmp(argv[i], "-trace") == 0 && i + 1 < argc) {
+			trace::start(argv[i + 1]);
+			trace::setThreadName("Main");
+		}
+		if (strcmp(argv[i], "-size") == 0 && i + 2 < argc) {
+			imageWidth = atoi(argv[i + 1]);
+			imageHeight = atoi(argv[i + 2]);
+		}
+	}
+
+	// Bricked volumes are streamed from disk as the view needs them, nothing is read up front
+	if (BrickedVolume::isBrickedPath(volumePath)) {
+		openBrickedVolume(halfFloat);
+		return;
+	}
+
+	// Interactive sessions show the window right away and load in the background; batches and conversions need
+	// the whole volume before they can start
+	if (!headless && !cpuRender && brickedOutputPath.empty()) {
+		w_handle = new GLFCameraWindow(WIDTH, HEIGHT, WINDOWNAME);
+		w_handle->halfFloatVolume = halfFloat;
+		w_handle->preIntegration = preIntegration;
+		w_handle->adaptiveStepping = adaptiveStepping;
+		w_handle->SetStepSize(stepSize);
+		w_handle->Create1DTransferFunction();
+		w_handle->loadingStatus = "Reading " + volumePath;
+		loader = std::thread([this]() {
+			trace::setThreadName("Loader");
+			loadVolume(true);
+		});
+		return;
+	}
+
+	loadVolume(false);
+	if (loadStage == LoadFailed)
+	{
+		std::cout << "Volume does not exist" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+
+	// The CPU ray caster needs no OpenGL context, so batches also run on machines without a GPU
+	if (cpuRender) {
+		if (buildGradients) {
+			std::cout << "The CPU ray caster does not shade, -gradients is ignored" << std::endl;
+		}
+		if (preIntegration) {
+			std::cout << "The CPU ray caster point samples the transfer function, -preIntegration is ignored" << std::endl;
+		}
+		cpuRayCaster = new CPURayCaster(cpuThreads);
+		cpuRayCaster->setPacketWidth(cpuPacketWidth);
+		cpuRayCaster->setVolume(volReader.getCPUVolume(), volReader.getVoxelType(), volReader.getCPULayout());
+		cpuOccupancy.setBrickGrid(&brickGrid);
+		cpuRayCaster->setOccupancyGrid(&cpuOccupancy);
+		if (buildPyramid) cpuRayCaster->setPyramid(&pyramid);
+
+		float scale = voxelTypeScale(volReader.getVoxelType());
+		cpuWindow = glm::vec2(valueRange.x, glm::max(valueRange.y, valueRange.x + 1e-6f * scale)) / scale;
+
+		glm::vec3 spacing = volReader.getVolumeSpacing();
+		float minSpacing = glm::min(spacing.x, glm::min(spacing.y, spacing.z));
+		cpuVolumeSize = glm::vec3(volReader.getVolumeDimensionX(), volReader.getVolumeDimensionY(), volReader.getVolumeDimensionZ()) * (spacing / minSpacing);
+
+		applyCPUTransferFunction(defaultTransferFunction());
+		return;
 	}
 
+	w_handle = new GLFCameraWindow(imageWidth, imageHeight, WINDOWNAME, true);
+	w_handle->halfFloatVolume = halfFloat;
+	w_handle->preIntegration = preIntegration;
+	w_handle->adaptiveStepping = adaptiveStepping;
+	w_handle->SetStepSize(stepSize);
+
+	w_handle->Create3DVolumeTexture(volReader.getVolume(), volReader.getVoxelType(), volReader.getVolumeDimensionX(), volReader.getVolumeDimensionY(), volReader.getVolumeDimensionZ(),
+		volReader.getVolumeSpacing(), valueRange);
+
+	if (buildPyramid) {
+		w_handle->SetVolumePyramid(&pyramid, levelOfDetail, lodBias);
+	}
+	w_handle->SetBrickGrid(&brickGrid);
+	if (buildGradients) {
+		w_handle->SetGradientVolume(&gradients, true, gradientOpacity);
+	}
+
+	w_handle->Create1DTransferFunction();
+}
+
+Application::~Application()
+{
+	if (loader.joinable()) loader.join();
+	if (trace::isEnabled()) trace::write();
+}
+
+void Application::loadVolume(bool notify)
+{
+	// Each stage is published through loadStage; the render thread picks it up in pollLoading()
+	auto publish = [&](int stage) {
+		loadStage = stage;
+		if (notify) glfwPostEmptyEvent();
+	};
+	// Stage durations go to the window's profiler; batch runs create the window only after loading
+	auto stageStart = std::chrono::steady_clock::now();
+	auto record = [&](const char* name) {
+		auto now = std::chrono::steady_clock::now();
+		if (w_handle) w_handle->profiler.recordEvent(name, std::chrono::duration<float, std::milli>(now - stageStart).count());
+		stageStart = now;
+	};
+
 	if (!volReader.readVolume(volumePath))                                      // Reading the Volume
 	{
+		publish(LoadFailed);
+		return;
+	}
+	record("Read volume");
+	volReader.getValueRange(valueRange.x, valueRange.y);
+
+	if (!brickedOutputPath.empty()) {
+		glm::vec3 spacing = volReader.getVolumeSpacing();
+		bool written = BrickedVolume::write(brickedOutputPath, volReader.getCPUVolume(), volReader.getVoxelType(), volReader.getCPULayout(), spacing, brickedBrickSize);
+		exit(written ? EXIT_SUCCESS : EXIT_FAILURE);
+	}
+	publish(LoadMapped);
+
+	brickGrid.build(volReader.getCPUVolume(), volReader.getVoxelType(), volReader.getCPULayout());
+	record("Brick grid");
+	publish(LoadBricked);
+
+	if (buildPyramid) {
+		pyramid.build(volReader.getCPUVolume(), volReader.getVoxelType(), volReader.getCPULayout(), mipFilter);
+		record("Mip pyramid");
+	}
+	publish(LoadPyramid);
+
+	if (buildGradients && !cpuRender) {
+		gradients.build(volReader.getCPUVolume(), volReader.getVoxelType(), volReader.getCPULayout(), volReader.getVolumeSpacing());
+		record("Gradients");
+	}
+	publish(LoadDone);
+}
+
+void Application::pollLoading()
+{
+	int stage = loadStage;
+	if (stage == appliedStage) return;
+
+	if (stage == LoadFailed) {
+		loader.join();
 		std::cout << "Volume does not exist" << std::endl;
 		exit(EXIT_FAILURE);
 	}
+	if (appliedStage < LoadMapped && stage >= LoadMapped) {
+		// The GPU copy streams from the mapped file while the CPU-side structures are still being built
+		w_handle->BeginVolumeUpload(volReader.getVolume(), volReader.getVoxelType(), int(volReader.getVolumeDimensionX()), int(volReader.getVolumeDimensionY()),
+			int(volReader.getVolumeDimensionZ()), volReader.getVolumeSpacing(), valueRange);
+		w_handle->loadingStatus = "Building brick grid";
+	}
+	if (appliedStage < LoadBricked && stage >= LoadBricked) {
+		w_handle->SetBrickGrid(&brickGrid);
+		w_handle->loadingStatus = buildPyramid ? "Building mip pyramid" : "";
+	}
+	if (appliedStage < LoadPyramid && stage >= LoadPyramid) {
+		if (buildPyramid) {
+			w_handle->SetVolumePyramid(&pyramid, levelOfDetail, lodBias);
+		}
+		w_handle->loadingStatus = buildGradients ? "Computing gradients" : "";
+	}
+	if (stage == LoadDone) {
+		loader.join();
+		if (buildGradients) {
+			w_handle->SetGradientVolume(&gradients, true, gradientOpacity);
+		}
+		w_handle->loadingStatus = "";
+	}
+	appliedStage = stage;
+}
+
+void Application::openBrickedVolume(bool halfFloat)
+{
+	if (cpuRender) {
+		std::cout << "The CPU ray caster needs the whole volume in memory, it cannot render bricked volumes" << std::endl;
+		exit(EXIT_FAILURE);
+	}
+	if (!bricked.open(volumePath)) {
+		exit(EXIT_FAILURE);
+	}
+	bricked.fillBrickGrid(brickGrid);
 
-	w_handle = new GLFCameraWindow(WIDTH, HEIGHT, WINDOWNAME);
+	if (headless) {
+		w_handle = new GLFCameraWindow(imageWidth, imageHeight, WINDOWNAME, true);
+	}
+	else {
+		w_handle = new GLFCameraWindow(WIDTH, HEIGHT, WINDOWNAME);
+	}
+	w_handle->halfFloatVolume = halfFloat;
+	w_handle->preIntegration = preIntegration;
+	w_handle->adaptiveStepping = adaptiveStepping;
+	w_handle->SetStepSize(stepSize);
 
-	w_handle->Create3DVolumeTexture(volReader.getVolume(), volReader.getVolumeDimensionX(), volReader.getVolumeDimensionY(), volReader.getVolumeDimensionZ());
+	if (!w_handle->SetOutOfCoreVolume(&bricked, size_t(std::max(streamingBudgetMB, 1)) << 20)) {
+		exit(EXIT_FAILURE);
+	}
+	w_handle->SetBrickGrid(&brickGrid);
 
 	w_handle->Create1DTransferFunction();
 }
 
 bool Application::run()
 {
+	pollLoading();
 	return w_handle->Run();
+}
+
+void Application::applyCPUTransferFunction(const std::vector<TransferFunctionPoint>& controlPoints)
+{
+	float lut[256 * 4];
+	buildTransferFunctionLUT(controlPoints, lut);
+	cpuRayCaster->setTransferFunction(lut);
+
+	int dirtyZBegin, dirtyZEnd;
+	cpuOccupancy.update(lut, cpuWindow.x, cpuWindow.y, dirtyZBegin, dirtyZEnd);
+}
+
+CPURenderParams Application::cpuRenderParams(const CameraPose& pose) const
+{
+	// Same transformations as GLFWindow::Setup{Model,View,Projection}Transformation
+	glm::mat4 model = volumeModelMatrix(cpuVolumeSize);
+	glm::mat4 view = cameraViewMatrix(pose);
+	glm::mat4 projection = cameraProjectionMatrix((float)imageWidth / (float)imageHeight);
+
+	CPURenderParams params;
+	params.width = imageWidth;
+	params.height = imageHeight;
+	params.cameraPos = pose.position;
+	params.modelViewProjection = projection * view * model;
+	params.volumeSize = cpuVolumeSize;
+	params.windowMin = cpuWindow.x;
+	params.windowMax = cpuWindow.y;
+	params.stepSize = stepSize;
+	params.stepRatio = stepSize;
+	params.emptySpaceSkipping = true;
+	params.adaptiveStepping = adaptiveStepping;
+	params.levelOfDetail = levelOfDetail;
+	params.lodBias = lodBias;
+	return params;
+}
+
+bool Application::runBatch()
+{
+	std::vector<CameraPose> poses;
+	if (cameraPath.empty()) {
+		poses.push_back(CameraPose{ w_handle ? w_handle->camposition : glm::vec3(0, 0, 280.0f) });
+	}
+	else if (!readCameraPoses(cameraPath, poses)) {
+		return false;
+	}
+	if (poses.empty()) {
+		std::cerr << "No camera poses in " << cameraPath << std::endl;
+		return false;
+	}
+
+	std::error_code error;
+	fs::create_directories(outputDir, error);
+	if (error) {
+		std::cerr << "Failed to create output directory " << outputDir << ": " << error.message() << std::endl;
+		return false;
+	}
+
+	// Without -tf the default ramp from Create1DTransferFunction is used
+	std::vector<std::string> tfPaths = transferFunctionPaths;
+	if (tfPaths.empty()) tfPaths.push_back("");
+
+	using Clock = std::chrono::steady_clock;
+	auto seconds = [](Clock::duration d) { return std::chrono::duration<double>(d).count(); };
+
+	std::vector<unsigned char> pixels;
+	int images = 0;
+	double renderTime = 0.0, writeTime = 0.0;
+	double tileImbalance = 0.0;
+	int tileSteals = 0, splitTiles = 0;
+	auto batchStart = Clock::now();
+	bool success = true;
+
+	for (const auto& tfPath : tfPaths) {
+		std::string tfName = "default";
+		if (!tfPath.empty()) {
+			std::vector<TransferFunctionPoint> controlPoints;
+			if (cpuRender ? !loadTransferFunction(tfPath, controlPoints) : !w_handle->LoadTransferFunction(tfPath)) {
+				success = false;
+				continue;
+			}
+			if (cpuRender) {
+				applyCPUTransferFunction(controlPoints);
+			}
+			else {
+				w_handle->Create1DTransferFunction();
+			}
+			tfName = fs::path(tfPath).stem().string();
+		}
+
+		for (size_t i = 0; i < poses.size(); i++) {
+			auto start = Clock::now();
+			if (cpuRender) {
+				cpuRayCaster->render(cpuRenderParams(poses[i]), pixels);
+				const TileStats& stats = cpuRayCaster->getTileStats();
+				tileImbalance += stats.imbalance;
+				tileSteals += stats.steals;
+				splitTiles += stats.splitTiles;
+			}
+			else {
+				w_handle->SetCamera(poses[i].position, poses[i].at, poses[i].up);
+				if (!w_handle->RenderToImage(pixels)) {
+					std::cerr << "Rendering pose " << i << " with " << tfName << " failed" << std::endl;
+					success = false;
+					continue;
+				}
+			}
+			auto rendered = Clock::now();
+			trace::record("Render image", start, rendered);
+
+			char name[32];
+			snprintf(name, sizeof(name), "_%04d.", int(i));
+			fs::path fileName = fs::path(outputDir) / (tfName + name + imageFormat);
+			TraceScope writeScope("Write image");
+			if (!writeImage(fileName.string(), imageWidth, imageHeight, pixels.data())) {
+				std::cerr << "Failed to write " << fileName.string() << std::endl;
+				success = false;
+				continue;
+			}
+			renderTime += seconds(rendered - start);
+			writeTime += seconds(Clock::now() - rendered);
+			images++;
+		}
+	}
+
+	double totalTime = seconds(Clock::now() - batchStart);
+	std::cout << "Rendered " << images << " images of " << imageWidth << "x" << imageHeight
+		<< (cpuRender ? " on " + std::to_string(cpuRayCaster->getThreadCount()) + " CPU threads (" + std::to_string(cpuRayCaster->getPacketWidth()) + " rays per packet)" : std::string(" on the GPU")) << " in " << totalTime << " s (" << (totalTime > 0.0 ? images / totalTime : 0.0) << " images/s, "
+		<< (images ? renderTime * 1000.0 / images : 0.0) << " ms render + "
+		<< (images ? writeTime * 1000.0 / images : 0.0) << " ms write per image)" << std::endl;
+	if (cpuRender && images) {
+		std::cout << "Tiles per image: " << cpuRayCaster->getTileStats().tiles << " (" << float(splitTiles) / images << " split, "
+			<< float(tileSteals) / images << " stolen), busiest thread " << tileImbalance / images << "x the mean busy time" << std::endl;
+	}
+
+	if (w_handle) w_handle->cleanup();
+	return success;
 }
\ No newline at end of file
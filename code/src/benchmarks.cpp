@@ -0,0 +1,292 @@
+// VolumeRenderingBench: micro-benchmarks of the CPU-side hot paths over synthetic volumes, to decide which
+// preprocessing belongs at load time and which can be done lazily.
+#include "microBenchmark.h"
+#include "volumeReader.h"
+#include "brickGrid.h"
+#include "brickedVolume.h"
+#include "volumePyramid.h"
+#include "gradientVolume.h"
+#include "transferFunction.h"
+#include "cpuRayCaster.h"
+#include "camera.h"
+#include "parallel.h"
+#include "syntheticVolume.h"
+#include <filesystem>
+#include <fstream>
+#include <cstring>
+#include <cmath>
+#include <sstream>
+
+namespace fs = std::filesystem;
+
+namespace {
+
+// One synthetic volume in memory and on disk in every format a reader accepts
+struct SyntheticVolume {
+    int n = 0;
+    VoxelType type = VoxelType::UInt16;
+    std::vector<unsigned char> voxels;
+    VoxelLayout layout;
+    std::string rawPath, mhdPath, brickedPath;
+
+    double megabytes() const { return double(voxels.size()) / (1024.0 * 1024.0); }
+
+    bool create(int size, VoxelType voxelType, const fs::path& directory)
+    {
+        n = size;
+        type = voxelType;
+        voxels.assign(size_t(n) * n * n * voxelTypeSize(type), 0);
+        dispatchVoxelType(type, [&](auto zero) {
+            fillSyntheticVolume(reinterpret_cast<decltype(zero)*>(voxels.data()), n);
+        });
+        layout.build(VoxelOrder::Linear, n, n, n);
+
+        // The raw reader takes dimensions and element type from the file name
+        std::string base = "synthetic_" + std::to_string(n) + "x" + std::to_string(n) + "x" + std::to_string(n) + "_" + voxelTypeName(type);
+        rawPath = (directory / (base + ".raw")).string();
+        mhdPath = (directory / (base + ".mhd")).string();
+        brickedPath = (directory / (base + ".vbrk")).string();
+
+        std::ofstream raw(rawPath, std::ios::binary);
+        raw.write(reinterpret_cast<const char*>(voxels.data()), std::streamsize(voxels.size()));
+        if (!raw) {
+            std::cerr << "Failed to write " << rawPath << std::endl;
+            return false;
+        }
+
+        const char* metaTypes[] = { "MET_UCHAR", "MET_USHORT", "MET_SHORT", "MET_FLOAT" };
+        std::ofstream mhd(mhdPath);
+        mhd << "ObjectType = Image\nNDims = 3\nDimSize = " << n << " " << n << " " << n << "\nElementSpacing = 1 1 1\n"
+            << "ElementType = " << metaTypes[int(type)] << "\nElementDataFile = " << fs::path(rawPath).filename().string() << "\n";
+        if (!mhd) {
+            std::cerr << "Failed to write " << mhdPath << std::endl;
+            return false;
+        }
+
+        return BrickedVolume::write(brickedPath, voxels.data(), type, layout, glm::vec3(1.0f));
+    }
+
+    void remove() const
+    {
+        std::error_code error;
+        for (const std::string& path : { rawPath, mhdPath, brickedPath }) fs::remove(path, error);
+    }
+};
+
+// A transfer function with a few more control points than the default ramp, as users build them
+std::vector<TransferFunctionPoint> syntheticTransferFunction(float shift)
+{
+    return {
+        { 0.0f, glm::vec4(0, 0, 0, 0) },
+        { 0.2f + shift, glm::vec4(0.8f, 0.3f, 0.2f, 0.0f) },
+        { 0.35f + shift, glm::vec4(0.9f, 0.6f, 0.4f, 0.2f) },
+        { 0.6f, glm::vec4(1.0f, 0.9f, 0.8f, 0.05f) },
+        { 0.8f, glm::vec4(1.0f, 1.0f, 1.0f, 0.8f) },
+        { 1.0f, glm::vec4(1, 1, 1, 1) }
+    };
+}
+
+// Consumes a value so the compiler cannot drop the loop that produced it
+volatile uint64_t sink = 0;
+
+void benchmarkLoading(MicroBenchmarkRunner& runner, const SyntheticVolume& volume)
+{
+    const std::string suffix = "/" + std::to_string(volume.n);
+
+    // Everything before the GPU upload can start: map the file, find the value range, touch every page once
+    auto load = [&](const std::string& path) {
+        VolumeReader reader;
+        if (!reader.readVolume(path)) return;
+        float lo, hi;
+        reader.getValueRange(lo, hi);
+        const uint64_t* words = static_cast<const uint64_t*>(reader.getVolume());
+        uint64_t sum = 0;
+        for (size_t i = 0; i < volume.voxels.size() / 8; i += 512) sum += words[i];
+        sink = sink + sum;
+    };
+    runner.run("load_raw" + suffix, volume.megabytes(), "MB/s", [&]() { load(volume.rawPath); });
+    runner.run("load_mhd" + suffix, volume.megabytes(), "MB/s", [&]() { load(volume.mhdPath); });
+
+    // Bricks are read one at a time as the streamer does; opening the file is not part of it
+    BrickedVolume bricked;
+    if (!runner.matches("load_vbrk" + suffix) || !bricked.open(volume.brickedPath)) return;
+    std::vector<unsigned char> brick(bricked.getBrickBytes());
+    runner.run("load_vbrk" + suffix, volume.megabytes(), "MB/s", [&]() {
+        for (size_t i = 0; i < bricked.getBrickCount(); i++) {
+            bricked.readBrick(i, brick.data());
+        }
+        sink = sink + brick[0];
+    });
+}
+
+void benchmarkPreprocessing(MicroBenchmarkRunner& runner, const SyntheticVolume& volume)
+{
+    const std::string suffix = "/" + std::to_string(volume.n);
+
+    // Built once up front as well, the occupancy benchmark needs it even when brick_grid is filtered out
+    BrickGrid grid;
+    grid.build(volume.voxels.data(), volume.type, volume.layout);
+    runner.run("brick_grid" + suffix, volume.megabytes(), "MB/s", [&]() {
+        grid.build(volume.voxels.data(), volume.type, volume.layout);
+    });
+
+    runner.run("mip_pyramid_average" + suffix, volume.megabytes(), "MB/s", [&]() {
+        VolumePyramid pyramid;
+        pyramid.build(volume.voxels.data(), volume.type, volume.layout, MipFilter::Average);
+    });
+    runner.run("mip_pyramid_max" + suffix, volume.megabytes(), "MB/s", [&]() {
+        VolumePyramid pyramid;
+        pyramid.build(volume.voxels.data(), volume.type, volume.layout, MipFilter::Max);
+    });
+
+    GradientVolume gradients;
+    runner.run("gradients" + suffix, volume.megabytes(), "MB/s", [&]() {
+        gradients.build(volume.voxels.data(), volume.type, volume.layout, glm::vec3(1.0f));
+    });
+
+    // The occupancy refresh of every transfer function edit; alternating two functions so each call does the work
+    OccupancyGrid occupancy;
+    occupancy.setBrickGrid(&grid);
+    float luts[2][256 * 4];
+    buildTransferFunctionLUT(syntheticTransferFunction(0.0f), luts[0]);
+    buildTransferFunctionLUT(syntheticTransferFunction(0.05f), luts[1]);
+    int flip = 0;
+    runner.run("occupancy_update" + suffix, double(grid.getBrickCount()) * 1e-6, "Mbricks/s", [&]() {
+        int dirtyZBegin, dirtyZEnd;
+        occupancy.update(luts[flip], 0.0f, 1.0f, dirtyZBegin, dirtyZEnd);
+        flip ^= 1;
+    });
+}
+
+void benchmarkTransferFunction(MicroBenchmarkRunner& runner)
+{
+    std::vector<TransferFunctionPoint> points = syntheticTransferFunction(0.0f);
+    float lut[256 * 4];
+    runner.run("transfer_function_lut", 1.0, "calls/s", [&]() {
+        buildTransferFunctionLUT(points, lut);
+        sink = sink + uint64_t(lut[1023] * 255.0f);
+    });
+
+    std::vector<float> table(256 * 256 * 4);
+    runner.run("pre_integration_table", 1.0, "calls/s", [&]() {
+        buildPreIntegrationTable(lut, table.data());
+    });
+}
+
+void benchmarkRayCasting(MicroBenchmarkRunner& runner, const SyntheticVolume& volume, CPURayCaster& rayCaster, int imageSize)
+{
+    BrickGrid grid;
+    grid.build(volume.voxels.data(), volume.type, volume.layout);
+    OccupancyGrid occupancy;
+    occupancy.setBrickGrid(&grid);
+    float lut[256 * 4];
+    buildTransferFunctionLUT(syntheticTransferFunction(0.0f), lut);
+    int dirtyZBegin, dirtyZEnd;
+    occupancy.update(lut, 0.0f, 1.0f, dirtyZBegin, dirtyZEnd);
+
+    rayCaster.setVolume(volume.voxels.data(), volume.type, volume.layout);
+    rayCaster.setTransferFunction(lut);
+    rayCaster.setOccupancyGrid(&occupancy);
+    rayCaster.setPyramid(nullptr);
+
+    // Same transformations as Application::cpuRenderParams, the camera on the z axis at about the default distance
+    const float n = float(volume.n);
+    glm::vec3 cameraPos(0.0f, 0.0f, 1.1f * n);
+    glm::mat4 model = volumeModelMatrix(glm::vec3(n));
+    glm::mat4 view = cameraViewMatrix(CameraPose{ cameraPos });
+    glm::mat4 projection = cameraProjectionMatrix(1.0f);
+
+    CPURenderParams params;
+    params.width = params.height = imageSize;
+    params.cameraPos = cameraPos;
+    params.modelViewProjection = projection * view * model;
+    params.volumeSize = glm::vec3(n);
+    params.emptySpaceSkipping = true;
+
+    std::vector<unsigned char> pixels;
+    const double megapixels = double(imageSize) * imageSize * 1e-6;
+    const std::string suffix = "/" + std::to_string(volume.n);
+    runner.run("cpu_ray_cast" + suffix, megapixels, "Mpix/s", [&]() { rayCaster.render(params, pixels); });
+    params.adaptiveStepping = true;
+    runner.run("cpu_ray_cast_adaptive" + suffix, megapixels, "Mpix/s", [&]() { rayCaster.render(params, pixels); });
+}
+
+}
+
+int main(int argc, char** argv)
+{
+    MicroBenchmarkRunner runner;
+    std::vector<int> sizes = { 64, 128, 256, 512 };
+    VoxelType type = VoxelType::UInt16;
+    fs::path directory = fs::temp_directory_path() / "volren_bench";
+    std::string outputPath;
+    int imageSize = 512;
+    int threads = 0;
+
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-sizes") == 0 && i + 1 < argc) {
+            sizes.clear();
+            std::stringstream list(argv[i + 1]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                int size = atoi(item.c_str());
+                if (size < 16 || size > 1024) {
+                    std::cout << "Invalid volume size " << item << ", expected 16..1024" << std::endl;
+                    return 1;
+                }
+                sizes.push_back(size);
+            }
+        }
+        if (strcmp(argv[i], "-type") == 0 && i + 1 < argc) {
+            type = voxelTypeFromName(argv[i + 1]);
+            if (type == VoxelType::Unknown) {
+                std::cout << "Unknown voxel type " << argv[i + 1] << ", expected uint8, uint16, int16 or float32" << std::endl;
+                return 1;
+            }
+        }
+        if (strcmp(argv[i], "-filter") == 0 && i + 1 < argc) {
+            runner.setFilter(argv[i + 1]);
+        }
+        if (strcmp(argv[i], "-minTime") == 0 && i + 1 < argc) {
+            runner.setMinTime(atof(argv[i + 1]));
+        }
+        if (strcmp(argv[i], "-dir") == 0 && i + 1 < argc) {
+            directory = argv[i + 1];
+        }
+        if (strcmp(argv[i], "-out") == 0 && i + 1 < argc) {
+            outputPath = argv[i + 1];
+        }
+        if (strcmp(argv[i], "-image") == 0 && i + 1 < argc) {
+            imageSize = std::max(atoi(argv[i + 1]), 16);
+        }
+        if (strcmp(argv[i], "-threads") == 0 && i + 1 < argc) {
+            threads = atoi(argv[i + 1]);
+        }
+    }
+
+    std::error_code error;
+    fs::create_directories(directory, error);
+    if (error) {
+        std::cerr << "Failed to create " << directory.string() << ": " << error.message() << std::endl;
+        return 1;
+    }
+
+    printf("%-36s %15s %15s %8s %15s\n", "Benchmark", "Mean", "Fastest", "Runs", "Throughput");
+    benchmarkTransferFunction(runner);
+
+    CPURayCaster rayCaster(threads);
+    for (int size : sizes) {
+        SyntheticVolume volume;
+        bool created = volume.create(size, type, directory);
+        if (created) {
+            benchmarkLoading(runner, volume);
+            benchmarkPreprocessing(runner, volume);
+            benchmarkRayCasting(runner, volume, rayCaster, imageSize);
+        }
+        volume.remove();
+        if (!created) return 1;
+    }
+
+    if (!outputPath.empty() && !runner.writeJson(outputPath)) return 1;
+    return 0;
+}
@@ -0,0 +1,174 @@
+#include "brickGrid.h"
+#include "parallel.h"
+#include "trace.h"
+#include <cmath>
+
+template<typename T>
+void BrickGrid::buildTyped(const VoxelAccessor<T>& volume)
+{
+    // Bricks of one z layer are independent of all other layers
+    parallelFor(0, gridDims[2], [&](int bzBegin, int bzEnd) {
+        for (int bz = bzBegin; bz < bzEnd; bz++) {
+            int z0 = std::max(bz * brickSize - 1, 0), z1 = std::min((bz + 1) * brickSize + 1, volumeDims[2]);
+            for (int by = 0; by < gridDims[1]; by++) {
+                int y0 = std::max(by * brickSize - 1, 0), y1 = std::min((by + 1) * brickSize + 1, volumeDims[1]);
+                for (int bx = 0; bx < gridDims[0]; bx++) {
+                    int x0 = std::max(bx * brickSize - 1, 0), x1 = std::min((bx + 1) * brickSize + 1, volumeDims[0]);
+
+                    T lo = volume(x0, y0, z0), hi = lo;
+                    for (int z = z0; z < z1; z++) {
+                        for (int y = y0; y < y1; y++) {
+                            const T* row = volume.voxels + volume.y[y] + volume.z[z];
+                            for (int x = x0; x < x1; x++) {
+                                T value = row[volume.x[x]];
+                                lo = std::min(lo, value);
+                                hi = std::max(hi, value);
+                            }
+                        }
+                    }
+
+                    size_t brick = (size_t(bz) * gridDims[1] + by) * gridDims[0] + bx;
+                    minMax[brick * 2 + 0] = VoxelTraits<T>::normalize(lo);
+                    minMax[brick * 2 + 1] = VoxelTraits<T>::normalize(hi);
+                }
+            }
+        }
+    });
+}
+
+void BrickGrid::build(const void* volume, VoxelType type, const VoxelLayout& layout, int size)
+{
+    TraceScope scope("Build brick grid");
+    brickSize = size;
+    for (int i = 0; i < 3; i++) {
+        volumeDims[i] = layout.getDims()[i];
+        gridDims[i] = (volumeDims[i] + brickSize - 1) / brickSize;
+    }
+    minMax.assign(getBrickCount() * 2, 0.0f);
+
+    dispatchVoxelType(type, [&](auto zero) {
+        buildTyped(VoxelAccessor<decltype(zero)>(volume, layout));
+    });
+}
+
+void BrickGrid::assign(const int* dims, int size, const std::vector<float>& ranges)
+{
+    brickSize = size;
+    for (int i = 0; i < 3; i++) {
+        volumeDims[i] = dims[i];
+        gridDims[i] = (volumeDims[i] + brickSize - 1) / brickSize;
+    }
+    minMax = ranges;
+    minMax.resize(getBrickCount() * 2, 0.0f);
+}
+
+void OccupancyGrid::setBrickGrid(const BrickGrid* brickGrid)
+{
+    grid = brickGrid;
+    occupancy.assign(grid->getBrickCount(), 0);
+    texelRange.resize(grid->getBrickCount() * 2);
+    texelRangeValid = false;
+    lutValid = false;
+}
+
+void OccupancyGrid::computeTexelRanges(float windowMin, float windowMax)
+{
+    const float* minMax = grid->getMinMax();
+    float windowScale = 1.0f / std::max(windowMax - windowMin, 1e-6f);
+
+    for (size_t brick = 0; brick < grid->getBrickCount(); brick++) {
+        float sMin = std::min(std::max((minMax[brick * 2 + 0] - windowMin) * windowScale, 0.0f), 1.0f);
+        float sMax = std::min(std::max((minMax[brick * 2 + 1] - windowMin) * windowScale, 0.0f), 1.0f);
+
+        // Samples are weighted by the scalar itself, a brick that stays at 0 contributes nothing
+        if (sMax <= 0.0f) {
+            texelRange[brick * 2 + 0] = 1;
+            texelRange[brick * 2 + 1] = 0;
+            continue;
+        }
+
+        // Texels touched by linear filtering of the 256 entry transfer function
+        texelRange[brick * 2 + 0] = short(std::max(int(std::floor(sMin * 256.0f - 0.5f)), -1));
+        texelRange[brick * 2 + 1] = short(std::min(int(std::floor(sMax * 256.0f - 0.5f)) + 1, 256));
+    }
+
+    window[0] = windowMin;
+    window[1] = windowMax;
+    texelRangeValid = true;
+}
+
+float OccupancyGrid::maxOpacity(int lo, int hi) const
+{
+    // Two overlapping power of two ranges cover [lo, hi]
+    int level = 0;
+    while ((2 << level) <= hi - lo + 1) level++;
+    return std::max(opacityMax[level][lo], opacityMax[level][hi - (1 << level) + 1]);
+}
+
+bool OccupancyGrid::update(const float* transferFunction, float windowMin, float windowMax, int& dirtyZBegin, int& dirtyZEnd)
+{
+    dirtyZBegin = dirtyZEnd = 0;
+    if (!grid) return false;
+
+    bool windowChanged = !texelRangeValid || window[0] != windowMin || window[1] != windowMax;
+    if (windowChanged) {
+        computeTexelRanges(windowMin, windowMax);
+    }
+
+    bool lutChanged = !lutValid;
+    for (int i = 0; i < 256 * 4; i++) {
+        lutChanged |= transferFunction[i] != lut[i];
+        lut[i] = transferFunction[i];
+    }
+    if (!windowChanged && !lutChanged) return false;
+
+    if (lutChanged) {
+        visibleSum[0] = 0;
+        for (int i = 0; i < 256; i++) {
+            // Samples add colour * scalar even at zero alpha, so only all zero texels are invisible
+            const float* texel = lut + i * 4;
+            visible[i] = texel[0] > 0.0f || texel[1] > 0.0f || texel[2] > 0.0f || texel[3] > 0.0f;
+            visibleSum[i + 1] = visibleSum[i] + (visible[i] ? 1 : 0);
+            // Filtering reaches scalars up to (i + 1.5) / 256 from texel i
+            opacityMax[0][i] = lut[i * 4 + 3] * std::min((i + 1.5f) / 256.0f, 1.0f);
+        }
+        for (int level = 1; level < 9; level++) {
+            for (int i = 0; i + (1 << level) <= 256; i++) {
+                opacityMax[level][i] = std::max(opacityMax[level - 1][i], opacityMax[level - 1][i + (1 << (level - 1))]);
+            }
+        }
+        lutValid = true;
+    }
+
+    const int* gridDims = grid->getGridDims();
+    size_t layerSize = size_t(gridDims[0]) * gridDims[1];
+    size_t firstChanged = occupancy.size(), lastChanged = 0;
+
+    for (size_t brick = 0; brick < occupancy.size(); brick++) {
+        int lo = texelRange[brick * 2 + 0], hi = texelRange[brick * 2 + 1];
+
+        bool occupied = false;
+        float opacity = 0.0f;
+        if (lo <= hi) {
+            int count = visibleSum[std::min(hi, 255) + 1] - visibleSum[std::max(lo, 0)];
+            occupied = count > 0 || (lo < 0 && visible[255]) || (hi > 255 && visible[0]);
+            if (occupied) {
+                opacity = maxOpacity(std::max(lo, 0), std::min(hi, 255));
+                if (lo < 0) opacity = std::max(opacity, opacityMax[0][255]);
+                if (hi > 255) opacity = std::max(opacity, opacityMax[0][0]);
+            }
+        }
+
+        unsigned char value = occupied ? (unsigned char)std::min(std::max(std::ceil(opacity * 255.0f), 1.0f), 255.0f) : 0;
+        if (occupancy[brick] != value) {
+            occupancy[brick] = value;
+            firstChanged = std::min(firstChanged, brick);
+            lastChanged = brick;
+        }
+    }
+
+    if (firstChanged > lastChanged) return false;
+    dirtyZBegin = int(firstChanged / layerSize);
+    dirtyZEnd = int(lastChanged / layerSize) + 1;
+    return true;
+}
\ No newline at end of file
@@ -0,0 +1,289 @@
+#include "brickStreamer.h"
+#include "trace.h"
+#include <algorithm>
+#include <cmath>
+
+void BrickStreamer::start(BrickedVolume* brickedVolume, const int* slots, int stagingBuffers, std::function<void()> loadedCallback)
+{
+    stop();
+    volume = brickedVolume;
+    onLoaded = std::move(loadedCallback);
+    for (int axis = 0; axis < 3; axis++) {
+        slotDims[axis] = slots[axis];
+    }
+
+    const size_t brickCount = volume->getBrickCount();
+    const int slotCount = slotDims[0] * slotDims[1] * slotDims[2];
+    pageTable.assign(brickCount * 4, 0);
+    brickSlot.assign(brickCount, -1);
+    brickRequest.assign(brickCount, 0);
+    state.assign(brickCount, Absent);
+    slotBrick.assign(slotCount, -1);
+    slotUsed.assign(slotCount, 0);
+    lru.clear();
+    lruPosition.resize(slotCount);
+    for (int slot = 0; slot < slotCount; slot++) {
+        lruPosition[slot] = lru.insert(lru.end(), slot);
+    }
+    requestNumber = 0;
+    pageTableDirty = true;
+
+    staging.assign(std::max(stagingBuffers, 1), std::vector<unsigned char>(volume->getBrickBytes()));
+    freeBuffers.clear();
+    for (int buffer = 0; buffer < int(staging.size()); buffer++) {
+        freeBuffers.push_back(buffer);
+    }
+    queue.clear();
+    loaded.clear();
+    requested.clear();
+    stats = StreamingStats();
+    stats.slots = slotCount;
+
+    stopping = false;
+    ioThread = std::thread(&BrickStreamer::ioLoop, this);
+}
+
+void BrickStreamer::stop()
+{
+    if (!ioThread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        stopping = true;
+    }
+    wake.notify_all();
+    ioThread.join();
+}
+
+void BrickStreamer::ioLoop()
+{
+    trace::setThreadName("Brick streamer");
+    for (;;) {
+        int brick, buffer;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            wake.wait(lock, [&]() { return stopping || (!queue.empty() && !freeBuffers.empty()); });
+            if (stopping) return;
+            brick = queue.front();
+            queue.pop_front();
+            buffer = freeBuffers.back();
+            freeBuffers.pop_back();
+            state[brick] = Loading;
+        }
+
+        bool ok;
+        {
+            TraceScope scope("Read brick");
+            ok = volume->readBrick(brick, staging[buffer].data());
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            if (ok) {
+                loaded.push_back(Staged{ brick, buffer });
+                state[brick] = Loaded;
+                stats.bytesRead += volume->getBrickBytes();
+            }
+            else {
+                // Leave it absent, a later request retries
+                freeBuffers.push_back(buffer);
+                state[brick] = Absent;
+            }
+        }
+        if (ok && onLoaded) onLoaded();
+    }
+}
+
+void BrickStreamer::touch(int slot)
+{
+    slotUsed[slot] = requestNumber;
+    lru.splice(lru.begin(), lru, lruPosition[slot]);
+}
+
+void BrickStreamer::place(int slot, int brick)
+{
+    slotBrick[slot] = brick;
+    brickSlot[brick] = slot;
+    if (brickRequest[brick] == requestNumber) {
+        touch(slot);
+    }
+    else {
+        // Read for an earlier view, first in line for eviction
+        slotUsed[slot] = brickRequest[brick];
+        lru.splice(lru.end(), lru, lruPosition[slot]);
+    }
+
+    int x, y, z;
+    getSlotPosition(slot, x, y, z);
+    unsigned char* entry = &pageTable[size_t(brick) * 4];
+    entry[0] = (unsigned char)x;
+    entry[1] = (unsigned char)y;
+    entry[2] = (unsigned char)z;
+    entry[3] = 255;
+}
+
+void BrickStreamer::request(const std::vector<int>& bricks)
+{
+    const size_t count = std::min(bricks.size(), slotBrick.size());
+    requestNumber++;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    // Bricks queued for an older view that this one does not need go back to absent
+    for (int brick : queue) {
+        state[brick] = Absent;
+    }
+    queue.clear();
+
+    // Touch in reverse so the most important brick ends up most recently used
+    for (size_t i = count; i-- > 0;) {
+        int brick = bricks[i];
+        brickRequest[brick] = requestNumber;
+        if (brickSlot[brick] >= 0) touch(brickSlot[brick]);
+    }
+    requested.assign(bricks.begin(), bricks.begin() + count);
+    stats.pending = 0;
+    for (int brick : requested) {
+        if (state[brick] == Absent) {
+            state[brick] = Queued;
+            queue.push_back(brick);
+        }
+        if (state[brick] != Resident) stats.pending++;
+    }
+    stats.requested = int(count);
+    wake.notify_all();
+}
+
+bool BrickStreamer::collect(size_t byteBudget, const std::function<void(int slot, const void* voxels)>& upload)
+{
+    std::vector<Staged> ready;
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        size_t take = std::min(loaded.size(), std::max<size_t>(byteBudget / volume->getBrickBytes(), 1));
+        ready.assign(loaded.begin(), loaded.begin() + take);
+        loaded.erase(loaded.begin(), loaded.begin() + take);
+    }
+
+    int uploaded = 0;
+    std::vector<int> placed(ready.size(), -1), evicted;
+    for (size_t i = 0; i < ready.size(); i++) {
+        // The least recently requested slot; if even that one belongs to the current view the atlas is full
+        int slot = lru.back();
+        if (slotBrick[slot] >= 0 && slotUsed[slot] == requestNumber) continue;
+
+        if (slotBrick[slot] >= 0) {
+            int victim = slotBrick[slot];
+            brickSlot[victim] = -1;
+            pageTable[size_t(victim) * 4 + 3] = 0;
+            evicted.push_back(victim);
+        }
+        upload(slot, staging[ready[i].buffer].data());
+        place(slot, ready[i].brick);
+        placed[i] = slot;
+        uploaded++;
+    }
+
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        for (int brick : evicted) {
+            state[brick] = Absent;
+        }
+        // A brick that did not fit goes back to absent too and is not pending any more
+        for (size_t i = 0; i < ready.size(); i++) {
+            freeBuffers.push_back(ready[i].buffer);
+            state[ready[i].brick] = placed[i] >= 0 ? Resident : Absent;
+        }
+        stats.pending = 0;
+        for (int brick : requested) {
+            if (state[brick] == Queued || state[brick] == Loading || state[brick] == Loaded) stats.pending++;
+        }
+        stats.evictions += evicted.size();
+        stats.uploadedLastFrame = uploaded;
+    }
+    if (!ready.empty()) wake.notify_all();
+
+    pageTableDirty |= uploaded > 0;
+    bool changed = pageTableDirty;
+    pageTableDirty = false;
+    return changed;
+}
+
+bool BrickStreamer::isIdle()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    return stats.pending == 0;
+}
+
+void BrickStreamer::getSlotPosition(int slot, int& x, int& y, int& z) const
+{
+    x = slot % slotDims[0];
+    y = (slot / slotDims[0]) % slotDims[1];
+    z = slot / (slotDims[0] * slotDims[1]);
+}
+
+StreamingStats BrickStreamer::getStats()
+{
+    std::lock_guard<std::mutex> lock(mutex);
+    StreamingStats current = stats;
+    current.resident = 0;
+    for (int brick : slotBrick) {
+        if (brick >= 0) current.resident++;
+    }
+    return current;
+}
+
+std::vector<int> visibleBricks(const BrickedVolume& volume, const unsigned char* occupancy, glm::vec3 cameraPos, glm::vec3 volumeSize, float aspect)
+{
+    // Same camera basis as the shader; the half angle tangents get a small margin for the half pixel offsets
+    const glm::vec3 w = glm::normalize(cameraPos);
+    const glm::vec3 u = glm::normalize(glm::cross(glm::vec3(0, 1, 0), w));
+    const glm::vec3 v = glm::normalize(glm::cross(w, u));
+    const float focalDistance = 1.0f / (2.0f * std::tan(90.0f * 3.14f / 360.0f));
+    const float tanX = aspect * 0.5f / focalDistance * 1.05f;
+    const float tanY = 0.5f / focalDistance * 1.05f;
+
+    const int* dims = volume.getDims();
+    const int* grid = volume.getGridDims();
+    const int brickSize = volume.getBrickSize();
+    const glm::vec3 voxelSize = volumeSize / glm::vec3(dims[0], dims[1], dims[2]);
+
+    std::vector<std::pair<float, int>> candidates;
+    for (int bz = 0; bz < grid[2]; bz++) {
+        for (int by = 0; by < grid[1]; by++) {
+            for (int bx = 0; bx < grid[0]; bx++) {
+                int brick = (bz * grid[1] + by) * grid[0] + bx;
+                if (occupancy && !occupancy[brick]) continue;
+
+                // World space box of the brick including the voxel that filtering reads past each face
+                const int brickIndex[3] = { bx, by, bz };
+                glm::vec3 lo, hi;
+                for (int axis = 0; axis < 3; axis++) {
+                    int first = brickIndex[axis] * brickSize - 1;
+                    int last = std::min((brickIndex[axis] + 1) * brickSize + 1, dims[axis]);
+                    lo[axis] = first * voxelSize[axis] - volumeSize[axis] * 0.5f;
+                    hi[axis] = last * voxelSize[axis] - volumeSize[axis] * 0.5f;
+                }
+
+                bool outside[5] = { true, true, true, true, true };  // Behind, left, right, below, above
+                for (int corner = 0; corner < 8; corner++) {
+                    glm::vec3 p((corner & 1) ? hi.x : lo.x, (corner & 2) ? hi.y : lo.y, (corner & 4) ? hi.z : lo.z);
+                    glm::vec3 d = p - cameraPos;
+                    float depth = -glm::dot(d, w), x = glm::dot(d, u), y = glm::dot(d, v);
+                    outside[0] = outside[0] && depth <= 0.0f;
+                    outside[1] = outside[1] && x < -tanX * depth;
+                    outside[2] = outside[2] && x > tanX * depth;
+                    outside[3] = outside[3] && y < -tanY * depth;
+                    outside[4] = outside[4] && y > tanY * depth;
+                }
+                if (outside[0] || outside[1] || outside[2] || outside[3] || outside[4]) continue;
+
+                glm::vec3 nearest = glm::clamp(cameraPos, lo, hi);
+                candidates.emplace_back(glm::length(nearest - cameraPos), brick);
+            }
+        }
+    }
+
+    std::sort(candidates.begin(), candidates.end());
+    std::vector<int> bricks(candidates.size());
+    for (size_t i = 0; i < candidates.size(); i++) {
+        bricks[i] = candidates[i].second;
+    }
+    return bricks;
+}
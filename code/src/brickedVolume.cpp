@@ -0,0 +1,216 @@
+#include "brickedVolume.h"
+#include "brickGrid.h"
+#include "parallel.h"
+#include <iostream>
+#include <cstring>
+
+namespace {
+
+const char brickedMagic[8] = { 'V', 'O', 'L', 'B', 'R', 'K', '1', 0 };
+
+struct BrickedHeader {
+    char magic[8];
+    int32_t dims[3];
+    int32_t brickSize;
+    int32_t voxelType;
+    float spacing[3];
+    float valueRange[2];
+    uint64_t rangesOffset;
+    uint64_t bricksOffset;
+};
+
+bool seekFile(FILE* file, uint64_t offset)
+{
+#ifdef _WIN32
+    return _fseeki64(file, int64_t(offset), SEEK_SET) == 0;
+#else
+    return fseeko(file, off_t(offset), SEEK_SET) == 0;
+#endif
+}
+
+template<typename T>
+void fillBrick(const VoxelAccessor<T>& volume, int brickSize, int bx, int by, int bz, T* out, float& lo, float& hi, T& coreLo, T& coreHi)
+{
+    const int padded = brickSize + 2;
+    const int x0 = bx * brickSize - 1, y0 = by * brickSize - 1, z0 = bz * brickSize - 1;
+    T minValue = volume.inside(x0 + 1, y0 + 1, z0 + 1) ? volume(x0 + 1, y0 + 1, z0 + 1) : T(0);
+    T maxValue = minValue;
+    coreLo = coreHi = minValue;
+
+    for (int k = 0; k < padded; k++) {
+        for (int j = 0; j < padded; j++) {
+            T* row = out + (size_t(k) * padded + j) * padded;
+            for (int i = 0; i < padded; i++) {
+                int x = x0 + i, y = y0 + j, z = z0 + k;
+                if (!volume.inside(x, y, z)) {
+                    row[i] = T(0);
+                    continue;
+                }
+                T value = volume(x, y, z);
+                row[i] = value;
+                minValue = std::min(minValue, value);
+                maxValue = std::max(maxValue, value);
+                bool core = i > 0 && j > 0 && k > 0 && i <= brickSize && j <= brickSize && k <= brickSize;
+                if (core) {
+                    coreLo = std::min(coreLo, value);
+                    coreHi = std::max(coreHi, value);
+                }
+            }
+        }
+    }
+    // Same ranges BrickGrid::build computes: the brick plus the apron inside the volume
+    lo = VoxelTraits<T>::normalize(minValue);
+    hi = VoxelTraits<T>::normalize(maxValue);
+}
+
+}
+
+bool BrickedVolume::isBrickedPath(const std::string& path)
+{
+    return path.size() >= 5 && path.compare(path.size() - 5, 5, ".vbrk") == 0;
+}
+
+bool BrickedVolume::write(const std::string& path, const void* volume, VoxelType type, const VoxelLayout& layout, glm::vec3 voxelSpacing, int size)
+{
+    if (size < 1) {
+        std::cerr << "Invalid brick size " << size << std::endl;
+        return false;
+    }
+    FILE* out = fopen(path.c_str(), "wb");
+    if (!out) {
+        std::cerr << "Could not create " << path << std::endl;
+        return false;
+    }
+
+    const int* volumeDims = layout.getDims();
+    int grid[3];
+    for (int axis = 0; axis < 3; axis++) {
+        grid[axis] = (volumeDims[axis] + size - 1) / size;
+    }
+    const size_t brickCount = size_t(grid[0]) * grid[1] * grid[2];
+    const size_t paddedVoxels = size_t(size + 2) * (size + 2) * (size + 2);
+    const size_t brickBytes = paddedVoxels * voxelTypeSize(type);
+
+    BrickedHeader header = {};
+    memcpy(header.magic, brickedMagic, sizeof(brickedMagic));
+    for (int axis = 0; axis < 3; axis++) {
+        header.dims[axis] = volumeDims[axis];
+        header.spacing[axis] = voxelSpacing[axis];
+    }
+    header.brickSize = size;
+    header.voxelType = int32_t(type);
+    header.rangesOffset = sizeof(BrickedHeader);
+    header.bricksOffset = header.rangesOffset + brickCount * 2 * sizeof(float);
+
+    // Bricks are written one row at a time, so memory use stays at a row of bricks whatever the volume size
+    std::vector<float> ranges(brickCount * 2);
+    std::vector<unsigned char> row(size_t(grid[0]) * brickBytes);
+    bool ok = seekFile(out, header.bricksOffset);
+    double lowest = 0.0, highest = 0.0;
+    bool first = true;
+
+    dispatchVoxelType(type, [&](auto zero) {
+        using T = decltype(zero);
+        VoxelAccessor<T> source(volume, layout);
+        std::vector<T> rowLo(grid[0]), rowHi(grid[0]);
+
+        for (int bz = 0; bz < grid[2] && ok; bz++) {
+            for (int by = 0; by < grid[1] && ok; by++) {
+                size_t rowStart = (size_t(bz) * grid[1] + by) * grid[0];
+                parallelFor(0, grid[0], [&](int bxBegin, int bxEnd) {
+                    for (int bx = bxBegin; bx < bxEnd; bx++) {
+                        T* brick = reinterpret_cast<T*>(row.data() + bx * brickBytes);
+                        fillBrick(source, size, bx, by, bz, brick, ranges[(rowStart + bx) * 2], ranges[(rowStart + bx) * 2 + 1], rowLo[bx], rowHi[bx]);
+                    }
+                });
+                for (int bx = 0; bx < grid[0]; bx++) {
+                    if (first || rowLo[bx] < lowest) lowest = double(rowLo[bx]);
+                    if (first || rowHi[bx] > highest) highest = double(rowHi[bx]);
+                    first = false;
+                }
+                ok = fwrite(row.data(), brickBytes, grid[0], out) == size_t(grid[0]);
+            }
+        }
+    });
+
+    // Matches VolumeReader::getValueRange, which reports the full range for 8-bit volumes
+    header.valueRange[0] = type == VoxelType::UInt8 ? 0.0f : float(lowest);
+    header.valueRange[1] = type == VoxelType::UInt8 ? 255.0f : float(highest);
+
+    ok = ok && seekFile(out, 0)
+        && fwrite(&header, sizeof(header), 1, out) == 1
+        && fwrite(ranges.data(), sizeof(float), ranges.size(), out) == ranges.size();
+    ok = fclose(out) == 0 && ok;
+    if (!ok) {
+        std::cerr << "Failed writing " << path << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << path << ": " << grid[0] << "x" << grid[1] << "x" << grid[2] << " bricks of " << size << "^3 voxels ("
+        << (header.bricksOffset + brickCount * brickBytes) / (1024.0 * 1024.0) << " MB)" << std::endl;
+    return true;
+}
+
+bool BrickedVolume::open(const std::string& path)
+{
+    close();
+    file = fopen(path.c_str(), "rb");
+    if (!file) {
+        std::cerr << "Could not open " << path << std::endl;
+        return false;
+    }
+
+    BrickedHeader header;
+    if (fread(&header, sizeof(header), 1, file) != 1 || memcmp(header.magic, brickedMagic, sizeof(brickedMagic)) != 0) {
+        std::cerr << path << " is not a bricked volume" << std::endl;
+        close();
+        return false;
+    }
+    if (header.brickSize < 1 || header.voxelType < 0 || header.voxelType >= int32_t(VoxelType::Unknown)
+        || header.dims[0] < 1 || header.dims[1] < 1 || header.dims[2] < 1) {
+        std::cerr << path << ": invalid header" << std::endl;
+        close();
+        return false;
+    }
+
+    brickSize = header.brickSize;
+    voxelType = VoxelType(header.voxelType);
+    for (int axis = 0; axis < 3; axis++) {
+        dims[axis] = header.dims[axis];
+        gridDims[axis] = (dims[axis] + brickSize - 1) / brickSize;
+        spacing[axis] = header.spacing[axis];
+    }
+    valueRange = glm::vec2(header.valueRange[0], header.valueRange[1]);
+    bricksOffset = header.bricksOffset;
+
+    minMax.resize(getBrickCount() * 2);
+    if (!seekFile(file, header.rangesOffset) || fread(minMax.data(), sizeof(float), minMax.size(), file) != minMax.size()) {
+        std::cerr << path << ": truncated brick ranges" << std::endl;
+        close();
+        return false;
+    }
+
+    std::cout << "Bricked volume " << dims[0] << "x" << dims[1] << "x" << dims[2] << " " << voxelTypeName(voxelType) << ", "
+        << getBrickCount() << " bricks of " << brickSize << "^3 (" << getBrickBytes() / 1024.0 << " KB each)" << std::endl;
+    return true;
+}
+
+void BrickedVolume::close()
+{
+    if (file) {
+        fclose(file);
+        file = nullptr;
+    }
+    minMax.clear();
+}
+
+bool BrickedVolume::readBrick(size_t brick, void* out)
+{
+    std::lock_guard<std::mutex> lock(fileMutex);
+    if (!file || brick >= getBrickCount()) return false;
+    return seekFile(file, bricksOffset + brick * getBrickBytes()) && fread(out, getBrickBytes(), 1, file) == 1;
+}
+
+void BrickedVolume::fillBrickGrid(BrickGrid& grid) const
+{
+    grid.assign(dims, brickSize, minMax);
+}
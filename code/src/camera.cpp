@@ -0,0 +1,56 @@
+#include "camera.h"
+#include <glm/gtc/matrix_transform.hpp>
+#include <fstream>
+#include <sstream>
+#include <iostream>
+
+glm::mat4 volumeModelMatrix(const glm::vec3& volumeSize)
+{
+    // Model coordinates are the world coordinates
+    return glm::translate(glm::mat4(1.0f), glm::vec3(-volumeSize.x / 2, -volumeSize.y / 2, volumeSize.z / 2));
+}
+
+glm::mat4 cameraViewMatrix(const CameraPose& pose)
+{
+    return glm::lookAt(pose.position, pose.at, pose.up);
+}
+
+glm::mat4 cameraProjectionMatrix(float aspect)
+{
+    return glm::perspective(45.0f, aspect, 0.1f, 800.0f);
+}
+
+bool readCameraPoses(const std::string& fileName, std::vector<CameraPose>& poses)
+{
+    std::ifstream ifs(fileName);
+    if (!ifs) {
+        std::cerr << "Failed to open camera file: " << fileName << std::endl;
+        return false;
+    }
+
+    std::string line;
+    int lineNumber = 0;
+    while (std::getline(ifs, line)) {
+        lineNumber++;
+        size_t comment = line.find('#');
+        if (comment != std::string::npos) line.erase(comment);
+
+        std::istringstream tokens(line);
+        std::vector<float> values;
+        float value;
+        while (tokens >> value) values.push_back(value);
+        if (values.empty()) continue;
+
+        if (values.size() != 3 && values.size() != 6 && values.size() != 9) {
+            std::cerr << fileName << ":" << lineNumber << ": expected 3, 6 or 9 numbers" << std::endl;
+            return false;
+        }
+
+        CameraPose pose;
+        pose.position = glm::vec3(values[0], values[1], values[2]);
+        if (values.size() >= 6) pose.at = glm::vec3(values[3], values[4], values[5]);
+        if (values.size() == 9) pose.up = glm::vec3(values[6], values[7], values[8]);
+        poses.push_back(pose);
+    }
+    return true;
+}
@@ -0,0 +1,358 @@
+// VolumeRenderingTests: checks of volren_core that need no GPU. Run without arguments for every test, or with
+// test names (voxel_type, gradient_packing, occupancy, skipping, packets, layouts) as CTest does. Exits with the
+// number of failures.
+#include "voxelType.h"
+#include "voxelLayout.h"
+#include "brickGrid.h"
+#include "volumePyramid.h"
+#include "gradientVolume.h"
+#include "transferFunction.h"
+#include "cpuRayCaster.h"
+#include "camera.h"
+#include "syntheticVolume.h"
+#include <iostream>
+#include <string>
+#include <vector>
+#include <cmath>
+#include <algorithm>
+
+namespace {
+
+int failures = 0;
+
+void check(bool condition, const std::string& what)
+{
+    if (!condition) {
+        std::cerr << "FAILED: " << what << std::endl;
+        failures++;
+    }
+}
+
+void testVoxelType()
+{
+    struct Case { const char* name; VoxelType expected; };
+    const Case cases[] = {
+        { "foo_512x512x512_uint16.raw", VoxelType::UInt16 },
+        { "ct_512x512x300_int16.raw", VoxelType::Int16 },
+        { "head_256x256x225.raw", VoxelType::UInt8 },
+        { "head_256x256x225_uint8.raw", VoxelType::UInt8 },
+        { "density_float32_128x128x128.raw", VoxelType::Float32 },
+        { "volumes/uint16.raw", VoxelType::UInt16 },
+        { "uint16_scans/head_256x256x225.raw", VoxelType::UInt8 },     // Directories do not count
+        { "C:\\int16\\head.raw", VoxelType::UInt8 },
+        { "head_uint16x.raw", VoxelType::UInt8 },                      // Only whole tokens
+    };
+    for (const Case& c : cases) {
+        VoxelType type = voxelTypeFromFileName(c.name);
+        check(type == c.expected, std::string("voxelTypeFromFileName(\"") + c.name + "\") is " + voxelTypeName(type)
+            + ", expected " + voxelTypeName(c.expected));
+    }
+}
+
+void testGradientPacking()
+{
+    // Directions spread over the sphere (both octahedron halves), plus the axes and the folds' edges
+    std::vector<glm::vec3> directions = {
+        glm::vec3(1, 0, 0), glm::vec3(-1, 0, 0), glm::vec3(0, 1, 0), glm::vec3(0, -1, 0), glm::vec3(0, 0, 1),
+        glm::vec3(0, 0, -1), glm::vec3(1, 1, 0), glm::vec3(-1, 1, 0), glm::vec3(1, -1, -1), glm::vec3(-1, -1, -1)
+    };
+    const int count = 2000;
+    for (int i = 0; i < count; i++) {
+        float z = 1.0f - 2.0f * (i + 0.5f) / count;
+        float r = std::sqrt(1.0f - z * z);
+        float phi = 2.39996323f * i;
+        directions.push_back(glm::vec3(r * std::cos(phi), r * std::sin(phi), z));
+    }
+
+    // 10 bits per octahedral coordinate: the worst case is well below half a degree
+    const float minCosine = std::cos(0.5f * 3.14159265f / 180.0f);
+    int wrong = 0;
+    float worst = 1.0f;
+    for (const glm::vec3& direction : directions) {
+        glm::vec3 unit = glm::normalize(direction);
+        for (float length : { 0.01f, 1.0f, 250.0f }) {
+            float cosine = glm::dot(GradientVolume::unpackNormal(GradientVolume::pack(unit * length, 1.0f / 250.0f)), unit);
+            worst = std::min(worst, cosine);
+            if (!(cosine >= minCosine)) wrong++;
+        }
+    }
+    check(wrong == 0, std::to_string(wrong) + " packed normals are off by more than 0.5 degrees (worst cosine "
+        + std::to_string(worst) + ")");
+
+    // Magnitude in the third channel, relative to magnitudeScale and saturating at 1
+    for (float magnitude : { 0.0f, 0.25f, 0.5f, 1.0f, 2.0f }) {
+        uint32_t texel = GradientVolume::pack(glm::vec3(0.0f, magnitude, 0.0f), 1.0f);
+        float unpacked = float((texel >> 20) & 1023u) / 1023.0f;
+        check(std::abs(unpacked - std::min(magnitude, 1.0f)) <= 0.5f / 1023.0f,
+            "packed magnitude " + std::to_string(magnitude) + " reads back as " + std::to_string(unpacked));
+    }
+
+    // A zero gradient (homogeneous region) still decodes to a unit vector
+    glm::vec3 flat = GradientVolume::unpackNormal(GradientVolume::pack(glm::vec3(0.0f), 1.0f));
+    check(std::abs(glm::length(flat) - 1.0f) < 1e-3f, "zero gradient does not decode to a unit normal");
+}
+
+// Synthetic volume set up for the CPU ray caster in one layout, with everything the optional features read
+struct RenderVolume {
+    static constexpr int n = 48;
+    static constexpr VoxelType type = VoxelType::UInt16;
+    std::vector<unsigned char> voxels;
+    VoxelLayout layout;
+    BrickGrid grid;
+    OccupancyGrid occupancy;
+    VolumePyramid pyramid;
+    float lut[256 * 4];
+
+    void create(const std::vector<uint16_t>& linear, VoxelOrder order)
+    {
+        layout.build(order, n, n, n, 8);
+        voxels.assign(layout.getStorageSize() * voxelTypeSize(type), 0);
+        layout.swizzle(linear.data(), type, voxels.data());
+
+        // 8^3 bricks leave the corners outside the sphere empty; with 16^3 every brick touches it
+        grid.build(voxels.data(), type, layout, 8);
+        occupancy.setBrickGrid(&grid);
+        // Nothing below 0.1, then colour at zero opacity: samples there add colour but never stop a ray
+        buildTransferFunctionLUT({
+            { 0.0f, glm::vec4(0, 0, 0, 0) },
+            { 0.1f, glm::vec4(0, 0, 0, 0) },
+            { 0.15f, glm::vec4(0.8f, 0.3f, 0.2f, 0.0f) },
+            { 0.3f, glm::vec4(0.8f, 0.3f, 0.2f, 0.0f) },
+            { 0.45f, glm::vec4(0.9f, 0.6f, 0.4f, 0.15f) },
+            { 0.7f, glm::vec4(1.0f, 0.9f, 0.8f, 0.05f) },
+            { 1.0f, glm::vec4(1, 1, 1, 0.9f) }
+        }, lut);
+        int dirtyZBegin, dirtyZEnd;
+        occupancy.update(lut, 0.0f, 1.0f, dirtyZBegin, dirtyZEnd);
+        pyramid.build(voxels.data(), type, layout, MipFilter::Average);
+    }
+
+    void attach(CPURayCaster& rayCaster) const
+    {
+        rayCaster.setVolume(voxels.data(), type, layout);
+        rayCaster.setTransferFunction(lut);
+        rayCaster.setOccupancyGrid(&occupancy);
+        rayCaster.setPyramid(&pyramid);
+    }
+};
+
+std::vector<uint16_t> syntheticLinearVolume()
+{
+    const int n = RenderVolume::n;
+    std::vector<uint16_t> linear(size_t(n) * n * n);
+    fillSyntheticVolume(linear.data(), n);
+
+    // Background outside the sphere: all zero texels for z < n / 2, which empty space skipping may drop, and
+    // colour at zero opacity for z >= n / 2, which it must not and which the test view sees in front of the sphere
+    for (size_t i = 0; i < linear.size(); i++) {
+        if (linear[i] == 0) linear[i] = uint16_t((int(i / (size_t(n) * n)) < n / 2 ? 0.05f : 0.2f) * 65535.0f);
+    }
+    return linear;
+}
+
+// The feature combinations the equivalence claims cover
+struct RenderCase {
+    const char* name;
+    bool emptySpaceSkipping, levelOfDetail, adaptiveStepping;
+};
+const RenderCase renderCases[] = {
+    { "plain", false, false, false },
+    { "skipping", true, false, false },
+    { "lod", false, true, false },
+    { "skipping+lod", true, true, false },
+    { "adaptive", false, false, true },
+    { "skipping+adaptive", true, false, true },
+    { "lod+adaptive", false, true, true },
+    { "skipping+lod+adaptive", true, true, true },
+};
+
+CPURenderParams renderParams(const RenderCase& renderCase)
+{
+    // An oblique view, so rays cross bricks and layout tiles along every axis, at an odd size for partial packets
+    const int width = 101, height = 67;
+    CameraPose pose{ glm::vec3(16.0f, 12.0f, 34.0f) };
+    glm::vec3 volumeSize(float(RenderVolume::n));
+
+    CPURenderParams params;
+    params.width = width;
+    params.height = height;
+    params.cameraPos = pose.position;
+    params.modelViewProjection = cameraProjectionMatrix(float(width) / float(height)) * cameraViewMatrix(pose) * volumeModelMatrix(volumeSize);
+    params.volumeSize = volumeSize;
+    params.emptySpaceSkipping = renderCase.emptySpaceSkipping;
+    params.levelOfDetail = renderCase.levelOfDetail;
+    params.lodBias = 1.0f;                         // The footprint alone stays below a voxel at this size
+    params.adaptiveStepping = renderCase.adaptiveStepping;
+    params.adaptiveOpacity = 0.5f;                 // Most bricks of this transfer function qualify for longer steps
+    params.clearColor = glm::vec4(0.0f, 0.0f, 0.0f, 1.0f);
+    return params;
+}
+
+std::string compareImages(const std::vector<unsigned char>& expected, const std::vector<unsigned char>& actual, int width)
+{
+    if (expected.size() != actual.size()) return "image sizes differ";
+    size_t different = 0, first = 0;
+    for (size_t i = 0; i < expected.size(); i++) {
+        if (expected[i] != actual[i] && different++ == 0) first = i;
+    }
+    if (different == 0) return "";
+    size_t pixel = first / 4;
+    return std::to_string(different) + " bytes differ, first at pixel (" + std::to_string(pixel % width) + ", "
+        + std::to_string(pixel / width) + ")";
+}
+
+bool coversVolume(const std::vector<unsigned char>& rgba)
+{
+    // Over the black clear colour, for the comparisons to mean anything a good part of the image must be lit
+    size_t lit = 0;
+    for (size_t i = 0; i < rgba.size(); i += 4) {
+        if (rgba[i] > 16) lit++;
+    }
+    return lit * 10 > rgba.size() / 4;
+}
+
+void testPackets()
+{
+    RenderVolume volume;
+    volume.create(syntheticLinearVolume(), VoxelOrder::Linear);
+    CPURayCaster rayCaster;
+    volume.attach(rayCaster);
+
+    std::vector<std::vector<unsigned char>> references;
+    for (const RenderCase& renderCase : renderCases) {
+        CPURenderParams params = renderParams(renderCase);
+        std::vector<unsigned char> reference, image;
+        rayCaster.setPacketWidth(1);
+        rayCaster.render(params, reference);
+        check(coversVolume(reference), std::string(renderCase.name) + ": the scalar image is empty");
+        references.push_back(reference);
+
+        for (int width : { 4, 8, 16 }) {
+            rayCaster.setPacketWidth(width);
+            if (rayCaster.getPacketWidth() != width) {
+                std::cout << "Skipping " << width << " wide packets (" << renderCase.name << "), not supported by this CPU" << std::endl;
+                continue;
+            }
+            rayCaster.render(params, image);
+            std::string difference = compareImages(reference, image, params.width);
+            check(difference.empty(), std::string(renderCase.name) + ": " + std::to_string(width) + " wide packets differ from scalar, " + difference);
+        }
+    }
+
+    // Otherwise the cases above would not exercise level of detail and adaptive stepping at all
+    check(references[2] != references[0], "level of detail does not change the image");
+    check(references[4] != references[0], "adaptive stepping does not change the image");
+}
+
+void testOccupancy()
+{
+    RenderVolume volume;
+    volume.create(syntheticLinearVolume(), VoxelOrder::Linear);
+    const int bricks = int(volume.grid.getBrickCount());
+    auto countEmpty = [&]() {
+        int empty = 0;
+        for (int i = 0; i < bricks; i++) empty += volume.occupancy.getOccupancy()[i] == 0;
+        return empty;
+    };
+    int empty = countEmpty();
+    check(empty > 0 && empty < bricks, std::to_string(empty) + " of " + std::to_string(bricks) + " bricks are empty, the skipping cases need some of both");
+
+    // A colour-only edit where the transfer function is transparent makes those bricks visible again
+    float lut[256 * 4];
+    std::copy(volume.lut, volume.lut + 256 * 4, lut);
+    for (int i = 0; i < 26; i++) lut[i * 4 + 2] = 0.5f;
+    int dirtyZBegin, dirtyZEnd;
+    bool changed = volume.occupancy.update(lut, 0.0f, 1.0f, dirtyZBegin, dirtyZEnd);
+    check(changed && dirtyZBegin < dirtyZEnd, "a colour-only edit is not reported as a change");
+    check(countEmpty() == 0, std::to_string(countEmpty()) + " bricks stay empty after a colour-only edit");
+}
+
+void testSkipping()
+{
+    RenderVolume volume;
+    volume.create(syntheticLinearVolume(), VoxelOrder::Linear);
+    CPURayCaster rayCaster;
+    volume.attach(rayCaster);
+
+    // Skipping bricks the transfer function maps to nothing must not change a single byte, with every other feature
+    for (const RenderCase& renderCase : renderCases) {
+        if (renderCase.emptySpaceSkipping) continue;
+        CPURenderParams params = renderParams(renderCase);
+        for (int width : { 1, 0 }) {
+            rayCaster.setPacketWidth(width);
+            std::vector<unsigned char> expected, image;
+            params.emptySpaceSkipping = false;
+            rayCaster.render(params, expected);
+            params.emptySpaceSkipping = true;
+            rayCaster.render(params, image);
+            std::string difference = compareImages(expected, image, params.width);
+            check(difference.empty(), std::string(renderCase.name) + " with skipping (packet width " + std::to_string(rayCaster.getPacketWidth())
+                + ") differs from without, " + difference);
+        }
+    }
+}
+
+void testLayouts()
+{
+    std::vector<uint16_t> linear = syntheticLinearVolume();
+    RenderVolume reference;
+    reference.create(linear, VoxelOrder::Linear);
+    CPURayCaster rayCaster;
+
+    for (VoxelOrder order : { VoxelOrder::Morton, VoxelOrder::Tiled }) {
+        RenderVolume volume;
+        volume.create(linear, order);
+        const std::string name = volume.layout.describe();
+
+        for (const RenderCase& renderCase : renderCases) {
+            CPURenderParams params = renderParams(renderCase);
+            for (int width : { 1, 0 }) {
+                rayCaster.setPacketWidth(width);
+                std::vector<unsigned char> expected, image;
+                reference.attach(rayCaster);
+                rayCaster.render(params, expected);
+                volume.attach(rayCaster);
+                rayCaster.render(params, image);
+                std::string difference = compareImages(expected, image, params.width);
+                check(difference.empty(), name + " (" + renderCase.name + ", packet width " + std::to_string(rayCaster.getPacketWidth())
+                    + ") differs from linear, " + difference);
+            }
+        }
+    }
+}
+
+struct Test {
+    const char* name;
+    void (*run)();
+};
+const Test tests[] = {
+    { "voxel_type", testVoxelType },
+    { "gradient_packing", testGradientPacking },
+    { "occupancy", testOccupancy },
+    { "skipping", testSkipping },
+    { "packets", testPackets },
+    { "layouts", testLayouts },
+};
+
+} // namespace
+
+int main(int argc, char** argv)
+{
+    std::vector<std::string> selected(argv + 1, argv + argc);
+    for (const std::string& name : selected) {
+        bool known = false;
+        for (const Test& test : tests) known = known || name == test.name;
+        if (!known) {
+            std::cerr << "Unknown test " << name << std::endl;
+            return 1;
+        }
+    }
+
+    for (const Test& test : tests) {
+        if (!selected.empty() && std::find(selected.begin(), selected.end(), test.name) == selected.end()) continue;
+        int before = failures;
+        test.run();
+        std::cout << (failures == before ? "passed " : "FAILED ") << test.name << std::endl;
+    }
+    return failures;
+}
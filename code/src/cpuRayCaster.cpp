@@ -0,0 +1,408 @@
+#include "cpuRayCaster.h"
+#include "rayCastKernels.h"
+#include <cmath>
+
+#if defined(VOLREN_X86_SIMD) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace {
+
+// Slab test of fshader11's rayintersection(), including its order of comparisons
+bool rayIntersection(const glm::vec3& position, const glm::vec3& dir, const glm::vec3& extentMin, const glm::vec3& extentMax, float& tentry, float& texit)
+{
+    float tymin, tymax, tzmin, tzmax;
+    glm::vec3 invdir = 1.0f / dir;
+
+    if (invdir.x < 0) {
+        tentry = (extentMax.x - position.x) / dir.x;
+        texit = (extentMin.x - position.x) / dir.x;
+    }
+    else {
+        tentry = (extentMin.x - position.x) / dir.x;
+        texit = (extentMax.x - position.x) / dir.x;
+    }
+
+    if (invdir.y < 0) {
+        tymin = (extentMax.y - position.y) / dir.y;
+        tymax = (extentMin.y - position.y) / dir.y;
+    }
+    else {
+        tymin = (extentMin.y - position.y) / dir.y;
+        tymax = (extentMax.y - position.y) / dir.y;
+    }
+
+    if ((tentry > tymax) || (tymin > texit)) {
+        return false;
+    }
+
+    if (tymin > tentry) tentry = tymin;
+    if (tymax < texit) texit = tymax;
+
+    if (invdir.z < 0) {
+        tzmin = (extentMax.z - position.z) / dir.z;
+        tzmax = (extentMin.z - position.z) / dir.z;
+    }
+    else {
+        tzmin = (extentMin.z - position.z) / dir.z;
+        tzmax = (extentMax.z - position.z) / dir.z;
+    }
+
+    if (tzmin > tentry) tentry = tzmin;
+    if (tzmax < texit) texit = tzmax;
+
+    if (texit > 0 && tentry < texit) {
+        tentry = tentry < 0 ? 0 : tentry;
+        return true;
+    }
+    return false;
+}
+
+// GL_LINEAR lookup in the 256 texel GL_REPEAT transfer function texture
+inline glm::vec4 sampleTransferFunction(const float* lut, float s)
+{
+    float u = s * 256.0f - 0.5f;
+    float base = std::floor(u);
+    float f = u - base;
+    int i0 = int(base) & 255, i1 = (int(base) + 1) & 255;
+    const float* a = lut + i0 * 4;
+    const float* b = lut + i1 * 4;
+    return glm::vec4(a[0] + f * (b[0] - a[0]), a[1] + f * (b[1] - a[1]), a[2] + f * (b[2] - a[2]), a[3] + f * (b[3] - a[3]));
+}
+
+// GL_LINEAR lookup in the volume texture with GL_CLAMP addressing: coordinates clamp to [0, 1] first
+template<typename T>
+inline float sampleVolume(const VoxelAccessor<T>& voxels, const glm::vec3& texPos)
+{
+    int i0[3];
+    float f[3];
+    for (int axis = 0; axis < 3; axis++) {
+        float u = std::min(std::max(texPos[axis], 0.0f), 1.0f) * voxels.dims[axis] - 0.5f;
+        float base = std::floor(u);
+        i0[axis] = int(base);
+        f[axis] = u - base;
+    }
+
+    // The eight texels of the GL_LINEAR footprint, x fastest; texels outside the volume read the zero border
+    float c[8];
+    for (int corner = 0; corner < 8; corner++) {
+        int x = i0[0] + (corner & 1), y = i0[1] + ((corner >> 1) & 1), z = i0[2] + (corner >> 2);
+        c[corner] = voxels.inside(x, y, z) ? VoxelTraits<T>::normalize(voxels(x, y, z)) : 0.0f;
+    }
+    float c00 = c[0] * (1 - f[0]) + c[1] * f[0];
+    float c10 = c[2] * (1 - f[0]) + c[3] * f[0];
+    float c01 = c[4] * (1 - f[0]) + c[5] * f[0];
+    float c11 = c[6] * (1 - f[0]) + c[7] * f[0];
+    float c0 = c00 * (1 - f[1]) + c10 * f[1];
+    float c1 = c01 * (1 - f[1]) + c11 * f[1];
+    return c0 * (1 - f[2]) + c1 * f[2];
+}
+
+inline unsigned char toUnorm8(float v)
+{
+    return (unsigned char)std::lround(std::min(std::max(v, 0.0f), 1.0f) * 255.0f);
+}
+
+// Widest ray packet the CPU and OS support: 16 (AVX-512), 8 (AVX2), 4 (SSE4.1) or 1 (scalar only)
+int detectPacketWidth()
+{
+#if defined(VOLREN_X86_SIMD) && defined(_MSC_VER)
+    int info[4];
+    __cpuid(info, 0);
+    int maxLeaf = info[0];
+    __cpuid(info, 1);
+    bool sse41 = (info[2] & (1 << 19)) != 0;
+    bool osxsave = (info[2] & (1 << 27)) != 0;
+    bool avx = (info[2] & (1 << 28)) != 0;
+    unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+    bool ymmState = (xcr0 & 0x6) == 0x6, zmmState = (xcr0 & 0xE6) == 0xE6;
+    bool avx2 = false, avx512 = false;
+    if (maxLeaf >= 7) {
+        __cpuidex(info, 7, 0);
+        avx2 = avx && ymmState && (info[1] & (1 << 5)) != 0;
+        avx512 = ymmState && zmmState && (info[1] & (1 << 16)) != 0;
+    }
+    return avx512 ? 16 : avx2 ? 8 : sse41 ? 4 : 1;
+#elif defined(VOLREN_X86_SIMD)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return 16;
+    if (__builtin_cpu_supports("avx2")) return 8;
+    if (__builtin_cpu_supports("sse4.1")) return 4;
+    return 1;
+#else
+    return 1;
+#endif
+}
+
+template<typename T>
+void renderTileScalarTyped(const RayCastFrame& frame, int x0, int y0, int x1, int y1)
+{
+    const float screenWidth = float(frame.width), screenHeight = float(frame.height);
+    const glm::vec3 extent = frame.extent;
+    const glm::vec3 brickGridScale = frame.brickGridScale;
+
+    for (int py = y0; py < y1; py++) {
+        for (int px = x0; px < x1; px++) {
+            if (!raycast::boxCoversPixel(frame, px, py)) {
+                raycast::writeClear(frame, px, py);
+                continue;
+            }
+
+            // gl_FragCoord is the pixel centre
+            float fragX = px + 0.5f, fragY = py + 0.5f;
+            float xw = frame.aspect * (fragX - screenWidth / 2.0f + 0.5f) / screenWidth;
+            float yw = (fragY - screenHeight / 2.0f + 0.5f) / screenHeight;
+            glm::vec3 position = frame.cameraPos;
+            glm::vec3 direction = glm::normalize(frame.u * xw + frame.v * yw - frame.focalDistance * frame.w);
+
+            glm::vec4 dst(0.0f);
+            float tentry, texit;
+            if (rayIntersection(position, direction, frame.extentMin, frame.extentMax, tentry, texit)) {
+                int level = frame.levelOfDetail ? raycast::selectLevel(frame, tentry) : 0;
+                const VoxelAccessor<T> voxels(frame.levels[level].volume, *frame.levels[level].layout);
+                const float levelScale = float(1 << level);
+                const float stepSize = frame.stepSize * levelScale;
+                const float stepRatio = frame.stepRatio * levelScale;
+
+                float t = tentry;
+                glm::vec3 currentPos = position + t * direction;
+
+                glm::vec3 brickDir = direction / extent * brickGridScale;
+                for (int axis = 0; axis < 3; axis++) {
+                    brickDir[axis] = std::max(std::abs(brickDir[axis]), 1e-6f) * (brickDir[axis] >= 0.0f ? 1.0f : -1.0f);
+                }
+
+                for (;;) {
+                    glm::vec3 texPos = (currentPos + extent / 2.0f) / extent;
+                    float advance = stepSize, sampleRatio = stepRatio;
+                    if (frame.occupied || frame.maxOpacity) {
+                        glm::vec3 brickPos = texPos * brickGridScale;
+                        int b[3];
+                        for (int axis = 0; axis < 3; axis++) {
+                            b[axis] = std::min(std::max(int(brickPos[axis]), 0), frame.lastBrick[axis]);
+                        }
+                        size_t brick = (size_t(b[2]) * frame.gridDims[1] + b[1]) * frame.gridDims[0] + b[0];
+                        bool skip = frame.occupied && frame.occupied[brick] == 0;
+                        float stepScale = frame.maxOpacity ? raycast::adaptiveStepScale(frame, frame.maxOpacity[brick]) : 1.0f;
+
+                        if (skip || stepScale > 1.0f) {
+                            // Distance to the first sample past the brick, on the same lattice of t values
+                            float tBrick = INFINITY;
+                            for (int axis = 0; axis < 3; axis++) {
+                                float boundary = std::floor(brickPos[axis]) + (brickDir[axis] >= 0.0f ? 1.0f : 0.0f);
+                                tBrick = std::min(tBrick, (boundary - brickPos[axis]) / brickDir[axis]);
+                            }
+                            float pastBrick = std::max(std::ceil(tBrick / stepSize), 1.0f) * stepSize;
+                            if (skip) {
+                                t += pastBrick;
+                                currentPos = position + direction * t;
+                                if (t > texit) break;
+                                continue;
+                            }
+                            advance = std::min(stepSize * stepScale, pastBrick);
+                            sampleRatio = stepRatio * (advance / stepSize);
+                        }
+                    }
+
+                    float value = sampleVolume(voxels, texPos);
+                    float scalar = std::min(std::max((value - frame.windowMin) / (frame.windowMax - frame.windowMin), 0.0f), 1.0f);
+                    glm::vec4 src = sampleTransferFunction(frame.transferFunction, scalar);
+
+                    float weight = scalar;
+                    if (sampleRatio != 1.0f) {
+                        weight = raycast::correctedWeight(scalar, src.a, sampleRatio);
+                    }
+
+                    dst.r += (1.0f - dst.a) * src.r * weight;
+                    dst.g += (1.0f - dst.a) * src.g * weight;
+                    dst.b += (1.0f - dst.a) * src.b * weight;
+                    dst.a += (1.0f - dst.a) * src.a * weight;
+
+                    t += advance;
+                    currentPos = position + direction * t;
+                    if (t > texit) break;
+                    if (dst.a > 0.95f) break;
+                }
+            }
+
+            raycast::writeBlended(frame, px, py, dst.r, dst.g, dst.b, dst.a);
+        }
+    }
+}
+
+}
+
+void CPURayCaster::setVolume(const void* data, VoxelType type, const VoxelLayout& voxelLayout)
+{
+    volume = data;
+    volumeType = type;
+    layout = voxelLayout;
+}
+
+void CPURayCaster::setTransferFunction(const float* rgba256)
+{
+    for (int i = 0; i < 256 * 4; i++) {
+        transferFunction[i] = std::lround(std::min(std::max(rgba256[i], 0.0f), 1.0f) * 255.0f) / 255.0f;
+    }
+}
+
+bool raycast::boxCoversPixel(const RayCastFrame& frame, int px, int py)
+{
+    // The back face under the pixel centre has to lie between the near and far clip planes
+    float ndcX = (px + 0.5f) / frame.width * 2.0f - 1.0f;
+    float ndcY = (py + 0.5f) / frame.height * 2.0f - 1.0f;
+    glm::vec4 nearPoint = frame.inverseMVP * glm::vec4(ndcX, ndcY, -1.0f, 1.0f);
+    glm::vec4 farPoint = frame.inverseMVP * glm::vec4(ndcX, ndcY, 1.0f, 1.0f);
+    glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+    glm::vec3 delta = glm::vec3(farPoint) / farPoint.w - origin;
+
+    float sEnter = -INFINITY, sExit = INFINITY;
+    for (int axis = 0; axis < 3; axis++) {
+        if (delta[axis] == 0.0f) {
+            if (origin[axis] < frame.boxMin[axis] || origin[axis] > frame.boxMax[axis]) return false;
+            continue;
+        }
+        float s0 = (frame.boxMin[axis] - origin[axis]) / delta[axis];
+        float s1 = (frame.boxMax[axis] - origin[axis]) / delta[axis];
+        sEnter = std::max(sEnter, std::min(s0, s1));
+        sExit = std::min(sExit, std::max(s0, s1));
+    }
+    return sEnter <= sExit && sExit >= 0.0f && sExit <= 1.0f;
+}
+
+void raycast::writeClear(const RayCastFrame& frame, int px, int py)
+{
+    unsigned char* pixel = frame.image + (size_t(py) * frame.width + px) * 4;
+    for (int c = 0; c < 4; c++) pixel[c] = toUnorm8(frame.clearColor[c]);
+}
+
+void raycast::writeBlended(const RayCastFrame& frame, int px, int py, float r, float g, float b, float a)
+{
+    unsigned char* pixel = frame.image + (size_t(py) * frame.width + px) * 4;
+    glm::vec4 color = glm::clamp(glm::vec4(r, g, b, a), 0.0f, 1.0f);
+    glm::vec4 blended = color * color.a + frame.clearColor * (1.0f - color.a);
+    for (int c = 0; c < 4; c++) pixel[c] = toUnorm8(blended[c]);
+}
+
+int raycast::selectLevel(const RayCastFrame& frame, float tentry)
+{
+    float footprint = tentry * frame.footprintScale;
+    float lod = std::floor(std::log2(std::max(footprint, 1.0f)) + frame.lodBias);
+    return int(std::min(std::max(lod, 0.0f), float(frame.levelCount - 1)));
+}
+
+float raycast::correctedWeight(float scalar, float srcAlpha, float stepRatio)
+{
+    // The limit for alpha -> 0 is scalar * stepRatio, so colour at zero opacity keeps its weight per unit length
+    float alpha = srcAlpha * scalar;
+    return alpha > 0.0f ? scalar * (1.0f - std::pow(1.0f - std::min(alpha, 0.9999f), stepRatio)) / alpha : scalar * stepRatio;
+}
+
+float raycast::adaptiveStepScale(const RayCastFrame& frame, unsigned char maxOpacity)
+{
+    float opacity = maxOpacity / 255.0f;
+    return opacity > 0.0f ? std::min(std::max(frame.adaptiveOpacity / opacity, 1.0f), frame.maxStepScale) : frame.maxStepScale;
+}
+
+void renderTileScalar(const RayCastFrame& frame, int x0, int y0, int x1, int y1)
+{
+    dispatchVoxelType(frame.volumeType, [&](auto zero) {
+        renderTileScalarTyped<decltype(zero)>(frame, x0, y0, x1, y1);
+    });
+}
+
+int CPURayCaster::getSupportedPacketWidth()
+{
+    static const int supported = detectPacketWidth();
+    return supported;
+}
+
+void CPURayCaster::setPacketWidth(int width)
+{
+    // Round down to a kernel that exists and that the CPU can run
+    int limit = width <= 0 ? getSupportedPacketWidth() : std::min(width, getSupportedPacketWidth());
+    packetWidth = limit >= 16 ? 16 : limit >= 8 ? 8 : limit >= 4 ? 4 : 1;
+}
+
+void CPURayCaster::render(const CPURenderParams& params, std::vector<unsigned char>& rgba)
+{
+    rgba.resize(size_t(params.width) * params.height * 4);
+    if (!volume || params.width <= 0 || params.height <= 0) return;
+
+    RayCastFrame frame;
+    frame.width = params.width;
+    frame.height = params.height;
+    frame.image = rgba.data();
+
+    frame.cameraPos = params.cameraPos;
+    const glm::vec3 up = glm::vec3(0, 1, 0);
+    const float fov = 90.0f;
+    frame.aspect = float(params.width) / float(params.height);
+    frame.focalDistance = 1.0f / (2.0f * std::tan(fov * 3.14f / (180.0f * 2.0f)));
+    frame.w = glm::normalize(params.cameraPos);
+    frame.u = glm::normalize(glm::cross(up, frame.w));
+    frame.v = glm::normalize(glm::cross(frame.w, frame.u));
+
+    // The bounding box is drawn from model space [0, size - 1] x [0, size - 1] x [-size + 1, 0]
+    frame.inverseMVP = glm::inverse(params.modelViewProjection);
+    frame.boxMin = glm::vec3(0.0f, 0.0f, -params.volumeSize.z + 1.0f);
+    frame.boxMax = glm::vec3(params.volumeSize.x - 1.0f, params.volumeSize.y - 1.0f, 0.0f);
+
+    frame.extentMax = params.volumeSize * 0.5f;
+    frame.extentMin = -frame.extentMax;
+    frame.extent = frame.extentMax - frame.extentMin;
+    frame.stepSize = params.stepSize;
+    frame.stepRatio = params.stepRatio;
+    frame.windowMin = params.windowMin;
+    frame.windowMax = params.windowMax;
+    frame.clearColor = params.clearColor;
+
+    frame.transferFunction = transferFunction;
+    frame.volumeType = volumeType;
+    frame.levelCount = 1;
+    if (pyramid && pyramid->getVoxelType() == volumeType) {
+        frame.levelCount = std::min(pyramid->getLevelCount(), RayCastFrame::maxLevels);
+    }
+    for (int level = 0; level < frame.levelCount; level++) {
+        RayCastFrame::Level& target = frame.levels[level];
+        target.volume = level == 0 ? volume : pyramid->getLevel(level);
+        target.layout = level == 0 ? &layout : &pyramid->getLayout(level);
+        for (int axis = 0; axis < 3; axis++) {
+            target.offsets[axis] = target.layout->getOffsets(axis);
+            target.dims[axis] = target.layout->getDims()[axis];
+        }
+        target.linear = target.layout->getOrder() == VoxelOrder::Linear;
+    }
+
+    // Pixels subtend 1 / (height * focalDistance) per unit of distance; the finest voxel axis decides
+    const int* dims = layout.getDims();
+    glm::vec3 voxelSize = frame.extent / glm::vec3(dims[0], dims[1], dims[2]);
+    frame.levelOfDetail = params.levelOfDetail && frame.levelCount > 1;
+    frame.lodBias = params.lodBias;
+    frame.footprintScale = 1.0f / (float(params.height) * frame.focalDistance) / std::min(voxelSize.x, std::min(voxelSize.y, voxelSize.z));
+
+    if ((params.emptySpaceSkipping || params.adaptiveStepping) && occupancy && occupancy->getBrickGrid()) {
+        const BrickGrid* grid = occupancy->getBrickGrid();
+        if (params.emptySpaceSkipping) frame.occupied = occupancy->getOccupancy();
+        if (params.adaptiveStepping) frame.maxOpacity = occupancy->getOccupancy();
+        frame.adaptiveOpacity = params.adaptiveOpacity;
+        frame.maxStepScale = params.maxStepScale;
+        const int* dims = grid->getVolumeDims();
+        frame.brickGridScale = glm::vec3(dims[0], dims[1], dims[2]) / float(grid->getBrickSize());
+        for (int axis = 0; axis < 3; axis++) {
+            frame.gridDims[axis] = grid->getGridDims()[axis];
+            frame.lastBrick[axis] = frame.gridDims[axis] - 1;
+        }
+    }
+
+    RayCastTileFunc renderTile = renderTileScalar;
+#if defined(VOLREN_X86_SIMD)
+    if (packetWidth == 16) renderTile = renderTileAVX512;
+    else if (packetWidth == 8) renderTile = renderTileAVX2;
+    else if (packetWidth == 4) renderTile = renderTileSSE4;
+#endif
+
+    scheduler.run(pool, params.width, params.height, tileSize, [&](int x0, int y0, int x1, int y1) {
+        renderTile(frame, x0, y0, x1, y1);
+    });
+}
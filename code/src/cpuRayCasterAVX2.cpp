@@ -0,0 +1,8 @@
+// AVX2 ray packet kernel; this file is compiled with AVX2 code generation enabled (see CMakeLists.txt)
+#define VOLREN_SIMD_AVX2
+#include "rayCastPacket.h"
+
+void renderTileAVX2(const RayCastFrame& frame, int x0, int y0, int x1, int y1)
+{
+    PacketKernel<SimdAVX2>::render(frame, x0, y0, x1, y1);
+}
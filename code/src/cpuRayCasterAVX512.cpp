@@ -0,0 +1,8 @@
+// AVX-512F ray packet kernel; this file is compiled with AVX-512F code generation enabled (see CMakeLists.txt)
+#define VOLREN_SIMD_AVX512
+#include "rayCastPacket.h"
+
+void renderTileAVX512(const RayCastFrame& frame, int x0, int y0, int x1, int y1)
+{
+    PacketKernel<SimdAVX512>::render(frame, x0, y0, x1, y1);
+}
@@ -0,0 +1,8 @@
+// SSE4.1 ray packet kernel; this file is compiled with SSE4.1 code generation enabled (see CMakeLists.txt)
+#define VOLREN_SIMD_SSE4
+#include "rayCastPacket.h"
+
+void renderTileSSE4(const RayCastFrame& frame, int x0, int y0, int x1, int y1)
+{
+    PacketKernel<SimdSSE4>::render(frame, x0, y0, x1, y1);
+}
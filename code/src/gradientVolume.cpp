@@ -0,0 +1,140 @@
+#include "gradientVolume.h"
+#include "parallel.h"
+#include "trace.h"
+#include <cmath>
+
+namespace {
+
+// Central differences of one row: the row itself with one voxel of clamped padding on each side, and its four
+// neighbour rows. Plain loops over float arrays so the compiler vectorizes them.
+struct RowGradient {
+    std::vector<float> center, yMinus, yPlus, zMinus, zPlus;
+    std::vector<float> gx, gy, gz;
+
+    explicit RowGradient(int width)
+        : center(width + 2), yMinus(width), yPlus(width), zMinus(width), zPlus(width), gx(width), gy(width), gz(width) {}
+
+    template<typename T>
+    void compute(const VoxelAccessor<T>& volume, int y, int z, glm::vec3 scale)
+    {
+        const int width = volume.dims[0];
+        auto load = [&](int row, int slice, float* out) {
+            const T* voxels = volume.voxels + volume.y[row] + volume.z[slice];
+            for (int x = 0; x < width; x++) {
+                out[x] = VoxelTraits<T>::normalize(voxels[volume.x[x]]);
+            }
+        };
+        load(y, z, center.data() + 1);
+        center[0] = center[1];
+        center[width + 1] = center[width];
+        load(std::max(y - 1, 0), z, yMinus.data());
+        load(std::min(y + 1, volume.dims[1] - 1), z, yPlus.data());
+        load(y, std::max(z - 1, 0), zMinus.data());
+        load(y, std::min(z + 1, volume.dims[2] - 1), zPlus.data());
+
+        const float* c = center.data();
+        for (int x = 0; x < width; x++) {
+            gx[x] = (c[x + 2] - c[x]) * scale.x;
+            gy[x] = (yPlus[x] - yMinus[x]) * scale.y;
+            gz[x] = (zPlus[x] - zMinus[x]) * scale.z;
+        }
+    }
+};
+
+}
+
+uint32_t GradientVolume::pack(glm::vec3 gradient, float magnitudeScale)
+{
+    float length = std::abs(gradient.x) + std::abs(gradient.y) + std::abs(gradient.z);
+    float u = 0.0f, v = 0.0f;
+    if (length > 0.0f) {
+        // Project onto the octahedron |x| + |y| + |z| = 1 and fold the lower half over the upper one
+        u = gradient.x / length;
+        v = gradient.y / length;
+        if (gradient.z < 0.0f) {
+            float foldedU = (1.0f - std::abs(v)) * (u >= 0.0f ? 1.0f : -1.0f);
+            float foldedV = (1.0f - std::abs(u)) * (v >= 0.0f ? 1.0f : -1.0f);
+            u = foldedU;
+            v = foldedV;
+        }
+    }
+    float magnitude = std::min(glm::length(gradient) * magnitudeScale, 1.0f);
+    uint32_t r = uint32_t((u * 0.5f + 0.5f) * 1023.0f + 0.5f);
+    uint32_t g = uint32_t((v * 0.5f + 0.5f) * 1023.0f + 0.5f);
+    uint32_t b = uint32_t(magnitude * 1023.0f + 0.5f);
+    return r | g << 10 | b << 20 | 3u << 30;
+}
+
+glm::vec3 GradientVolume::unpackNormal(uint32_t texel)
+{
+    // Same decoding as fshader11
+    float u = float(texel & 1023u) / 1023.0f * 2.0f - 1.0f;
+    float v = float((texel >> 10) & 1023u) / 1023.0f * 2.0f - 1.0f;
+    glm::vec3 n(u, v, 1.0f - std::abs(u) - std::abs(v));
+    float t = std::max(-n.z, 0.0f);
+    n.x += n.x >= 0.0f ? -t : t;
+    n.y += n.y >= 0.0f ? -t : t;
+    return glm::normalize(n);
+}
+
+template<typename T>
+void GradientVolume::buildTyped(const VoxelAccessor<T>& volume, glm::vec3 voxelSize)
+{
+    const glm::vec3 scale = 0.5f / voxelSize;
+    const int width = dims[0];
+
+    // Magnitudes are stored relative to the largest one, so the volume is differentiated twice: once for the
+    // maximum, once to pack. That is cheaper than keeping three floats per voxel around.
+    std::vector<float> sliceMax(dims[2], 0.0f);
+    parallelFor(0, dims[2], [&](int zBegin, int zEnd) {
+        RowGradient row(width);
+        for (int z = zBegin; z < zEnd; z++) {
+            float highest = 0.0f;
+            for (int y = 0; y < dims[1]; y++) {
+                row.compute(volume, y, z, scale);
+                for (int x = 0; x < width; x++) {
+                    highest = std::max(highest, row.gx[x] * row.gx[x] + row.gy[x] * row.gy[x] + row.gz[x] * row.gz[x]);
+                }
+            }
+            sliceMax[z] = highest;
+        }
+    });
+    maxMagnitude = std::sqrt(*std::max_element(sliceMax.begin(), sliceMax.end()));
+    const float magnitudeScale = maxMagnitude > 0.0f ? 1.0f / maxMagnitude : 0.0f;
+
+    parallelFor(0, dims[2], [&](int zBegin, int zEnd) {
+        RowGradient row(width);
+        for (int z = zBegin; z < zEnd; z++) {
+            for (int y = 0; y < dims[1]; y++) {
+                row.compute(volume, y, z, scale);
+                uint32_t* out = texels.data() + (size_t(z) * dims[1] + y) * width;
+                for (int x = 0; x < width; x++) {
+                    out[x] = pack(glm::vec3(row.gx[x], row.gy[x], row.gz[x]), magnitudeScale);
+                }
+            }
+        }
+    });
+}
+
+void GradientVolume::build(const void* volume, VoxelType type, const VoxelLayout& layout, glm::vec3 spacing)
+{
+    TraceScope scope("Build gradients");
+    for (int axis = 0; axis < 3; axis++) {
+        dims[axis] = layout.getDims()[axis];
+    }
+    texels.assign(size_t(dims[0]) * dims[1] * dims[2], 0);
+
+    // World space voxel size as in GLFWindow: the finest axis is one unit long
+    float minSpacing = std::min(spacing.x, std::min(spacing.y, spacing.z));
+    glm::vec3 voxelSize = spacing / minSpacing;
+
+    dispatchVoxelType(type, [&](auto zero) {
+        buildTyped(VoxelAccessor<decltype(zero)>(volume, layout), voxelSize);
+    });
+}
+
+void GradientVolume::clear()
+{
+    texels.clear();
+    texels.shrink_to_fit();
+}
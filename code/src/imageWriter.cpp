@@ -0,0 +1,118 @@
+#include "imageWriter.h"
+#include <fstream>
+#include <vector>
+#include <algorithm>
+#include <cstdint>
+
+bool writePPM(const std::string& fileName, int width, int height, const unsigned char* rgba)
+{
+    std::ofstream ofs(fileName, std::ios::binary);
+    if (!ofs) return false;
+
+    ofs << "P6\n" << width << " " << height << "\n255\n";
+    std::vector<unsigned char> row(size_t(width) * 3);
+    for (int y = height - 1; y >= 0; y--) {
+        const unsigned char* src = rgba + size_t(y) * width * 4;
+        for (int x = 0; x < width; x++) {
+            row[x * 3 + 0] = src[x * 4 + 0];
+            row[x * 3 + 1] = src[x * 4 + 1];
+            row[x * 3 + 2] = src[x * 4 + 2];
+        }
+        ofs.write(reinterpret_cast<const char*>(row.data()), row.size());
+    }
+    return bool(ofs);
+}
+
+static uint32_t crc32(uint32_t crc, const unsigned char* data, size_t length)
+{
+    static uint32_t table[256];
+    static bool tableReady = false;
+    if (!tableReady) {
+        for (uint32_t i = 0; i < 256; i++) {
+            uint32_t c = i;
+            for (int k = 0; k < 8; k++) c = (c & 1) ? 0xEDB88320u ^ (c >> 1) : c >> 1;
+            table[i] = c;
+        }
+        tableReady = true;
+    }
+
+    crc = ~crc;
+    for (size_t i = 0; i < length; i++) crc = table[(crc ^ data[i]) & 0xFF] ^ (crc >> 8);
+    return ~crc;
+}
+
+static void putBigEndian(std::vector<unsigned char>& out, uint32_t value)
+{
+    out.push_back((value >> 24) & 0xFF);
+    out.push_back((value >> 16) & 0xFF);
+    out.push_back((value >> 8) & 0xFF);
+    out.push_back(value & 0xFF);
+}
+
+static void writeChunk(std::ofstream& ofs, const char* type, const std::vector<unsigned char>& data)
+{
+    std::vector<unsigned char> chunk;
+    putBigEndian(chunk, uint32_t(data.size()));
+    chunk.insert(chunk.end(), type, type + 4);
+    chunk.insert(chunk.end(), data.begin(), data.end());
+    putBigEndian(chunk, crc32(0, chunk.data() + 4, chunk.size() - 4));
+    ofs.write(reinterpret_cast<const char*>(chunk.data()), chunk.size());
+}
+
+bool writePNG(const std::string& fileName, int width, int height, const unsigned char* rgba)
+{
+    std::ofstream ofs(fileName, std::ios::binary);
+    if (!ofs) return false;
+
+    const unsigned char signature[8] = { 0x89, 'P', 'N', 'G', '\r', '\n', 0x1A, '\n' };
+    ofs.write(reinterpret_cast<const char*>(signature), 8);
+
+    std::vector<unsigned char> header;
+    putBigEndian(header, uint32_t(width));
+    putBigEndian(header, uint32_t(height));
+    header.insert(header.end(), { 8, 6, 0, 0, 0 });      // 8 bit RGBA, deflate, no filter, no interlace
+    writeChunk(ofs, "IHDR", header);
+
+    // Filtered scanlines: a 0 (none) filter byte followed by the top-down row
+    size_t rowBytes = size_t(width) * 4;
+    std::vector<unsigned char> raw;
+    raw.reserve((rowBytes + 1) * height);
+    for (int y = height - 1; y >= 0; y--) {
+        raw.push_back(0);
+        raw.insert(raw.end(), rgba + y * rowBytes, rgba + (y + 1) * rowBytes);
+    }
+
+    // zlib stream made of stored blocks of at most 65535 bytes
+    std::vector<unsigned char> zlib = { 0x78, 0x01 };
+    uint32_t adlerA = 1, adlerB = 0;
+    for (size_t offset = 0; ; ) {
+        size_t blockSize = std::min<size_t>(65535, raw.size() - offset);
+        bool last = offset + blockSize == raw.size();
+        zlib.push_back(last ? 1 : 0);
+        zlib.push_back(blockSize & 0xFF);
+        zlib.push_back((blockSize >> 8) & 0xFF);
+        zlib.push_back(~blockSize & 0xFF);
+        zlib.push_back((~blockSize >> 8) & 0xFF);
+        zlib.insert(zlib.end(), raw.begin() + offset, raw.begin() + offset + blockSize);
+        for (size_t i = offset; i < offset + blockSize; i++) {
+            adlerA = (adlerA + raw[i]) % 65521;
+            adlerB = (adlerB + adlerA) % 65521;
+        }
+        offset += blockSize;
+        if (last) break;
+    }
+    putBigEndian(zlib, (adlerB << 16) | adlerA);
+    writeChunk(ofs, "IDAT", zlib);
+
+    writeChunk(ofs, "IEND", {});
+    return bool(ofs);
+}
+
+bool writeImage(const std::string& fileName, int width, int height, const unsigned char* rgba)
+{
+    size_t dot = fileName.find_last_of('.');
+    if (dot != std::string::npos && fileName.substr(dot) == ".ppm") {
+        return writePPM(fileName, width, height, rgba);
+    }
+    return writePNG(fileName, width, height, rgba);
+}
\ No newline at end of file
@@ -5,6 +5,11 @@ int main(int argc, char** argv)
 
     Application app(argc, argv);
 
+    if (app.isHeadless())
+    {
+        return app.runBatch() ? 0 : 1;
+    }
+
     while (app.run())
     {
 
@@ -0,0 +1,101 @@
+#include "mappedFile.h"
+#include <cstdint>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+bool MappedFile::fileSize(const std::string& path, size_t& size)
+{
+#ifdef _WIN32
+    WIN32_FILE_ATTRIBUTE_DATA info;
+    if (!GetFileAttributesExA(path.c_str(), GetFileExInfoStandard, &info)) return false;
+    size = (size_t(info.nFileSizeHigh) << 32) | size_t(info.nFileSizeLow);
+#else
+    struct stat st;
+    if (stat(path.c_str(), &st) != 0) return false;
+    size = size_t(st.st_size);
+#endif
+    return true;
+}
+
+bool MappedFile::open(const std::string& path, size_t offset, size_t len, bool writable)
+{
+    close();
+
+    size_t totalSize = 0;
+    if (!fileSize(path, totalSize) || offset >= totalSize) return false;
+    if (len == 0) len = totalSize - offset;
+    if (offset + len > totalSize) return false;
+
+#ifdef _WIN32
+    SYSTEM_INFO sysInfo;
+    GetSystemInfo(&sysInfo);
+    size_t alignedOffset = offset - offset % sysInfo.dwAllocationGranularity;
+
+    HANDLE file = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+    if (file == INVALID_HANDLE_VALUE) return false;
+    HANDLE mapping = CreateFileMappingA(file, NULL, writable ? PAGE_WRITECOPY : PAGE_READONLY, 0, 0, NULL);
+    if (mapping == NULL) {
+        CloseHandle(file);
+        return false;
+    }
+    mappedLength = len + (offset - alignedOffset);
+    mappedBase = MapViewOfFile(mapping, writable ? FILE_MAP_COPY : FILE_MAP_READ, DWORD(uint64_t(alignedOffset) >> 32), DWORD(alignedOffset & 0xFFFFFFFF), mappedLength);
+    if (mappedBase == NULL) {
+        CloseHandle(mapping);
+        CloseHandle(file);
+        mappedLength = 0;
+        return false;
+    }
+    fileHandle = file;
+    mappingHandle = mapping;
+#else
+    size_t pageSize = size_t(sysconf(_SC_PAGESIZE));
+    size_t alignedOffset = offset - offset % pageSize;
+
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return false;
+    mappedLength = len + (offset - alignedOffset);
+    void* base = mmap(NULL, mappedLength, writable ? PROT_READ | PROT_WRITE : PROT_READ, MAP_PRIVATE, fd, off_t(alignedOffset));
+    ::close(fd);                                // The mapping keeps its own reference to the file
+    if (base == MAP_FAILED) {
+        mappedLength = 0;
+        return false;
+    }
+    madvise(base, mappedLength, MADV_SEQUENTIAL);     // Volumes are consumed front to back by the upload
+    mappedBase = base;
+#endif
+
+    data = static_cast<unsigned char*>(mappedBase) + (offset - alignedOffset);
+    length = len;
+    copyOnWrite = writable;
+    return true;
+}
+
+void MappedFile::close()
+{
+    if (mappedBase == nullptr) return;
+
+#ifdef _WIN32
+    UnmapViewOfFile(mappedBase);
+    CloseHandle((HANDLE)mappingHandle);
+    CloseHandle((HANDLE)fileHandle);
+    mappingHandle = fileHandle = nullptr;
+#else
+    munmap(mappedBase, mappedLength);
+#endif
+
+    mappedBase = nullptr;
+    mappedLength = 0;
+    data = nullptr;
+    length = 0;
+    copyOnWrite = false;
+}
\ No newline at end of file
@@ -0,0 +1,59 @@
+#include "microBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <fstream>
+#include <iostream>
+
+void MicroBenchmarkRunner::run(const std::string& name, double work, const char* unit, const std::function<void()>& body,
+    const std::function<void()>& setup)
+{
+    if (!matches(name)) return;
+
+    using Clock = std::chrono::steady_clock;
+    Result result;
+    result.name = name;
+    result.unit = unit;
+    result.minMs = 1e30;
+    double total = 0.0;
+    while (result.iterations < minIterations || total < minSeconds) {
+        if (setup) setup();
+        auto start = Clock::now();
+        body();
+        double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+        total += seconds;
+        result.minMs = std::min(result.minMs, seconds * 1000.0);
+        result.iterations++;
+    }
+    result.meanMs = total * 1000.0 / result.iterations;
+    result.throughput = total > 0.0 ? work * result.iterations / total : 0.0;
+
+    printf("%-36s %12.3f ms %12.3f ms %8d %12.1f %s\n", name.c_str(), result.meanMs, result.minMs, result.iterations, result.throughput, unit);
+    fflush(stdout);
+    results.push_back(result);
+}
+
+bool MicroBenchmarkRunner::writeJson(const std::string& path) const
+{
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    out << "{\n  \"benchmarks\": [\n";
+    char line[512];
+    for (size_t i = 0; i < results.size(); i++) {
+        const Result& r = results[i];
+        snprintf(line, sizeof(line), "    {\"name\": \"%s\", \"iterations\": %d, \"meanMs\": %.4f, \"minMs\": %.4f, \"throughput\": %.3f, \"unit\": \"%s\"}%s\n",
+            r.name.c_str(), r.iterations, r.meanMs, r.minMs, r.throughput, r.unit.c_str(), i + 1 < results.size() ? "," : "");
+        out << line;
+    }
+    out << "  ]\n}\n";
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write " << path << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << path << std::endl;
+    return true;
+}
@@ -0,0 +1,7 @@
+#include "pathBenchmark.h"
+
+int main(int argc, char** argv)
+{
+    PathBenchmark benchmark(argc, argv);
+    return benchmark.run() ? 0 : 1;
+}
@@ -0,0 +1,347 @@
+#include "pathBenchmark.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+namespace {
+
+double percentile(const std::vector<double>& sorted, double p)
+{
+    if (sorted.empty()) return 0.0;
+    return sorted[std::min(size_t(p * sorted.size()), sorted.size() - 1)];
+}
+
+// Reads `"key": number` from one line of a report written by writeReport
+bool readNumber(const std::string& line, const char* key, double& value)
+{
+    std::string quoted = std::string("\"") + key + "\":";
+    size_t position = line.find(quoted);
+    if (position == std::string::npos) return false;
+    std::istringstream number(line.substr(position + quoted.size()));
+    return bool(number >> value);
+}
+
+}
+
+PathBenchmark::PathBenchmark(int argc, char** argv)
+{
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "-volumePath") == 0 && i + 1 < argc) {
+            volumePath = argv[i + 1];
+        }
+        if (strcmp(argv[i], "-dims") == 0 && i + 3 < argc) {
+            volReader.setVolumeDimensions(atoi(argv[i + 1]), atoi(argv[i + 2]), atoi(argv[i + 3]));
+        }
+        if (strcmp(argv[i], "-type") == 0 && i + 1 < argc) {
+            VoxelType type = voxelTypeFromName(argv[i + 1]);
+            if (type == VoxelType::Unknown) {
+                std::cout << "Unknown voxel type " << argv[i + 1] << ", expected uint8, uint16, int16 or float32" << std::endl;
+                exit(EXIT_FAILURE);
+            }
+            volReader.setVoxelType(type);
+        }
+        if (strcmp(argv[i], "-tf") == 0 && i + 1 < argc) {
+            tfPath = argv[i + 1];
+        }
+        if (strcmp(argv[i], "-out") == 0 && i + 1 < argc) {
+            outputPath = argv[i + 1];
+        }
+        if (strcmp(argv[i], "-baseline") == 0 && i + 1 < argc) {
+            baselinePath = argv[i + 1];
+        }
+        if (strcmp(argv[i], "-tolerance") == 0 && i + 1 < argc) {
+            tolerance = float(atof(argv[i + 1]));
+        }
+        if (strcmp(argv[i], "-sizes") == 0 && i + 1 < argc) {
+            // "1280x720,1920x1080"
+            sizes.clear();
+            std::stringstream list(argv[i + 1]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                int width = 0, height = 0;
+                if (sscanf(item.c_str(), "%dx%d", &width, &height) != 2 || width <= 0 || height <= 0) {
+                    std::cout << "Invalid size " << item << ", expected WIDTHxHEIGHT" << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                sizes.push_back({ width, height });
+            }
+        }
+        if (strcmp(argv[i], "-steps") == 0 && i + 1 < argc) {
+            stepSizes.clear();
+            std::stringstream list(argv[i + 1]);
+            std::string item;
+            while (std::getline(list, item, ',')) {
+                float step = float(atof(item.c_str()));
+                if (step <= 0.0f) {
+                    std::cout << "Invalid step size " << item << std::endl;
+                    exit(EXIT_FAILURE);
+                }
+                stepSizes.push_back(step);
+            }
+        }
+        if (strcmp(argv[i], "-frames") == 0 && i + 1 < argc) {
+            frames = std::max(atoi(argv[i + 1]), 1);
+        }
+        if (strcmp(argv[i], "-warmup") == 0 && i + 1 < argc) {
+            warmupFrames = std::max(atoi(argv[i + 1]), 0);
+        }
+        if (strcmp(argv[i], "-adaptive") == 0) {
+            adaptiveStepping = true;
+        }
+        if (strcmp(argv[i], "-preIntegration") == 0) {
+            preIntegration = true;
+        }
+    }
+
+    if (volumePath.empty() || sizes.empty() || stepSizes.empty()) {
+        std::cout << "Usage: VolumeRenderingPathBench -volumePath FILE [-dims X Y Z] [-type T] [-tf FILE.dat] [-sizes WxH,...] [-steps S,...]"
+            " [-frames N] [-warmup N] [-adaptive] [-preIntegration] [-out report.json] [-baseline old.json [-tolerance 0.1]]" << std::endl;
+        exit(EXIT_FAILURE);
+    }
+}
+
+PathBenchmark::~PathBenchmark()
+{
+    if (w_handle) w_handle->cleanup();
+}
+
+CameraPose PathBenchmark::pathPose(int frame, float distance) const
+{
+    // One orbit around the volume with the camera slightly above and below the equator, zooming in and out twice
+    const float pi = 3.14159265f;
+    float t = float(frame) / float(frames);
+    float angle = 2.0f * pi * t;
+    float elevation = 0.35f * std::sin(angle);
+    float zoom = 1.0f - 0.35f * std::sin(4.0f * pi * t);
+
+    CameraPose pose;
+    float d = distance * zoom;
+    pose.position = glm::vec3(d * std::cos(elevation) * std::sin(angle), d * std::sin(elevation), d * std::cos(elevation) * std::cos(angle));
+    return pose;
+}
+
+double PathBenchmark::nominalSamples(float stepSize) const
+{
+    // The bounding box of CreateBoundingBox in world space
+    glm::vec3 size = w_handle->GetVolumeSize();
+    glm::vec3 boxMin = glm::vec3(w_handle->modelT * glm::vec4(0.0f, 0.0f, -size.z + 1.0f, 1.0f));
+    glm::vec3 boxMax = glm::vec3(w_handle->modelT * glm::vec4(size.x - 1.0f, size.y - 1.0f, 0.0f, 1.0f));
+    glm::mat4 inverseViewProjection = glm::inverse(w_handle->projectionT * w_handle->viewT);
+
+    // Every 4th pixel in both directions is plenty for an estimate
+    const int stride = 4;
+    const int width = w_handle->GetWidth(), height = w_handle->GetHeight();
+    double samples = 0.0;
+    for (int y = stride / 2; y < height; y += stride) {
+        for (int x = stride / 2; x < width; x += stride) {
+            glm::vec2 ndc(2.0f * (x + 0.5f) / width - 1.0f, 2.0f * (y + 0.5f) / height - 1.0f);
+            glm::vec4 nearPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, -1.0f, 1.0f);
+            glm::vec4 farPoint = inverseViewProjection * glm::vec4(ndc.x, ndc.y, 1.0f, 1.0f);
+            glm::vec3 origin = glm::vec3(nearPoint) / nearPoint.w;
+            glm::vec3 direction = glm::normalize(glm::vec3(farPoint) / farPoint.w - origin);
+
+            glm::vec3 t0 = (boxMin - origin) / direction;
+            glm::vec3 t1 = (boxMax - origin) / direction;
+            glm::vec3 tNear = glm::min(t0, t1), tFar = glm::max(t0, t1);
+            float enter = std::max(std::max(tNear.x, tNear.y), std::max(tNear.z, 0.0f));
+            float exit = std::min(tFar.x, std::min(tFar.y, tFar.z));
+            if (exit > enter) samples += std::ceil((exit - enter) / stepSize);
+        }
+    }
+    return samples * stride * stride;
+}
+
+bool PathBenchmark::runConfiguration(int width, int height, float stepSize, PathBenchmarkResult& result)
+{
+    w_handle->ResizeWindow(width, height);
+    w_handle->SetStepSize(stepSize);
+
+    const glm::vec3 size = w_handle->GetVolumeSize();
+    const float distance = 0.9f * glm::length(size);     // Outside the volume also when zoomed in
+
+    const bool gpuTimers = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+    GLuint queries[2] = { 0, 0 };
+    if (gpuTimers) glGenQueries(2, queries);
+
+    using Clock = std::chrono::steady_clock;
+    std::vector<double> cpuTimes, gpuTimes;
+    double samples = 0.0, seconds = 0.0;
+    bool success = true;
+    for (int frame = -warmupFrames; frame < frames; frame++) {
+        CameraPose pose = pathPose(std::max(frame, 0), distance);
+        w_handle->SetCamera(pose.position, pose.at, pose.up);
+
+        // Nothing of the previous frame may still be running when the clock starts
+        glFinish();
+        auto start = Clock::now();
+        if (gpuTimers) glQueryCounter(queries[0], GL_TIMESTAMP);
+        if (!w_handle->RenderFrame()) {
+            std::cerr << "Rendering frame " << frame << " at " << width << "x" << height << " failed" << std::endl;
+            success = false;
+            break;
+        }
+        if (gpuTimers) glQueryCounter(queries[1], GL_TIMESTAMP);
+        glFinish();
+        double elapsed = std::chrono::duration<double>(Clock::now() - start).count();
+        if (frame < 0) continue;
+
+        cpuTimes.push_back(elapsed * 1000.0);
+        seconds += elapsed;
+        if (gpuTimers) {
+            GLuint64 begin = 0, end = 0;
+            glGetQueryObjectui64v(queries[0], GL_QUERY_RESULT, &begin);
+            glGetQueryObjectui64v(queries[1], GL_QUERY_RESULT, &end);
+            gpuTimes.push_back(double(end - begin) * 1e-6);
+        }
+        samples += nominalSamples(stepSize);
+    }
+    if (gpuTimers) glDeleteQueries(2, queries);
+    if (!success || cpuTimes.empty()) return false;
+
+    result.width = width;
+    result.height = height;
+    result.stepSize = stepSize;
+    result.frames = int(cpuTimes.size());
+    double total = 0.0;
+    for (double time : cpuTimes) total += time;
+    std::sort(cpuTimes.begin(), cpuTimes.end());
+    std::sort(gpuTimes.begin(), gpuTimes.end());
+    result.minMs = cpuTimes.front();
+    result.meanMs = total / cpuTimes.size();
+    result.medianMs = percentile(cpuTimes, 0.50);
+    result.p95Ms = percentile(cpuTimes, 0.95);
+    result.p99Ms = percentile(cpuTimes, 0.99);
+    result.maxMs = cpuTimes.back();
+    result.gpuMedianMs = percentile(gpuTimes, 0.50);
+    result.gpuP95Ms = percentile(gpuTimes, 0.95);
+    result.nominalSamples = samples / result.frames;
+    result.samplesPerSecond = seconds > 0.0 ? samples / seconds : 0.0;
+    return true;
+}
+
+bool PathBenchmark::writeReport(const std::vector<PathBenchmarkResult>& results) const
+{
+    std::ofstream out(outputPath);
+    if (!out) {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        return false;
+    }
+
+    // One configuration per line, which is all compareWithBaseline needs to read it back
+    auto escaped = [](std::string text) {
+        std::string result;
+        for (char c : text) {
+            if (c == '"' || c == '\\') result += '\\';
+            result += c;
+        }
+        return result;
+    };
+    const char* renderer = reinterpret_cast<const char*>(glGetString(GL_RENDERER));
+    out << "{\n";
+    out << "  \"volume\": \"" << escaped(volumePath) << "\",\n";
+    out << "  \"transferFunction\": \"" << escaped(tfPath) << "\",\n";
+    out << "  \"renderer\": \"" << escaped(renderer ? renderer : "") << "\",\n";
+    out << "  \"adaptiveStepping\": " << (adaptiveStepping ? "true" : "false") << ",\n";
+    out << "  \"preIntegration\": " << (preIntegration ? "true" : "false") << ",\n";
+    out << "  \"configurations\": [\n";
+    out << std::fixed << std::setprecision(4);
+    for (size_t i = 0; i < results.size(); i++) {
+        const PathBenchmarkResult& r = results[i];
+        out << "    {\"width\": " << r.width << ", \"height\": " << r.height << ", \"stepSize\": " << r.stepSize << ", \"frames\": " << r.frames
+            << ", \"minMs\": " << r.minMs << ", \"meanMs\": " << r.meanMs << ", \"medianMs\": " << r.medianMs << ", \"p95Ms\": " << r.p95Ms
+            << ", \"p99Ms\": " << r.p99Ms << ", \"maxMs\": " << r.maxMs << ", \"gpuMedianMs\": " << r.gpuMedianMs << ", \"gpuP95Ms\": " << r.gpuP95Ms
+            << std::setprecision(0) << ", \"nominalSamples\": " << r.nominalSamples << ", \"samplesPerSecond\": " << r.samplesPerSecond << std::setprecision(4)
+            << "}" << (i + 1 < results.size() ? "," : "") << "\n";
+    }
+    out << "  ]\n}\n";
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write " << outputPath << std::endl;
+        return false;
+    }
+    std::cout << "Wrote " << outputPath << std::endl;
+    return true;
+}
+
+bool PathBenchmark::compareWithBaseline(const std::vector<PathBenchmarkResult>& results) const
+{
+    std::ifstream in(baselinePath);
+    if (!in) {
+        std::cerr << "Failed to open baseline " << baselinePath << std::endl;
+        return false;
+    }
+
+    struct Baseline { double width, height, stepSize, medianMs, p95Ms; };
+    std::vector<Baseline> baselines;
+    std::string line;
+    while (std::getline(in, line)) {
+        Baseline b;
+        if (readNumber(line, "width", b.width) && readNumber(line, "height", b.height) && readNumber(line, "stepSize", b.stepSize)
+            && readNumber(line, "medianMs", b.medianMs) && readNumber(line, "p95Ms", b.p95Ms)) {
+            baselines.push_back(b);
+        }
+    }
+
+    bool passed = true;
+    std::cout << "Compared with " << baselinePath << " (tolerance " << tolerance * 100.0f << "%):" << std::endl;
+    for (const PathBenchmarkResult& r : results) {
+        auto match = std::find_if(baselines.begin(), baselines.end(), [&](const Baseline& b) {
+            return int(b.width) == r.width && int(b.height) == r.height && std::abs(b.stepSize - r.stepSize) < 1e-3;
+        });
+        std::cout << "  " << r.width << "x" << r.height << " step " << r.stepSize << ": ";
+        if (match == baselines.end()) {
+            std::cout << "not in the baseline" << std::endl;
+            continue;
+        }
+        double medianChange = r.medianMs / std::max(match->medianMs, 1e-6) - 1.0;
+        double p95Change = r.p95Ms / std::max(match->p95Ms, 1e-6) - 1.0;
+        bool regressed = medianChange > tolerance || p95Change > tolerance;
+        passed &= !regressed;
+        std::cout << std::fixed << std::setprecision(3) << "median " << match->medianMs << " -> " << r.medianMs << " ms (" << std::showpos
+            << std::setprecision(1) << medianChange * 100.0 << "%" << std::noshowpos << std::setprecision(3) << "), p95 " << match->p95Ms << " -> "
+            << r.p95Ms << " ms (" << std::showpos << std::setprecision(1) << p95Change * 100.0 << "%" << std::noshowpos << ")"
+            << (regressed ? "  REGRESSION" : "") << std::endl;
+    }
+    return passed;
+}
+
+bool PathBenchmark::run()
+{
+    if (!volReader.readVolume(volumePath)) {
+        std::cout << "Volume does not exist" << std::endl;
+        return false;
+    }
+    glm::vec2 valueRange;
+    volReader.getValueRange(valueRange.x, valueRange.y);
+    brickGrid.build(volReader.getCPUVolume(), volReader.getVoxelType(), volReader.getCPULayout());
+
+    // The same setup as a headless batch
+    w_handle = new GLFCameraWindow(sizes[0].first, sizes[0].second, WINDOWNAME, true);
+    w_handle->preIntegration = preIntegration;
+    w_handle->adaptiveStepping = adaptiveStepping;
+    w_handle->Create3DVolumeTexture(volReader.getVolume(), volReader.getVoxelType(), volReader.getVolumeDimensionX(), volReader.getVolumeDimensionY(),
+        volReader.getVolumeDimensionZ(), volReader.getVolumeSpacing(), valueRange);
+    w_handle->SetBrickGrid(&brickGrid);
+    if (!w_handle->LoadTransferFunction(tfPath)) {
+        return false;
+    }
+    w_handle->Create1DTransferFunction();
+
+    std::vector<PathBenchmarkResult> results;
+    for (const auto& size : sizes) {
+        for (float stepSize : stepSizes) {
+            PathBenchmarkResult result;
+            if (!runConfiguration(size.first, size.second, stepSize, result)) return false;
+            std::cout << std::fixed << std::setprecision(3) << size.first << "x" << size.second << " step " << stepSize << ": median "
+                << result.medianMs << " ms, p95 " << result.p95Ms << " ms, p99 " << result.p99Ms << " ms, "
+                << std::setprecision(1) << result.samplesPerSecond * 1e-6 << " M samples/s" << std::endl;
+            results.push_back(result);
+        }
+    }
+
+    if (!writeReport(results)) return false;
+    return baselinePath.empty() || compareWithBaseline(results);
+}
@@ -0,0 +1,167 @@
+#include "profiler.h"
+#include "trace.h"
+#include "imgui.h"
+#include <algorithm>
+
+const char* profileStageName(int stage)
+{
+    static const char* names[ProfileStageCount] = {
+        "Frame", "ImGui build", "Uploads", "SetUniforms", "Volume draw", "ImGui render", "Swap", "Transfer function"
+    };
+    return stage >= 0 && stage < ProfileStageCount ? names[stage] : "Unknown";
+}
+
+void Profiler::History::push(float value)
+{
+    values[next] = value;
+    next = (next + 1) % historySize;
+    count = std::min(count + 1, historySize);
+}
+
+void Profiler::init()
+{
+    if (initialized) return;
+    gpuTimers = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+    if (gpuTimers) {
+        for (Stage& stage : stages) {
+            glGenQueries(queryLatency * 2, &stage.queries[0][0]);
+        }
+    }
+    initialized = true;
+}
+
+void Profiler::release()
+{
+    if (initialized && gpuTimers) {
+        for (Stage& stage : stages) {
+            glDeleteQueries(queryLatency * 2, &stage.queries[0][0]);
+        }
+    }
+    initialized = false;
+}
+
+void Profiler::begin(ProfileStage index, bool gpu)
+{
+    Stage& stage = stages[index];
+    stage.gpuTimed = gpu && initialized && gpuTimers;
+    if (stage.gpuTimed) {
+        // Every slot of the ring still in flight: wait for the oldest rather than dropping its result
+        if (stage.pending[stage.queryIndex]) readQuery(stage, stage.queryIndex);
+        glQueryCounter(stage.queries[stage.queryIndex][0], GL_TIMESTAMP);
+    }
+    stage.cpuStart = std::chrono::steady_clock::now();
+}
+
+void Profiler::end(ProfileStage index)
+{
+    Stage& stage = stages[index];
+    auto cpuEnd = std::chrono::steady_clock::now();
+    stage.cpu.push(std::chrono::duration<float, std::milli>(cpuEnd - stage.cpuStart).count());
+    trace::record(profileStageName(index), stage.cpuStart, cpuEnd);
+    if (stage.gpuTimed) {
+        glQueryCounter(stage.queries[stage.queryIndex][1], GL_TIMESTAMP);
+        stage.pending[stage.queryIndex] = true;
+        stage.queryIndex = (stage.queryIndex + 1) % queryLatency;
+        stage.gpuTimed = false;
+    }
+}
+
+void Profiler::readQuery(Stage& stage, int slot)
+{
+    GLuint64 start = 0, finish = 0;
+    glGetQueryObjectui64v(stage.queries[slot][0], GL_QUERY_RESULT, &start);
+    glGetQueryObjectui64v(stage.queries[slot][1], GL_QUERY_RESULT, &finish);
+    stage.gpu.push(float(double(finish - start) * 1e-6));
+    stage.pending[slot] = false;
+}
+
+void Profiler::collect()
+{
+    if (!initialized || !gpuTimers) return;
+    for (Stage& stage : stages) {
+        // Oldest first, so the history stays in submission order
+        for (int i = 0; i < queryLatency; i++) {
+            int slot = (stage.queryIndex + i) % queryLatency;
+            if (!stage.pending[slot]) continue;
+            GLint available = 0;
+            glGetQueryObjectiv(stage.queries[slot][1], GL_QUERY_RESULT_AVAILABLE, &available);
+            if (!available) break;
+            readQuery(stage, slot);
+        }
+    }
+}
+
+void Profiler::recordEvent(const std::string& name, float ms)
+{
+    std::lock_guard<std::mutex> lock(eventMutex);
+    events.emplace_back(name, ms);
+}
+
+Profiler::Stats Profiler::getStats(ProfileStage index, bool gpu) const
+{
+    const History& history = gpu ? stages[index].gpu : stages[index].cpu;
+    Stats stats;
+    stats.count = history.count;
+    if (history.count == 0) return stats;
+
+    std::vector<float> sorted(history.values, history.values + history.count);
+    std::sort(sorted.begin(), sorted.end());
+    auto percentile = [&](float p) { return sorted[std::min(int(p * history.count), history.count - 1)]; };
+    stats.last = history.values[(history.next + historySize - 1) % historySize];
+    for (float value : sorted) stats.mean += value;
+    stats.mean /= float(history.count);
+    stats.p50 = percentile(0.50f);
+    stats.p95 = percentile(0.95f);
+    stats.p99 = percentile(0.99f);
+    stats.max = sorted.back();
+    return stats;
+}
+
+void Profiler::drawGui()
+{
+    if (!ImGui::CollapsingHeader("Profiler")) return;
+
+    ImGui::Text("Last %d samples, ms%s", historySize, gpuTimers ? "" : " (no GPU timer queries)");
+    ImGui::Columns(6, "profilerStages", false);
+    const char* headers[] = { "Stage", "CPU p50", "CPU p95", "CPU p99", "GPU p50", "GPU p95" };
+    for (const char* header : headers) {
+        ImGui::TextDisabled("%s", header);
+        ImGui::NextColumn();
+    }
+    for (int i = 0; i < ProfileStageCount; i++) {
+        Stats cpu = getStats(ProfileStage(i), false), gpu = getStats(ProfileStage(i), true);
+        ImGui::Text("%s", profileStageName(i));
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", cpu.p50);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", cpu.p95);
+        ImGui::NextColumn();
+        ImGui::Text("%.3f", cpu.p99);
+        ImGui::NextColumn();
+        if (gpu.count > 0) ImGui::Text("%.3f", gpu.p50);
+        else ImGui::TextDisabled("-");
+        ImGui::NextColumn();
+        if (gpu.count > 0) ImGui::Text("%.3f", gpu.p95);
+        else ImGui::TextDisabled("-");
+        ImGui::NextColumn();
+    }
+    ImGui::Columns(1);
+
+    // Timeline of one stage, oldest sample on the left
+    static int selected = ProfileVolumeDraw;
+    ImGui::Combo("Stage", &selected, [](void*, int index, const char** name) { *name = profileStageName(index); return true; }, nullptr, ProfileStageCount);
+    for (int gpu = 0; gpu < 2; gpu++) {
+        const History& history = gpu ? stages[selected].gpu : stages[selected].cpu;
+        if (history.count == 0) continue;
+        Stats stats = getStats(ProfileStage(selected), gpu != 0);
+        char overlay[64];
+        snprintf(overlay, sizeof(overlay), "%s last %.3f max %.3f", gpu ? "GPU" : "CPU", stats.last, stats.max);
+        int offset = history.count < historySize ? 0 : history.next;
+        ImGui::PlotHistogram(gpu ? "##gpu" : "##cpu", history.values, history.count, offset, overlay, 0.0f, std::max(stats.p99 * 1.25f, 1e-3f), ImVec2(-1, 60));
+    }
+
+    std::lock_guard<std::mutex> lock(eventMutex);
+    for (const auto& event : events) {
+        ImGui::Text("%s: %.1f ms", event.first.c_str(), event.second);
+    }
+}
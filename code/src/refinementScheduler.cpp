@@ -0,0 +1,105 @@
+#include "refinementScheduler.h"
+#include <algorithm>
+#include <cmath>
+
+void RefinementScheduler::invalidate(double now)
+{
+    viewChanged = true;
+    lastChangeTime = now;
+    displayedLevel = -1;
+    workLevel = -1;
+    workRow = 0;
+}
+
+void RefinementScheduler::makePass(int level, int windowWidth, int windowHeight, RefinementPass& pass) const
+{
+    pass.level = level;
+    pass.resolutionScale = levels[level].resolutionScale;
+    pass.stepScale = levels[level].stepScale;
+    pass.width = std::max(1, int(std::lround(windowWidth * pass.resolutionScale)));
+    pass.height = std::max(1, int(std::lround(windowHeight * pass.resolutionScale)));
+    pass.rowBegin = 0;
+    pass.rowEnd = pass.height;
+    pass.completesLevel = true;
+}
+
+double RefinementScheduler::passUnits(const RefinementPass& pass) const
+{
+    // Ray casting cost scales with the number of rays times the number of samples along each ray
+    return double(pass.width) * (pass.rowEnd - pass.rowBegin) / pass.stepScale;
+}
+
+bool RefinementScheduler::nextPass(double now, int windowWidth, int windowHeight, RefinementPass& pass)
+{
+    int finest = int(levels.size()) - 1;
+
+    if (!enabled) {
+        if (!viewChanged) return false;
+        makePass(finest, windowWidth, windowHeight, pass);
+        return true;
+    }
+
+    if (viewChanged) {
+        // Finest level that fits the interactive budget; the coarsest one until the cost model has data
+        int level = 0;
+        if (msPerUnit > 0.0) {
+            for (int l = finest; l >= 0; l--) {
+                makePass(l, windowWidth, windowHeight, pass);
+                if (passUnits(pass) * msPerUnit <= interactiveBudgetMs) {
+                    level = l;
+                    break;
+                }
+            }
+        }
+        makePass(level, windowWidth, windowHeight, pass);
+        return true;
+    }
+
+    if (displayedLevel >= finest || now - lastChangeTime < settleDelay) return false;
+
+    if (workLevel != displayedLevel + 1) {
+        workLevel = displayedLevel + 1;
+        workRow = 0;
+    }
+    makePass(workLevel, windowWidth, windowHeight, pass);
+
+    int rows = pass.height;
+    if (msPerUnit > 0.0) {
+        double msPerRow = pass.width / pass.stepScale * msPerUnit;
+        rows = std::max(1, int(refinementBudgetMs / msPerRow));
+    }
+    pass.rowBegin = workRow;
+    pass.rowEnd = std::min(pass.height, workRow + rows);
+    pass.completesLevel = pass.rowEnd == pass.height;
+    return true;
+}
+
+void RefinementScheduler::passRendered(const RefinementPass& pass)
+{
+    viewChanged = false;
+    if (pass.completesLevel) {
+        displayedLevel = pass.level;
+        workLevel = -1;
+        workRow = 0;
+    }
+    else {
+        workLevel = pass.level;
+        workRow = pass.rowEnd;
+    }
+}
+
+void RefinementScheduler::passTimed(const RefinementPass& pass, double gpuMs)
+{
+    double units = passUnits(pass);
+    if (units <= 0.0) return;
+
+    double sample = gpuMs / units;
+    msPerUnit = msPerUnit < 0.0 ? sample : 0.7 * msPerUnit + 0.3 * sample;
+}
+
+double RefinementScheduler::timeUntilWork(double now) const
+{
+    if (viewChanged) return 0.0;
+    if (!enabled || displayedLevel >= int(levels.size()) - 1) return -1.0;
+    return std::max(0.0, settleDelay - (now - lastChangeTime));
+}
\ No newline at end of file
@@ -0,0 +1,78 @@
+#include "shaderUniforms.h"
+#include <glm/gtc/type_ptr.hpp>
+#include <algorithm>
+#include <cstring>
+#include <cstdio>
+
+bool ShaderUniforms::resolve(GLuint linkedProgram, const char* const* names, int count, const std::vector<int>& optional)
+{
+    program = linkedProgram;
+    slots.assign(count, Slot());
+
+    bool allFound = true;
+    for (int i = 0; i < count; i++) {
+        slots[i].name = names[i];
+        slots[i].location = glGetUniformLocation(program, names[i]);
+        if (slots[i].location == -1 && std::find(optional.begin(), optional.end(), i) == optional.end()) {
+            fprintf(stderr, "Could not bind location: %s\n", names[i]);
+            allFound = false;
+        }
+    }
+    return allFound;
+}
+
+void ShaderUniforms::invalidate()
+{
+    for (auto& slot : slots) {
+        slot.hasValue = false;
+    }
+}
+
+bool ShaderUniforms::changed(int handle, const float* data, int count)
+{
+    Slot& slot = slots[handle];
+    if (slot.location == -1) return false;
+    if (slot.hasValue && memcmp(slot.value, data, count * sizeof(float)) == 0) return false;
+
+    memcpy(slot.value, data, count * sizeof(float));
+    slot.hasValue = true;
+    uploads++;
+    return true;
+}
+
+void ShaderUniforms::set(int handle, float value)
+{
+    if (changed(handle, &value, 1)) {
+        glUniform1f(slots[handle].location, value);
+    }
+}
+
+void ShaderUniforms::set(int handle, int value)
+{
+    float bits;
+    memcpy(&bits, &value, sizeof(bits));
+    if (changed(handle, &bits, 1)) {
+        glUniform1i(slots[handle].location, value);
+    }
+}
+
+void ShaderUniforms::set(int handle, const glm::vec3& value)
+{
+    if (changed(handle, glm::value_ptr(value), 3)) {
+        glUniform3fv(slots[handle].location, 1, glm::value_ptr(value));
+    }
+}
+
+void ShaderUniforms::set(int handle, const glm::mat4& value)
+{
+    if (changed(handle, glm::value_ptr(value), 16)) {
+        glUniformMatrix4fv(slots[handle].location, 1, GL_FALSE, glm::value_ptr(value));
+    }
+}
+
+int ShaderUniforms::takeUploadCount()
+{
+    int count = uploads;
+    uploads = 0;
+    return count;
+}
\ No newline at end of file
@@ -0,0 +1,170 @@
+#include "tileScheduler.h"
+#include <chrono>
+#include <numeric>
+
+namespace {
+
+// A queue's [head, tail) packed into one word, head in the low half
+inline uint64_t packRange(uint32_t head, uint32_t tail)
+{
+    return uint64_t(tail) << 32 | head;
+}
+
+}
+
+void TileScheduler::plan(int threads)
+{
+    items.clear();
+    stats.splitTiles = 0;
+    const bool history = !tileCost.empty();
+
+    // Split tiles that cost several times a fair share of the frame, down to 8 pixel pieces
+    float total = history ? std::accumulate(tileCost.begin(), tileCost.end(), 0.0f) : 0.0f;
+    float target = total / float(threads * 8);
+    for (int ty = 0; ty < tilesY; ty++) {
+        for (int tx = 0; tx < tilesX; tx++) {
+            int tile = ty * tilesX + tx;
+            int x0 = tx * tileSize, y0 = ty * tileSize;
+            int x1 = std::min(x0 + tileSize, width), y1 = std::min(y0 + tileSize, height);
+            float cost = history ? tileCost[tile] : 1.0f;
+
+            int parts = 1;
+            while (history && cost / (parts * parts) > target && tileSize / (parts * 2) >= 8 && parts < 4) {
+                parts *= 2;
+            }
+            if (parts > 1) stats.splitTiles++;
+
+            int stepX = (x1 - x0 + parts - 1) / parts, stepY = (y1 - y0 + parts - 1) / parts;
+            float area = float((x1 - x0) * (y1 - y0));
+            for (int sy = y0; sy < y1; sy += stepY) {
+                for (int sx = x0; sx < x1; sx += stepX) {
+                    int ex = std::min(sx + stepX, x1), ey = std::min(sy + stepY, y1);
+                    items.push_back(WorkItem{ sx, sy, ex, ey, tile, cost * (ex - sx) * (ey - sy) / area });
+                }
+            }
+        }
+    }
+
+    // Longest processing time first: deal the items, most expensive first, to the least loaded queue
+    std::vector<int> order(items.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(), [&](int a, int b) { return items[a].predictedCost > items[b].predictedCost; });
+
+    std::vector<std::vector<int>> assigned(threads);
+    std::vector<float> load(threads, 0.0f);
+    for (int item : order) {
+        int queue = int(std::min_element(load.begin(), load.end()) - load.begin());
+        assigned[queue].push_back(item);
+        load[queue] += items[item].predictedCost;
+    }
+
+    if (queueCount != threads) {
+        queues.reset(new WorkQueue[threads]);
+        queueCount = threads;
+    }
+    std::vector<WorkItem> grouped;
+    grouped.reserve(items.size());
+    for (int queue = 0; queue < threads; queue++) {
+        uint32_t head = uint32_t(grouped.size());
+        for (int item : assigned[queue]) grouped.push_back(items[item]);
+        queues[queue].range = packRange(head, uint32_t(grouped.size()));
+    }
+    items.swap(grouped);
+    itemCost.assign(items.size(), 0.0f);
+}
+
+bool TileScheduler::pop(int queue, int& item)
+{
+    std::atomic<uint64_t>& range = queues[queue].range;
+    uint64_t current = range.load();
+    for (;;) {
+        uint32_t head = uint32_t(current), tail = uint32_t(current >> 32);
+        if (head >= tail) return false;
+        if (range.compare_exchange_weak(current, packRange(head + 1, tail))) {
+            item = int(head);
+            return true;
+        }
+    }
+}
+
+bool TileScheduler::steal(int thief, int& item)
+{
+    for (int offset = 1; offset < queueCount; offset++) {
+        std::atomic<uint64_t>& range = queues[(thief + offset) % queueCount].range;
+        uint64_t current = range.load();
+        for (;;) {
+            uint32_t head = uint32_t(current), tail = uint32_t(current >> 32);
+            if (head >= tail) break;
+            if (range.compare_exchange_weak(current, packRange(head, tail - 1))) {
+                item = int(tail - 1);
+                return true;
+            }
+        }
+    }
+    return false;
+}
+
+void TileScheduler::run(ThreadPool& pool, int frameWidth, int frameHeight, int size, const std::function<void(int, int, int, int)>& renderTile)
+{
+    if (frameWidth <= 0 || frameHeight <= 0) return;
+    if (frameWidth != width || frameHeight != height || size != tileSize) {
+        width = frameWidth;
+        height = frameHeight;
+        tileSize = size;
+        tilesX = (width + tileSize - 1) / tileSize;
+        tilesY = (height + tileSize - 1) / tileSize;
+        tileCost.clear();
+    }
+
+    using Clock = std::chrono::steady_clock;
+    auto frameStart = Clock::now();
+    const int threads = pool.getThreadCount();
+    plan(threads);
+
+    std::vector<double> busy(threads, 0.0);
+    std::vector<int> steals(threads, 0);
+    pool.run(threads, [&](int queue, int thread) {
+        int item;
+        for (;;) {
+            bool own = pop(queue, item);
+            if (!own && !steal(queue, item)) break;
+            if (!own) steals[thread]++;
+
+            auto start = Clock::now();
+            const WorkItem& work = items[item];
+            renderTile(work.x0, work.y0, work.x1, work.y1);
+            double seconds = std::chrono::duration<double>(Clock::now() - start).count();
+            itemCost[item] = float(seconds);
+            busy[thread] += seconds;
+        }
+    });
+
+    // This frame's measurements become the next frame's prediction
+    tileCost.assign(size_t(tilesX) * tilesY, 0.0f);
+    for (size_t i = 0; i < items.size(); i++) {
+        tileCost[items[i].tile] += itemCost[i];
+    }
+    collectStats(threads, busy, steals, std::chrono::duration<double>(Clock::now() - frameStart).count());
+}
+
+void TileScheduler::collectStats(int threads, const std::vector<double>& busy, const std::vector<int>& steals, double frameSeconds)
+{
+    stats.tiles = tilesX * tilesY;
+    stats.workItems = int(items.size());
+    stats.steals = std::accumulate(steals.begin(), steals.end(), 0);
+    stats.frameMs = frameSeconds * 1000.0;
+
+    auto range = std::minmax_element(itemCost.begin(), itemCost.end());
+    stats.minItemMs = items.empty() ? 0.0 : *range.first * 1000.0;
+    stats.maxItemMs = items.empty() ? 0.0 : *range.second * 1000.0;
+    stats.meanItemMs = items.empty() ? 0.0 : std::accumulate(itemCost.begin(), itemCost.end(), 0.0) * 1000.0 / items.size();
+
+    stats.threadBusyMs.resize(threads);
+    double total = 0.0, busiest = 0.0;
+    for (int thread = 0; thread < threads; thread++) {
+        stats.threadBusyMs[thread] = busy[thread] * 1000.0;
+        total += busy[thread];
+        busiest = std::max(busiest, busy[thread]);
+    }
+    stats.imbalance = total > 0.0 ? busiest * threads / total : 1.0;
+}
@@ -0,0 +1,197 @@
+#include "trace.h"
+#include <atomic>
+#include <mutex>
+#include <vector>
+#include <memory>
+#include <fstream>
+#include <iostream>
+#include <cstdint>
+#include <cstdio>
+
+namespace trace {
+
+namespace {
+
+struct Event {
+    const char* name;
+    int64_t begin, end;     // Clock ticks converted to nanoseconds
+};
+
+// Events are appended to fixed size chunks that are never moved, so a writer on another thread can read every
+// event below a chunk's published count while the owning thread keeps appending
+struct Chunk {
+    static constexpr int capacity = 4096;
+    Event events[capacity];
+    std::atomic<int> count{ 0 };
+    Chunk* previous = nullptr;
+};
+
+struct ThreadBuffer {
+    static constexpr size_t maxEvents = size_t(1) << 20;   // 24 MB per thread, later events are dropped
+
+    int id = 0;
+    std::string name;                   // Guarded by the registry mutex
+    std::atomic<Chunk*> last{ nullptr };
+    size_t recorded = 0;                // Only touched by the owning thread
+    std::atomic<size_t> dropped{ 0 };
+};
+
+struct Registry {
+    std::mutex mutex;
+    std::vector<std::unique_ptr<ThreadBuffer>> buffers;
+    std::string path;
+    Clock::time_point origin;
+};
+
+std::atomic<bool> enabled{ false };
+
+// Never destroyed: threads that are still running at exit may record into their buffers
+Registry& registry()
+{
+    static Registry* instance = new Registry();
+    return *instance;
+}
+
+// Buffers outlive their threads, so the events of finished loaders are still written
+ThreadBuffer& threadBuffer()
+{
+    thread_local ThreadBuffer* buffer = nullptr;
+    if (!buffer) {
+        Registry& reg = registry();
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.buffers.push_back(std::make_unique<ThreadBuffer>());
+        buffer = reg.buffers.back().get();
+        buffer->id = int(reg.buffers.size());
+        buffer->name = "Thread " + std::to_string(buffer->id);
+    }
+    return *buffer;
+}
+
+int64_t toNanoseconds(Clock::time_point time)
+{
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(time.time_since_epoch()).count();
+}
+
+void writeEscaped(std::ostream& out, const char* text)
+{
+    for (const char* c = text; *c; c++) {
+        if (*c == '"' || *c == '\\') out << '\\' << *c;
+        else if (static_cast<unsigned char>(*c) < 0x20) out << ' ';
+        else out << *c;
+    }
+}
+
+}
+
+void start(const std::string& path)
+{
+    Registry& reg = registry();
+    {
+        std::lock_guard<std::mutex> lock(reg.mutex);
+        reg.path = path;
+        reg.origin = Clock::now();
+    }
+    enabled.store(true, std::memory_order_release);
+}
+
+bool isEnabled()
+{
+    return enabled.load(std::memory_order_relaxed);
+}
+
+void setThreadName(const char* name)
+{
+    ThreadBuffer& buffer = threadBuffer();
+    std::lock_guard<std::mutex> lock(registry().mutex);
+    buffer.name = name;
+}
+
+void record(const char* name, Clock::time_point begin, Clock::time_point end)
+{
+    if (!isEnabled()) return;
+
+    ThreadBuffer& buffer = threadBuffer();
+    Chunk* chunk = buffer.last.load(std::memory_order_relaxed);
+    int count = chunk ? chunk->count.load(std::memory_order_relaxed) : Chunk::capacity;
+    if (count == Chunk::capacity) {
+        if (buffer.recorded >= ThreadBuffer::maxEvents) {
+            buffer.dropped.fetch_add(1, std::memory_order_relaxed);
+            return;
+        }
+        Chunk* next = new Chunk();
+        next->previous = chunk;
+        buffer.last.store(next, std::memory_order_release);
+        chunk = next;
+        count = 0;
+    }
+    chunk->events[count] = Event{ name, toNanoseconds(begin), toNanoseconds(end) };
+    chunk->count.store(count + 1, std::memory_order_release);
+    buffer.recorded++;
+}
+
+bool write()
+{
+    std::string path;
+    {
+        std::lock_guard<std::mutex> lock(registry().mutex);
+        path = registry().path;
+    }
+    return write(path);
+}
+
+bool write(const std::string& path)
+{
+    if (path.empty()) return false;
+    std::ofstream out(path);
+    if (!out) {
+        std::cerr << "Failed to write trace " << path << std::endl;
+        return false;
+    }
+
+    Registry& reg = registry();
+    std::lock_guard<std::mutex> lock(reg.mutex);
+    const int64_t origin = toNanoseconds(reg.origin);
+    size_t events = 0, dropped = 0;
+    char number[64];
+
+    // Timestamps and durations in microseconds, relative to start()
+    out << "{\"displayTimeUnit\":\"ms\",\"traceEvents\":[\n";
+    out << "{\"name\":\"process_name\",\"ph\":\"M\",\"pid\":1,\"tid\":0,\"args\":{\"name\":\"VolumeRendering\"}}";
+    for (const auto& buffer : reg.buffers) {
+        out << ",\n{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << buffer->id << ",\"args\":{\"name\":\"";
+        writeEscaped(out, buffer->name.c_str());
+        out << "\"}}";
+
+        // Chunks are linked newest first
+        std::vector<const Chunk*> chunks;
+        for (const Chunk* chunk = buffer->last.load(std::memory_order_acquire); chunk; chunk = chunk->previous) {
+            chunks.push_back(chunk);
+        }
+        for (auto chunk = chunks.rbegin(); chunk != chunks.rend(); ++chunk) {
+            int count = (*chunk)->count.load(std::memory_order_acquire);
+            for (int i = 0; i < count; i++) {
+                const Event& event = (*chunk)->events[i];
+                if (event.end < origin) continue;
+                out << ",\n{\"name\":\"";
+                writeEscaped(out, event.name);
+                snprintf(number, sizeof(number), "\",\"ph\":\"X\",\"ts\":%.3f,\"dur\":%.3f", (event.begin - origin) * 1e-3, (event.end - event.begin) * 1e-3);
+                out << number << ",\"pid\":1,\"tid\":" << buffer->id << "}";
+                events++;
+            }
+        }
+        dropped += buffer->dropped.load(std::memory_order_relaxed);
+    }
+    out << "\n]}\n";
+    out.close();
+    if (!out) {
+        std::cerr << "Failed to write trace " << path << std::endl;
+        return false;
+    }
+
+    std::cout << "Wrote " << events << " trace events to " << path;
+    if (dropped) std::cout << " (" << dropped << " dropped, the per-thread buffers were full)";
+    std::cout << std::endl;
+    return true;
+}
+
+}
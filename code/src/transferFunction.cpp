@@ -0,0 +1,125 @@
+#include "transferFunction.h"
+#include <fstream>
+#include <iostream>
+#include <cmath>
+#include <algorithm>
+
+void buildTransferFunctionLUT(const std::vector<TransferFunctionPoint>& controlPoints, float* TransferFun)
+{
+    int controlPointIndex = 0;
+    for (int i = 0; i < 256; i++) {
+        float t = float(i) / 255.0f;
+        if (t == 0 || t == 1) {
+            TransferFun[i * 4 + 0] = controlPoints[controlPointIndex].color.x;
+            TransferFun[i * 4 + 1] = controlPoints[controlPointIndex].color.y;
+            TransferFun[i * 4 + 2] = controlPoints[controlPointIndex].color.z;
+            TransferFun[i * 4 + 3] = controlPoints[controlPointIndex].color.w;
+        }
+        else {
+            if (t > controlPoints[controlPointIndex].position)
+            {
+                controlPointIndex++;
+            }
+            float time = (t - controlPoints[controlPointIndex - 1].position) / (controlPoints[controlPointIndex].position - controlPoints[controlPointIndex - 1].position);
+            TransferFun[i * 4 + 0] = controlPoints[controlPointIndex - 1].color.x + time * (controlPoints[controlPointIndex].color.x - controlPoints[controlPointIndex - 1].color.x);
+            TransferFun[i * 4 + 1] = controlPoints[controlPointIndex - 1].color.y + time * (controlPoints[controlPointIndex].color.y - controlPoints[controlPointIndex - 1].color.y);
+            TransferFun[i * 4 + 2] = controlPoints[controlPointIndex - 1].color.z + time * (controlPoints[controlPointIndex].color.z - controlPoints[controlPointIndex - 1].color.z);
+            TransferFun[i * 4 + 3] = controlPoints[controlPointIndex - 1].color.w + time * (controlPoints[controlPointIndex].color.w - controlPoints[controlPointIndex - 1].color.w);
+        }
+
+    }
+}
+
+void buildPreIntegrationTable(const float* TransferFun, float* table)
+{
+    // Extinction and emission (colour per opacity times extinction) of each entry, then their running integrals
+    // with the trapezoidal rule, so the integral between any two entries is a difference
+    double tau[256], emission[256][3];
+    for (int i = 0; i < 256; i++) {
+        const float* rgba = TransferFun + i * 4;
+        float opacity = std::min(rgba[3] * (float(i) / 255.0f), 0.9999f);
+        tau[i] = -std::log(1.0 - opacity);
+        for (int c = 0; c < 3; c++) {
+            emission[i][c] = rgba[3] > 0.0f ? rgba[c] / rgba[3] * tau[i] : 0.0;
+        }
+    }
+    double tauSum[256], emissionSum[256][3];
+    tauSum[0] = 0.0;
+    emissionSum[0][0] = emissionSum[0][1] = emissionSum[0][2] = 0.0;
+    for (int i = 1; i < 256; i++) {
+        tauSum[i] = tauSum[i - 1] + 0.5 * (tau[i - 1] + tau[i]);
+        for (int c = 0; c < 3; c++) {
+            emissionSum[i][c] = emissionSum[i - 1][c] + 0.5 * (emission[i - 1][c] + emission[i][c]);
+        }
+    }
+
+    for (int back = 0; back < 256; back++) {
+        for (int front = 0; front < 256; front++) {
+            float* entry = table + (size_t(back) * 256 + front) * 4;
+            double extinction, color[3];
+            if (front == back) {
+                // A constant segment, identical to a point sample
+                extinction = tau[front];
+                for (int c = 0; c < 3; c++) color[c] = emission[front][c];
+            }
+            else {
+                double length = std::abs(back - front);
+                extinction = std::abs(tauSum[back] - tauSum[front]) / length;
+                for (int c = 0; c < 3; c++) color[c] = std::abs(emissionSum[back][c] - emissionSum[front][c]) / length;
+            }
+            for (int c = 0; c < 3; c++) {
+                entry[c] = extinction > 1e-12 ? float(color[c] / extinction) : 0.0f;
+            }
+            entry[3] = float(extinction);
+        }
+    }
+}
+
+bool saveTransferFunction(const std::string& filename, const std::vector<TransferFunctionPoint>& controlPoints)
+{
+    std::ofstream ofs(filename, std::ios::binary);
+    if (!ofs) {
+        std::cerr << "Failed to open file for saving: " << filename << std::endl;
+        return false;
+    }
+
+    size_t size = controlPoints.size();
+    ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+
+    for (const auto& point : controlPoints) {
+        ofs.write(reinterpret_cast<const char*>(&point.position), sizeof(point.position));
+        ofs.write(reinterpret_cast<const char*>(&point.color), sizeof(point.color));
+    }
+
+    ofs.close();
+    return true;
+}
+
+bool loadTransferFunction(const std::string& filename, std::vector<TransferFunctionPoint>& controlPoints)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        std::cerr << "Failed to open file for loading: " << filename << std::endl;
+        return false;
+    }
+
+    size_t size = 0;
+    ifs.read(reinterpret_cast<char*>(&size), sizeof(size));  // Read the size of the array
+    if (!ifs || size < 2 || size > 4096) {
+        std::cerr << "Not a transfer function file: " << filename << std::endl;
+        return false;
+    }
+
+    std::vector<TransferFunctionPoint> points(size);
+    for (auto& point : points) {
+        ifs.read(reinterpret_cast<char*>(&point.position), sizeof(point.position));  // Read position
+        ifs.read(reinterpret_cast<char*>(&point.color), sizeof(point.color));        // Read color
+    }
+    if (!ifs) {
+        std::cerr << "Truncated transfer function file: " << filename << std::endl;
+        return false;
+    }
+
+    controlPoints = points;
+    return true;
+}
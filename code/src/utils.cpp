@@ -1,5 +1,8 @@
 #include "utils.h"
+#include "camera.h"
+#include "trace.h"
 #include <filesystem>
+#include <chrono>
 
 namespace fs = std::filesystem;
 
@@ -19,6 +22,7 @@ static void glfwindow_key_cb(GLFWwindow* window, int key, int scancode, int acti
 {
     GLFWindow* gw = static_cast<GLFWindow*>(glfwGetWindowUserPointer(window));
     assert(gw);
+    gw->inputReceived = true;
 
     gw->key(key, action, mods);
 }
@@ -27,6 +31,7 @@ static void glfwindow_mouseMotion_cb(GLFWwindow* window, double xPos, double yPo
 {
     GLFWindow* gw = static_cast<GLFWindow*>(glfwGetWindowUserPointer(window));
     assert(gw);
+    gw->inputReceived = true;
 
     ImGuiIO& io = ImGui::GetIO();
     if (!io.WantCaptureMouse) {
@@ -37,6 +42,7 @@ static void glfwindow_mouseMotion_cb(GLFWwindow* window, double xPos, double yPo
 static void glfwindow_mouseScroll_cb(GLFWwindow* window, double xoffset, double yoffset) {
     GLFWindow* gw = static_cast<GLFWindow*>(glfwGetWindowUserPointer(window));
     assert(gw);
+    gw->inputReceived = true;
 
     ImGuiIO& io = ImGui::GetIO();
     if (!io.WantCaptureMouse) {
@@ -48,6 +54,7 @@ static void glfwindow_mouseButton_cb(GLFWwindow* window, int button, int action,
 {
     GLFWindow* gw = static_cast<GLFWindow*>(glfwGetWindowUserPointer(window));
     assert(gw);
+    gw->inputReceived = true;
 
     ImGuiIO& io = ImGui::GetIO();
     if (!io.WantCaptureMouse) {
@@ -55,7 +62,7 @@ static void glfwindow_mouseButton_cb(GLFWwindow* window, int button, int action,
     }
 }
 
-GLFWindow::GLFWindow(int width, int height, std::string windowName): Width(width), Height(height), WindowName(windowName)
+GLFWindow::GLFWindow(int width, int height, std::string windowName, bool headless): Width(width), Height(height), WindowName(windowName), headless(headless)
 {
     setupWindow();
 }
@@ -84,7 +91,12 @@ int GLFWindow::openGLInit() {
 #if defined(IMGUI_IMPL_OPENGL_LOADER_GL3W)
     bool err = gl3wInit() != 0;
 #elif defined(IMGUI_IMPL_OPENGL_LOADER_GLEW)
-    bool err = glewInit() != GLEW_OK;
+    GLenum glewStatus = glewInit();
+#ifdef GLEW_ERROR_NO_GLX_DISPLAY
+    // GLEW built for GLX loads the entry points, then reports this for EGL contexts (headless rendering)
+    if (glewStatus == GLEW_ERROR_NO_GLX_DISPLAY) glewStatus = GLEW_OK;
+#endif
+    bool err = glewStatus != GLEW_OK;
 #elif defined(IMGUI_IMPL_OPENGL_LOADER_GLAD)
     bool err = gladLoadGL() == 0;
 #elif defined(IMGUI_IMPL_OPENGL_LOADER_GLAD2)
@@ -122,29 +134,71 @@ int GLFWindow::openGLInit() {
     // Enable smooth point rendering
     glEnable(GL_LINE_SMOOTH);
     glHint(GL_LINE_SMOOTH_HINT, GL_NICEST);
+
+    profiler.init();
 }
 
-GLFWwindow* GLFWindow::setupWindow()
+GLFWwindow* GLFWindow::createOffscreenContext()
 {
-    glfwSetErrorCallback(glfw_error_callback);
+#ifdef GLFW_PLATFORM_NULL
+    // GLFW 3.4's null platform needs no X11 or Wayland display. Its EGL context is surfaceless on Mesa (llvmpipe or a
+    // render node), which is all batch rendering needs since it only draws into framebuffer objects.
+    if (!glfwPlatformSupported(GLFW_PLATFORM_NULL))
+        return NULL;
 
-    if (!glfwInit())
-        exit(EXIT_FAILURE);
+    glfwInitHint(GLFW_PLATFORM, GLFW_PLATFORM_NULL);
+    bool initialized = glfwInit();
+    glfwInitHint(GLFW_PLATFORM, GLFW_ANY_PLATFORM);
+    if (!initialized)
+        return NULL;
 
+    glfwWindowHint(GLFW_CLIENT_API, GLFW_OPENGL_API);
+    glfwWindowHint(GLFW_CONTEXT_CREATION_API, GLFW_EGL_CONTEXT_API);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
     glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
-    glfwWindowHint(GLFW_VISIBLE, GLFW_TRUE);    
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
 
-    // Create window with graphics context
-    Window = glfwCreateWindow(Width, Height, WindowName.c_str(), NULL, NULL);
-    if (Window == NULL) {
+    GLFWwindow* window = glfwCreateWindow(Width, Height, WindowName.c_str(), NULL, NULL);
+    glfwDefaultWindowHints();
+    if (window == NULL) {
         glfwTerminate();
-        exit(EXIT_FAILURE);
+        std::cout << "No offscreen EGL context, falling back to a hidden window (needs a display, e.g. Xvfb)" << std::endl;
+    }
+    return window;
+#else
+    std::cout << "GLFW 3.4 or newer is needed for offscreen rendering, using a hidden window (needs a display, e.g. Xvfb)" << std::endl;
+    return NULL;
+#endif
+}
+
+GLFWwindow* GLFWindow::setupWindow()
+{
+    glfwSetErrorCallback(glfw_error_callback);
+
+    Window = NULL;
+    if (headless) {
+        Window = createOffscreenContext();
+    }
+
+    if (Window == NULL) {
+        if (!glfwInit())
+            exit(EXIT_FAILURE);
+
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MAJOR, 3);
+        glfwWindowHint(GLFW_CONTEXT_VERSION_MINOR, 0);
+        glfwWindowHint(GLFW_VISIBLE, headless ? GLFW_FALSE : GLFW_TRUE);
+
+        // Create window with graphics context
+        Window = glfwCreateWindow(Width, Height, WindowName.c_str(), NULL, NULL);
+        if (Window == NULL) {
+            glfwTerminate();
+            exit(EXIT_FAILURE);
+        }
     }
 
     glfwSetWindowUserPointer(Window, this);
     glfwMakeContextCurrent(Window);
-    glfwSwapInterval(1);
+    glfwSwapInterval(headless ? 0 : 1);
 
     // Initialize OpenGL loader
     int status = openGLInit();
@@ -153,14 +207,21 @@ GLFWwindow* GLFWindow::setupWindow()
     }
     //std::cout<< "OpenGL version: " << glGetString(GL_VERSION) << std::endl;
 
+    ShaderProgram = CreateShaderProgram(vShaderFile, fShaderFile);
+    BindUniforms();
+
+    // Batch rendering only draws into framebuffer objects: no input, no GUI
+    if (headless) {
+        glEnable(GL_DEPTH_TEST);
+        return Window;
+    }
+
     glfwSetFramebufferSizeCallback(Window, glfwindow_reshape_cb);
     glfwSetMouseButtonCallback(Window, glfwindow_mouseButton_cb);
     glfwSetKeyCallback(Window, glfwindow_key_cb);
     glfwSetCursorPosCallback(Window, glfwindow_mouseMotion_cb);
     glfwSetScrollCallback(Window, glfwindow_mouseScroll_cb);
 
-    ShaderProgram = CreateShaderProgram(vShaderFile, fShaderFile);
-
     // Setup Dear ImGui context
     IMGUI_CHECKVERSION();
     ImGui::CreateContext();
@@ -281,9 +342,74 @@ void GLFWindow::RenderGUI()
 {
     ImGui::Begin("Information");
     ImGui::Text("%.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate);
+    if (volumeUploader.isActive()) {
+        ImGui::ProgressBar(volumeUploader.getProgress(), ImVec2(-1, 0), "Uploading volume");
+    }
+    if (!loadingStatus.empty()) {
+        ImGui::Text("%s", loadingStatus.c_str());
+    }
+    else if (uploadTime > 0.0f) {
+        ImGui::Text("Volume upload: %.0f ms (%s buffers)", uploadTime, uploadPersistent ? "persistent" : "mapped");
+    }
+    ImGui::Text("Voxels: %s", voxelTypeName(volumeType));
+    float dragSpeed = glm::max((dataRange.y - dataRange.x) / 500.0f, 1e-4f);
+    if (ImGui::DragFloatRange2("Window", &windowRange.x, &windowRange.y, dragSpeed, dataRange.x, dataRange.y)) {
+        UpdateOccupancyGrid();
+        renderParamsChanged = true;
+    }
+    if (brickGrid) {
+        renderParamsChanged |= ImGui::Checkbox("Empty space skipping", &emptySpaceSkipping);
+        renderParamsChanged |= ImGui::Checkbox("Adaptive stepping", &adaptiveStepping);
+        if (adaptiveStepping) {
+            renderParamsChanged |= ImGui::SliderFloat("Max step scale", &maxStepScale, 1.0f, 8.0f);
+            renderParamsChanged |= ImGui::SliderFloat("Adaptive opacity", &adaptiveOpacity, 0.005f, 0.5f, "%.3f", 3.0f);
+        }
+        ImGui::Text("Occupancy update: %.3f ms", occupancyUpdateTime);
+    }
+    if (brickedVolume) {
+        StreamingStats stats = streamer.getStats();
+        ImGui::Text("Bricks resident %d / %d slots, %d pending", stats.resident, stats.slots, stats.pending);
+        ImGui::Text("Visible bricks %d, evictions %zu, read %.1f MB", stats.requested, stats.evictions, stats.bytesRead / (1024.0 * 1024.0));
+    }
+    if (gradientUploader.isActive()) {
+        ImGui::ProgressBar(gradientUploader.getProgress(), ImVec2(-1, 0), "Uploading gradients");
+    }
+    else if (GradientsReady()) {
+        renderParamsChanged |= ImGui::Checkbox("Shading", &shading);
+        renderParamsChanged |= ImGui::SliderFloat("Gradient opacity", &gradientOpacity, 0.0f, 1.0f);
+    }
+    if (volumeLevels > 1) {
+        renderParamsChanged |= ImGui::Checkbox("Level of detail", &levelOfDetail);
+        if (levelOfDetail) {
+            renderParamsChanged |= ImGui::SliderFloat("LOD bias", &lodBias, -2.0f, 2.0f);
+            ImGui::Text("%d levels, %s filter", volumeLevels, mipFilterName(mipFilter));
+        }
+    }
+    if (ImGui::SliderFloat("Step size", &step_size, 0.25f, 4.0f)) {
+        renderParamsChanged = true;
+    }
+    renderParamsChanged |= ImGui::Checkbox("Pre-integration", &preIntegration);
+    ImGui::Text("Uniform uploads: %d", uniformUploads);
+    renderParamsChanged |= ImGui::Checkbox("Render on demand", &renderOnDemand);
+    renderParamsChanged |= ImGui::Checkbox("Progressive refinement", &refinement.enabled);
+    if (refinement.enabled) {
+        ImGui::SliderFloat("Interactive budget (ms)", &refinement.interactiveBudgetMs, 2.0f, 50.0f);
+        ImGui::SliderFloat("Refinement budget (ms)", &refinement.refinementBudgetMs, 2.0f, 100.0f);
+        ImGui::Text("Refinement level %d / %d", refinement.getDisplayedLevel() + 1, refinement.getLevelCount());
+    }
+    ImGui::Text("Volume frames: %d, last pass %.2f ms", volumeFrames, lastPassTime);
+    profiler.drawGui();
+    if (trace::isEnabled() && ImGui::Button("Write trace")) {
+        trace::write();
+    }
     ImGui::End();
 }
 
+static ImVec4 toImVec4(const glm::vec4& color)
+{
+    return ImVec4(color.x, color.y, color.z, color.w);
+}
+
 void GLFWindow::DrawTransferFunctionEditor() {
     ImGui::Begin("Transfer Function Editor");
 
@@ -302,10 +428,10 @@ void GLFWindow::DrawTransferFunctionEditor() {
         ImVec2 p2 = ImVec2(p0.x + width * controlPoints[i + 1].position, p0.y + height);
         draw_list->AddRectFilledMultiColor(
             p1, p2,
-            ImGui::ColorConvertFloat4ToU32(controlPoints[i].color),
-            ImGui::ColorConvertFloat4ToU32(controlPoints[i + 1].color),
-            ImGui::ColorConvertFloat4ToU32(controlPoints[i + 1].color),
-            ImGui::ColorConvertFloat4ToU32(controlPoints[i].color)
+            ImGui::ColorConvertFloat4ToU32(toImVec4(controlPoints[i].color)),
+            ImGui::ColorConvertFloat4ToU32(toImVec4(controlPoints[i + 1].color)),
+            ImGui::ColorConvertFloat4ToU32(toImVec4(controlPoints[i + 1].color)),
+            ImGui::ColorConvertFloat4ToU32(toImVec4(controlPoints[i].color))
         );
     }
 
@@ -343,7 +469,7 @@ void GLFWindow::DrawTransferFunctionEditor() {
             newPosition = glm::clamp(newPosition, 0.0f, 1.0f);
             newAlpha = glm::clamp(newAlpha, 0.0f, 1.0f);
 
-            newPoint = { newPosition, ImVec4(1, 1, 1, newAlpha) };
+            newPoint = { newPosition, glm::vec4(1, 1, 1, newAlpha) };
             addControlPoint = true;
         }
     }
@@ -364,7 +490,7 @@ void GLFWindow::DrawTransferFunctionEditor() {
     if (selectedControlPoint >= 0 && selectedControlPoint < controlPoints.size()) {
         ImGui::Separator();
         ImGui::Text("Edit Selected Point:");
-        if (ImGui::ColorEdit4("RGBA", (float*)&controlPoints[selectedControlPoint].color)) {
+        if (ImGui::ColorEdit4("RGBA", &controlPoints[selectedControlPoint].color.x)) {
             HasTransferFunctionModified = true;
         }
         ImGui::SameLine();
@@ -402,6 +528,7 @@ void GLFWindow::DrawTransferFunctionEditor() {
     if (showTFSelector) {
         ShowTransferFunctionSelector();
     }
+    ImGui::Checkbox("Stream edits through pixel buffers", &useTransferFunctionPBO);
     ImGui::End();
 }
 
@@ -420,12 +547,14 @@ void GLFWindow::ShowTransferFunctionSelector() {
     }
 
     static int selectedFileIndex = -1;
+    bool loadSelectedFile = false;
 
     if (ImGui::BeginCombo("Transfer Functions", selectedFileIndex == -1 ? "Select a file..." : tfFiles[selectedFileIndex].c_str())) {
         for (int i = 0; i < tfFiles.size(); ++i) {
             bool isSelected = (selectedFileIndex == i);
             if (ImGui::Selectable(tfFiles[i].c_str(), isSelected)) {
                 selectedFileIndex = i;
+                loadSelectedFile = true;
             }
             if (isSelected) {
                 ImGui::SetItemDefaultFocus();
@@ -434,8 +563,8 @@ void GLFWindow::ShowTransferFunctionSelector() {
         ImGui::EndCombo();
     }
 
-    // Load the selected transfer function
-    if (selectedFileIndex >= 0) {
+    // Load the selected transfer function once, when the selection changes
+    if (selectedFileIndex >= 0 && loadSelectedFile) {
         std::string selectedFile = tfFolderPath + "/" + tfFiles[selectedFileIndex];
         if (LoadTransferFunction(selectedFile)) {
             Create1DTransferFunction();
@@ -443,113 +572,148 @@ void GLFWindow::ShowTransferFunctionSelector() {
     }
 }
 
-void GLFWindow::SetUniforms()
+// Names of GLFWindow::UniformId, in enum order
+static const char* uniformNames[GLFWindow::U_COUNT] = {
+    "camPosition", "stepSize", "extentmin", "extentmax", "windowMin", "windowMax",
+    "texture3d", "transferfun", "emptySpaceSkipping", "occupancyGrid", "brickGridScale",
+    "vModel", "vView", "vProjection", "screen_width", "screen_height", "stepRatio",
+    "levelOfDetail", "lodBias", "maxLod",
+    "outOfCore", "pageTable", "brickAtlas", "pageBrickSize", "volumeDims",
+    "shading", "gradientVolume", "gradientOpacity",
+    "preIntegrated", "preIntegrationTable",
+    "adaptiveStepping", "adaptiveOpacity", "maxStepScale"
+};
+
+void GLFWindow::BindUniforms()
 {
-    glUseProgram(ShaderProgram);
-
-    GLint vCam_uniform = glGetUniformLocation(ShaderProgram, "camPosition");
-    if (vCam_uniform == -1) {
-        fprintf(stderr, "Could not bind location: camPosition\n");
+    if (!uniforms.resolve(ShaderProgram, uniformNames, U_COUNT, { U_SCREEN_WIDTH, U_SCREEN_HEIGHT })) {
         exit(0);
     }
-    glUniform3fv(vCam_uniform, 1, glm::value_ptr(camposition));
 
-    GLuint vstep_size = glGetUniformLocation(ShaderProgram, "stepSize");
-    if (vstep_size == -1) {
-        fprintf(stderr, "Could not bind location: vstep_size\n");
-        exit(0);
-    }
-    glUniform1f(vstep_size, step_size);
+    // Texture units never change, the samplers are assigned once per program
+    glUseProgram(ShaderProgram);
+    uniforms.set(U_TEXTURE3D, 0);
+    uniforms.set(U_TRANSFERFUN, 1);
+    uniforms.set(U_OCCUPANCY_GRID, 2);
+    uniforms.set(U_PAGE_TABLE, 3);
+    uniforms.set(U_BRICK_ATLAS, 4);
+    uniforms.set(U_GRADIENT_VOLUME, 5);
+    uniforms.set(U_PRE_INTEGRATION_TABLE, 6);
+}
 
-    GLuint vExtentMin = glGetUniformLocation(ShaderProgram, "extentmin");
-    if (vExtentMin == -1) {
-        fprintf(stderr, "Could not bind location: vExtentMin\n");
-        exit(0);
-    }
-    glUniform3f(vExtentMin, 0, 0, -VolumeSize.z);
+void GLFWindow::SetUniforms(float stepScale, int viewportWidth, int viewportHeight)
+{
+    glUseProgram(ShaderProgram);
 
-    GLuint vExtentMax = glGetUniformLocation(ShaderProgram, "extentmax");
-    if (vExtentMax == -1) {
-        fprintf(stderr, "Could not bind location: vExtentMax\n");
-        exit(0);
-    }
-    glUniform3f(vExtentMax, VolumeSize.x, VolumeSize.y, 0);
+    uniforms.set(U_CAM_POSITION, camposition);
+    uniforms.set(U_STEP_SIZE, step_size * stepScale);
+    uniforms.set(U_STEP_RATIO, step_size * stepScale);
+    uniforms.set(U_SCREEN_WIDTH, float(viewportWidth > 0 ? viewportWidth : Width));
+    uniforms.set(U_SCREEN_HEIGHT, float(viewportHeight > 0 ? viewportHeight : Height));
+    uniforms.set(U_EXTENT_MIN, glm::vec3(0, 0, -VolumeSize.z));
+    uniforms.set(U_EXTENT_MAX, glm::vec3(VolumeSize.x, VolumeSize.y, 0));
 
-    GLuint tex1 = glGetUniformLocation(ShaderProgram, "texture3d");
-    if (tex1 == -1) {
-        fprintf(stderr, "Could not bind location: texture3d\n");
-        exit(0);
+    glm::vec2 window = GetNormalizedWindow();
+    uniforms.set(U_WINDOW_MIN, window.x);
+    uniforms.set(U_WINDOW_MAX, window.y);
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, volumeTex);
+    glActiveTexture(GL_TEXTURE1);
+    glBindTexture(GL_TEXTURE_1D, tfTex);
+
+    uniforms.set(U_PRE_INTEGRATED, int(preIntegration));
+    if (preIntegration) {
+        glActiveTexture(GL_TEXTURE6);
+        glBindTexture(GL_TEXTURE_2D, preIntegrationTex);
     }
-    else {
-        unsigned int tex;
-        glGenVertexArrays(1, &tex);
-        glActiveTexture(GL_TEXTURE0);
-        glBindTexture(GL_TEXTURE_3D, volumeTex);
-        glUniform1i(tex1, 0);
+
+    uniforms.set(U_LEVEL_OF_DETAIL, int(levelOfDetail && volumeLevels > 1));
+    uniforms.set(U_LOD_BIAS, lodBias);
+    uniforms.set(U_MAX_LOD, float(volumeLevels - 1));
+
+    uniforms.set(U_EMPTY_SPACE_SKIPPING, int(brickGrid != nullptr && emptySpaceSkipping));
+    uniforms.set(U_ADAPTIVE_STEPPING, int(brickGrid != nullptr && adaptiveStepping));
+    uniforms.set(U_ADAPTIVE_OPACITY, adaptiveOpacity);
+    uniforms.set(U_MAX_STEP_SCALE, maxStepScale);
+    if (brickGrid) {
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, occupancyTex);
+        const int* dims = brickGrid->getVolumeDims();
+        uniforms.set(U_BRICK_GRID_SCALE, glm::vec3(dims[0], dims[1], dims[2]) / float(brickGrid->getBrickSize()));
     }
 
-    GLuint tex2 = glGetUniformLocation(ShaderProgram, "transferfun");
-    if (tex2 == -1) {
-        fprintf(stderr, "Could not bind location: transferfun\n");
-        exit(0);
+    uniforms.set(U_OUT_OF_CORE, int(brickedVolume != nullptr));
+    if (brickedVolume) {
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, pageTableTex);
+        glActiveTexture(GL_TEXTURE4);
+        glBindTexture(GL_TEXTURE_3D, brickAtlasTex);
+        const int* dims = brickedVolume->getDims();
+        uniforms.set(U_PAGE_BRICK_SIZE, float(brickedVolume->getBrickSize()));
+        uniforms.set(U_VOLUME_DIMS, glm::vec3(dims[0], dims[1], dims[2]));
     }
-    else {
-        glActiveTexture(GL_TEXTURE1);
-        glBindTexture(GL_TEXTURE_1D, tfTex);
-        glUniform1i(tex2, 1);
+
+    bool gradientsReady = GradientsReady();
+    uniforms.set(U_SHADING, int(gradientsReady && shading));
+    uniforms.set(U_GRADIENT_OPACITY, gradientsReady ? gradientOpacity : 0.0f);
+    if (gradientsReady) {
+        glActiveTexture(GL_TEXTURE5);
+        glBindTexture(GL_TEXTURE_3D, gradientTex);
     }
+
+    uniformUploads = uniforms.takeUploadCount();
+}
+
+glm::vec2 GLFWindow::GetNormalizedWindow()
+{
+    // Window in the units the shader samples from the volume texture
+    float windowMax = glm::max(windowRange.y, windowRange.x + 1e-6f * volumeTypeScale);
+    return glm::vec2(windowRange.x, windowMax) / volumeTypeScale;
 }
 
 void GLFWindow::SetupViewTransformation()
 {
-    viewT = glm::lookAt(camposition, camat, camup);
+    viewT = cameraViewMatrix(CameraPose{ camposition, camat, camup });
 
     //Pass-on the viewing matrix to the vertex shader
     glUseProgram(ShaderProgram);
-    vView_uniform = glGetUniformLocation(ShaderProgram, "vView");
-    if (vView_uniform == -1) {
-        fprintf(stderr, "Could not bind location: vView\n");
-        exit(0);
-    }
-    glUniformMatrix4fv(vView_uniform, 1, GL_FALSE, glm::value_ptr(viewT));
+    uniforms.set(U_VIEW, viewT);
+}
+
+void GLFWindow::SetCamera(const glm::vec3& position, const glm::vec3& at, const glm::vec3& up)
+{
+    camposition = position;
+    camat = at;
+    camup = up;
+    camright = glm::normalize(glm::cross(at - position, up));
+    SetupViewTransformation();
+
+    renderParamsChanged = true;
 }
 
 void GLFWindow::SetupModelTransformation()
 {
     //Modelling transformations (Model -> World coordinates)
-    modelT = glm::translate(glm::mat4(1.0f), glm::vec3(-VolumeSize.x / 2, -VolumeSize.y / 2, VolumeSize.z / 2));//Model coordinates are the world coordinates
+    modelT = volumeModelMatrix(VolumeSize);
 
     //Pass on the modelling matrix to the vertex shader
     glUseProgram(ShaderProgram);
-    vModel_uniform = glGetUniformLocation(ShaderProgram, "vModel");
-    if (vModel_uniform == -1) {
-        fprintf(stderr, "Could not bind location: vModel\n");
-        exit(0);
-    }
-    glUniformMatrix4fv(vModel_uniform, 1, GL_FALSE, glm::value_ptr(modelT));
+    uniforms.set(U_MODEL, modelT);
 }
 
 void GLFWindow::SetupProjectionTransformation()
 {
     //Projection transformation
-    projectionT = glm::perspective(45.0f, (GLfloat)Width / (GLfloat)Height, 0.1f, 800.0f);
+    projectionT = cameraProjectionMatrix((GLfloat)Width / (GLfloat)Height);
 
     //Pass on the projection matrix to the vertex shader
     glUseProgram(ShaderProgram);
-    vProjection_uniform = glGetUniformLocation(ShaderProgram, "vProjection");
-    if (vProjection_uniform == -1) {
-        fprintf(stderr, "Could not bind location: vProjection\n");
-        exit(0);
-    }
-    glUniformMatrix4fv(vProjection_uniform, 1, GL_FALSE, glm::value_ptr(projectionT));
+    uniforms.set(U_PROJECTION, projectionT);
 
     // Updating the screen dimensions in `screenWidth` and `screenHeight`
-    if (GLint widthLocation = glGetUniformLocation(ShaderProgram, "screen_width")) {
-        glUniform1f(widthLocation, Width);
-    }
-    if (GLint heightLocation = glGetUniformLocation(ShaderProgram, "screen_height")) {
-        glUniform1f(heightLocation, Height);
-    }    
+    uniforms.set(U_SCREEN_WIDTH, float(Width));
+    uniforms.set(U_SCREEN_HEIGHT, float(Height));
 }
 
 glm::vec3 GLFWindow::getTrackBallVector(double x, double y)
@@ -565,7 +729,48 @@ glm::vec3 GLFWindow::getTrackBallVector(double x, double y)
     return p;
 }
 
-void GLFWindow::Create3DVolumeTexture(GLubyte* Volume, float x_size, float y_size, float z_size)
+void GLFWindow::SetVolumeFormat(VoxelType type, glm::vec2 valueRange)
+{
+    // Voxels are uploaded in their native type; windowing to the transfer function range happens in the shader
+    GLint internalFormat = GL_R8;
+    GLenum dataType = GL_UNSIGNED_BYTE;
+    switch (type) {
+    case VoxelType::UInt16:
+        internalFormat = GL_R16;
+        dataType = GL_UNSIGNED_SHORT;
+        break;
+    case VoxelType::Int16:
+        internalFormat = GL_R16_SNORM;
+        dataType = GL_SHORT;
+        break;
+    case VoxelType::Float32:
+        internalFormat = halfFloatVolume ? GL_R16F : GL_R32F;
+        dataType = GL_FLOAT;
+        break;
+    default:
+        break;
+    }
+    volumeType = type;
+    volumeInternalFormat = internalFormat;
+    volumeDataType = dataType;
+    volumeTypeScale = voxelTypeScale(type);
+    dataRange = valueRange;
+    windowRange = valueRange;
+}
+
+void GLFWindow::SetVolumeGeometry(glm::vec3 dims, glm::vec3 spacing)
+{
+    // Anisotropic voxels stretch the box; the finest axis keeps its size in voxels
+    float minSpacing = glm::min(spacing.x, glm::min(spacing.y, spacing.z));
+    VolumeSize = dims * (spacing / minSpacing);
+    CreateBoundingBox();
+
+    SetupModelTransformation();                    // These funs will set and pass the Model, View, Transformation matrix to shaders
+    SetupViewTransformation();
+    SetupProjectionTransformation();
+}
+
+void GLFWindow::AllocateVolumeTexture(const void* Volume, int x_size, int y_size, int z_size)
 {
     glUseProgram(ShaderProgram);
 
@@ -577,54 +782,311 @@ void GLFWindow::Create3DVolumeTexture(GLubyte* Volume, float x_size, float y_siz
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
     glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, x_size, y_size, z_size, 0, GL_RED, GL_UNSIGNED_BYTE, Volume);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);                     // Rows of arbitrary width are tightly packed
+    glTexImage3D(GL_TEXTURE_3D, 0, volumeInternalFormat, x_size, y_size, z_size, 0, GL_RED, volumeDataType, Volume);
+}
 
-    VolumeSize = glm::vec3(x_size, y_size, z_size);
-    CreateBoundingBox();
+void GLFWindow::Create3DVolumeTexture(const void* Volume, VoxelType type, float x_size, float y_size, float z_size, glm::vec3 spacing, glm::vec2 valueRange)
+{
+    TraceScope scope("Upload volume");
+    SetVolumeFormat(type, valueRange);
+    AllocateVolumeTexture(Volume, int(x_size), int(y_size), int(z_size));
+    SetVolumeGeometry(glm::vec3(x_size, y_size, z_size), spacing);
+}
 
-    SetupModelTransformation();                    // These funs will set and pass the Model, View, Transformation matrix to shaders
-    SetupViewTransformation();
-    SetupProjectionTransformation();
+void GLFWindow::BeginVolumeUpload(const void* Volume, VoxelType type, int x_size, int y_size, int z_size, glm::vec3 spacing, glm::vec2 valueRange)
+{
+    SetVolumeFormat(type, valueRange);
+    AllocateVolumeTexture(NULL, x_size, y_size, z_size);
+    SetVolumeGeometry(glm::vec3(x_size, y_size, z_size), spacing);
+
+    // Filled slabs wake the event loop, which submits them and draws the next frame
+    volumeUploader.start(volumeTex, Volume, x_size, y_size, z_size, voxelTypeSize(type), GL_RED, volumeDataType, []() { glfwPostEmptyEvent(); });
+    uploadStartTime = glfwGetTime();
+}
+
+void GLFWindow::FinishVolumeUpload()
+{
+    if (!volumeUploader.isActive() && !gradientUploader.isActive()) return;
+    volumeUploader.finish();
+    gradientUploader.finish();
+    renderParamsChanged = true;
+}
+
+void GLFWindow::SetGradientVolume(const GradientVolume* gradients, bool enableShading, float opacityModulation)
+{
+    if (brickedVolume) {
+        std::cout << "Gradients are not streamed, shading is not available for out-of-core volumes" << std::endl;
+        return;
+    }
+    const int* dims = gradients->getDims();
+
+    glGenTextures(1, &gradientTex);
+    glActiveTexture(GL_TEXTURE5);
+    glBindTexture(GL_TEXTURE_3D, gradientTex);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGB10_A2, dims[0], dims[1], dims[2], 0, GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV, NULL);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    gradientUploader.start(gradientTex, gradients->getTexels(), dims[0], dims[1], dims[2], sizeof(uint32_t), GL_RGBA, GL_UNSIGNED_INT_2_10_10_10_REV,
+        []() { glfwPostEmptyEvent(); });
+    shading = enableShading;
+    gradientOpacity = opacityModulation;
+}
+
+bool GLFWindow::SetOutOfCoreVolume(BrickedVolume* volume, size_t budgetBytes)
+{
+    brickedVolume = volume;
+    SetVolumeFormat(volume->getVoxelType(), volume->getValueRange());
+    glUseProgram(ShaderProgram);
+
+    // As many slots as the budget allows (no more than there are bricks), arranged as a roughly cubic atlas.
+    // Slot coordinates are stored as bytes in the page table.
+    GLint maxSize = 0;
+    glGetIntegerv(GL_MAX_3D_TEXTURE_SIZE, &maxSize);
+    const int padded = volume->getPaddedBrickSize();
+    const int maxPerAxis = glm::min(maxSize / padded, 255);
+    size_t slots = glm::min(budgetBytes / volume->getBrickBytes(), volume->getBrickCount());
+    if (slots == 0 || maxPerAxis < 1) {
+        std::cerr << "Streaming budget too small for a " << volume->getBrickBytes() / 1024.0 << " KB brick" << std::endl;
+        return false;
+    }
+    int slotDims[3];
+    slotDims[0] = slotDims[1] = glm::clamp(int(std::cbrt(double(slots))), 1, maxPerAxis);
+    slotDims[2] = glm::clamp(int(slots / (size_t(slotDims[0]) * slotDims[1])), 1, maxPerAxis);
+
+    glGenTextures(1, &brickAtlasTex);
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_3D, brickAtlasTex);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexImage3D(GL_TEXTURE_3D, 0, volumeInternalFormat, slotDims[0] * padded, slotDims[1] * padded, slotDims[2] * padded, 0, GL_RED, volumeDataType, NULL);
+
+    const int* gridDims = volume->getGridDims();
+    glGenTextures(1, &pageTableTex);
+    glActiveTexture(GL_TEXTURE3);
+    glBindTexture(GL_TEXTURE_3D, pageTableTex);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_RGBA8UI, gridDims[0], gridDims[1], gridDims[2], 0, GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, NULL);
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    // Loaded bricks wake the event loop, which uploads them and redraws
+    streamer.start(volume, slotDims, 8, []() { glfwPostEmptyEvent(); });
+    streamingRequestsStale = true;
+    std::cout << "Brick atlas " << slotDims[0] << "x" << slotDims[1] << "x" << slotDims[2] << " slots ("
+        << slotDims[0] * slotDims[1] * slotDims[2] * volume->getBrickBytes() / (1024.0 * 1024.0) << " MB)" << std::endl;
+
+    const int* dims = volume->getDims();
+    SetVolumeGeometry(glm::vec3(dims[0], dims[1], dims[2]), volume->getSpacing());
+    return true;
+}
+
+void GLFWindow::UpdateStreaming()
+{
+    if (!brickedVolume) return;
+
+    // Requests only change with the view, the window or the transfer function (through the occupancy flags)
+    if (streamingRequestsStale) {
+        streamer.request(visibleBricks(*brickedVolume, occupancyGrid.getOccupancy(), camposition, VolumeSize, float(Width) / float(Height)));
+        streamingRequestsStale = false;
+    }
+
+    const int padded = brickedVolume->getPaddedBrickSize();
+    glActiveTexture(GL_TEXTURE4);
+    glBindTexture(GL_TEXTURE_3D, brickAtlasTex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    bool changed = streamer.collect(streamingUploadBudget, [&](int slot, const void* voxels) {
+        int x, y, z;
+        streamer.getSlotPosition(slot, x, y, z);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, x * padded, y * padded, z * padded, padded, padded, padded, GL_RED, volumeDataType, voxels);
+    });
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    if (changed) {
+        // The page table is small (four bytes per brick), it is replaced as a whole
+        const int* gridDims = brickedVolume->getGridDims();
+        glActiveTexture(GL_TEXTURE3);
+        glBindTexture(GL_TEXTURE_3D, pageTableTex);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, 0, gridDims[0], gridDims[1], gridDims[2], GL_RGBA_INTEGER, GL_UNSIGNED_BYTE, streamer.getPageTable());
+        glBindTexture(GL_TEXTURE_3D, 0);
+        renderParamsChanged = true;
+    }
+}
+
+void GLFWindow::FinishStreaming()
+{
+    if (!brickedVolume) return;
+    streamingRequestsStale = true;
+    UpdateStreaming();
+    while (!streamer.isIdle()) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        UpdateStreaming();
+    }
+    UpdateStreaming();
+}
+
+void GLFWindow::SetVolumePyramid(const VolumePyramid* pyramid, bool enableLevelOfDetail, float bias)
+{
+    TraceScope scope("Upload mip pyramid");
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, volumeTex);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    volumeLevels = pyramid ? pyramid->getLevelCount() : 1;
+    for (int level = 1; level < volumeLevels; level++) {
+        const int* dims = pyramid->getDims(level);
+        glTexImage3D(GL_TEXTURE_3D, level, volumeInternalFormat, dims[0], dims[1], dims[2], 0, GL_RED, volumeDataType, pyramid->getLevel(level));
+    }
+    // The shader picks one level per ray with textureLod, so levels are never blended
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_BASE_LEVEL, 0);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAX_LEVEL, volumeLevels - 1);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, volumeLevels > 1 ? GL_LINEAR_MIPMAP_NEAREST : GL_LINEAR);
+
+    if (pyramid) mipFilter = pyramid->getFilter();
+    levelOfDetail = enableLevelOfDetail;
+    lodBias = bias;
+    renderParamsChanged = true;
 }
 
 void GLFWindow::Create1DTransferFunction()
 {
-    int controlPointIndex = 0;
-    for (int i = 0; i < 256; i++) {
-        float t = float(i) / 255.0f;
-        if (t == 0 || t == 1) {
-            TransferFun[i * 4 + 0] = controlPoints[controlPointIndex].color.x;
-            TransferFun[i * 4 + 1] = controlPoints[controlPointIndex].color.y;
-            TransferFun[i * 4 + 2] = controlPoints[controlPointIndex].color.z;
-            TransferFun[i * 4 + 3] = controlPoints[controlPointIndex].color.w;
+    ProfileScope scope(profiler, ProfileTransferFunction);
+    buildTransferFunctionLUT(controlPoints, TransferFun);
+
+    UploadTransferFunction();
+    UploadPreIntegrationTable();
+
+    UpdateOccupancyGrid();
+
+    renderParamsChanged = true;
+}
+
+void GLFWindow::UploadTransferFunction()
+{
+    glActiveTexture(GL_TEXTURE1);
+
+    // The texture is allocated once with immutable storage and then only updated in place
+    if (tfTex == 0) {
+        glGenTextures(1, &tfTex);
+        glBindTexture(GL_TEXTURE_1D, tfTex);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        if (GLEW_ARB_texture_storage) {
+            glTexStorage1D(GL_TEXTURE_1D, 1, GL_RGBA8, 256);
         }
         else {
-            if (t > controlPoints[controlPointIndex].position)
-            {
-                controlPointIndex++;
-            }
-            float time = (t - controlPoints[controlPointIndex - 1].position) / (controlPoints[controlPointIndex].position - controlPoints[controlPointIndex - 1].position);
-            TransferFun[i * 4 + 0] = controlPoints[controlPointIndex - 1].color.x + time * (controlPoints[controlPointIndex].color.x - controlPoints[controlPointIndex - 1].color.x);
-            TransferFun[i * 4 + 1] = controlPoints[controlPointIndex - 1].color.y + time * (controlPoints[controlPointIndex].color.y - controlPoints[controlPointIndex - 1].color.y);
-            TransferFun[i * 4 + 2] = controlPoints[controlPointIndex - 1].color.z + time * (controlPoints[controlPointIndex].color.z - controlPoints[controlPointIndex - 1].color.z);
-            TransferFun[i * 4 + 3] = controlPoints[controlPointIndex - 1].color.w + time * (controlPoints[controlPointIndex].color.w - controlPoints[controlPointIndex - 1].color.w);
+            glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA8, 256, 0, GL_RGBA, GL_FLOAT, NULL);
+        }
+
+        glGenBuffers(2, tfPixelBuffers);
+        for (int i = 0; i < 2; i++) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tfPixelBuffers[i]);
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, 256 * 4 * sizeof(GLfloat), NULL, GL_STREAM_DRAW);
         }
-        
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    }
+    else {
+        glBindTexture(GL_TEXTURE_1D, tfTex);
     }
 
-    glUseProgram(ShaderProgram);
+    if (useTransferFunctionPBO) {
+        // Alternate between two pixel buffers so the copy never waits on a transfer the GPU is still reading
+        tfPixelBufferIndex = 1 - tfPixelBufferIndex;
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, tfPixelBuffers[tfPixelBufferIndex]);
+        void* mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, 256 * 4 * sizeof(GLfloat), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+        if (mapped) {
+            memcpy(mapped, TransferFun, 256 * 4 * sizeof(GLfloat));
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            glTexSubImage1D(GL_TEXTURE_1D, 0, 0, 256, GL_RGBA, GL_FLOAT, (const void*)0);
+        }
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+        if (mapped) {
+            glBindTexture(GL_TEXTURE_1D, 0);
+            return;
+        }
+    }
 
-    glGenTextures(1, &tfTex);
-    glActiveTexture(GL_TEXTURE1);
-    glBindTexture(GL_TEXTURE_1D, tfTex);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_S, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_WRAP_T, GL_REPEAT);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
-    glTexParameteri(GL_TEXTURE_1D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
-    glTexImage1D(GL_TEXTURE_1D, 0, GL_RGBA, 256, 0, GL_RGBA, GL_FLOAT, TransferFun);                    // Making a 1d transfer function
+    glTexSubImage1D(GL_TEXTURE_1D, 0, 0, 256, GL_RGBA, GL_FLOAT, TransferFun);
     glBindTexture(GL_TEXTURE_1D, 0);
 }
 
+void GLFWindow::UploadPreIntegrationTable()
+{
+    buildPreIntegrationTable(TransferFun, preIntegrationTable.data());
+
+    glActiveTexture(GL_TEXTURE6);
+    if (preIntegrationTex == 0) {
+        // Float storage: colour per unit opacity exceeds 1 wherever the transfer function is nearly transparent
+        glGenTextures(1, &preIntegrationTex);
+        glBindTexture(GL_TEXTURE_2D, preIntegrationTex);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+        glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+        glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA32F, 256, 256, 0, GL_RGBA, GL_FLOAT, NULL);
+    }
+    else {
+        glBindTexture(GL_TEXTURE_2D, preIntegrationTex);
+    }
+    glTexSubImage2D(GL_TEXTURE_2D, 0, 0, 0, 256, 256, GL_RGBA, GL_FLOAT, preIntegrationTable.data());
+    glBindTexture(GL_TEXTURE_2D, 0);
+}
+
+void GLFWindow::SetBrickGrid(const BrickGrid* grid)
+{
+    brickGrid = grid;
+    occupancyGrid.setBrickGrid(grid);
+    const int* gridDims = brickGrid->getGridDims();
+
+    glGenTextures(1, &occupancyTex);
+    glActiveTexture(GL_TEXTURE2);
+    glBindTexture(GL_TEXTURE_3D, occupancyTex);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_WRAP_R, GL_CLAMP_TO_EDGE);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+    glTexParameteri(GL_TEXTURE_3D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    glTexImage3D(GL_TEXTURE_3D, 0, GL_R8, gridDims[0], gridDims[1], gridDims[2], 0, GL_RED, GL_UNSIGNED_BYTE, occupancyGrid.getOccupancy());
+    glBindTexture(GL_TEXTURE_3D, 0);
+
+    UpdateOccupancyGrid();
+}
+
+void GLFWindow::UpdateOccupancyGrid()
+{
+    if (!brickGrid) return;
+
+    double startTime = glfwGetTime();
+
+    glm::vec2 window = GetNormalizedWindow();
+    int dirtyZBegin, dirtyZEnd;
+    if (occupancyGrid.update(TransferFun, window.x, window.y, dirtyZBegin, dirtyZEnd)) {
+        // Only the brick layers that changed are re-uploaded
+        const int* gridDims = brickGrid->getGridDims();
+        size_t layerSize = size_t(gridDims[0]) * gridDims[1];
+        glActiveTexture(GL_TEXTURE2);
+        glBindTexture(GL_TEXTURE_3D, occupancyTex);
+        glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, dirtyZBegin, gridDims[0], gridDims[1], dirtyZEnd - dirtyZBegin, GL_RED, GL_UNSIGNED_BYTE,
+            occupancyGrid.getOccupancy() + dirtyZBegin * layerSize);
+        glBindTexture(GL_TEXTURE_3D, 0);
+    }
+
+    occupancyUpdateTime = float(glfwGetTime() - startTime) * 1000.0f;
+}
+
 void GLFWindow::CreateBoundingBox()
 {
     float xSize = VolumeSize.x, ySize = VolumeSize.y, zSize = VolumeSize.z;
@@ -647,7 +1109,7 @@ void GLFWindow::CreateBoundingBox()
                 0, 1, 2, 0, 2, 3, //Front
                 4, 7, 5, 5, 7, 6, //Back
                 1, 6, 2, 1, 5, 6, //Left
-                0, 3, 4, 4, 7, 3, //Right
+                0, 3, 4, 4, 3, 7, //Right
                 0, 4, 1, 4, 5, 1, //Top
                 2, 6, 3, 3, 6, 7 //Bottom
     };
@@ -677,97 +1139,338 @@ void GLFWindow::CreateBoundingBox()
     glBindVertexArray(0); //Unbind the VAO to disable changes outside this function.
 }
 
+static void CreateRenderTarget(GLuint& fbo, GLuint& colorTex, GLuint& depthRB, int width, int height)
+{
+    if (fbo == 0) {
+        glGenFramebuffers(1, &fbo);
+        glGenTextures(1, &colorTex);
+        glGenRenderbuffers(1, &depthRB);
+    }
+
+    glBindTexture(GL_TEXTURE_2D, colorTex);
+    glTexImage2D(GL_TEXTURE_2D, 0, GL_RGBA8, width, height, 0, GL_RGBA, GL_UNSIGNED_BYTE, NULL);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+    glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+    glBindTexture(GL_TEXTURE_2D, 0);
+
+    glBindRenderbuffer(GL_RENDERBUFFER, depthRB);
+    glRenderbufferStorage(GL_RENDERBUFFER, GL_DEPTH_COMPONENT24, width, height);
+    glBindRenderbuffer(GL_RENDERBUFFER, 0);
+
+    glBindFramebuffer(GL_FRAMEBUFFER, fbo);
+    glFramebufferTexture2D(GL_FRAMEBUFFER, GL_COLOR_ATTACHMENT0, GL_TEXTURE_2D, colorTex, 0);
+    glFramebufferRenderbuffer(GL_FRAMEBUFFER, GL_DEPTH_ATTACHMENT, GL_RENDERBUFFER, depthRB);
+    if (glCheckFramebufferStatus(GL_FRAMEBUFFER) != GL_FRAMEBUFFER_COMPLETE) {
+        fprintf(stderr, "Volume framebuffer is incomplete\n");
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+}
+
+void GLFWindow::CreateVolumeFramebuffer(int width, int height)
+{
+    CreateRenderTarget(volumeFBO, volumeColorTex, volumeDepthRB, width, height);
+    CreateRenderTarget(refineFBO, refineColorTex, refineDepthRB, width, height);
+
+    if (passQueries[0] == 0) {
+        timerQueriesSupported = GLEW_ARB_timer_query || GLEW_VERSION_3_3;
+        if (timerQueriesSupported) glGenQueries(2, passQueries);
+    }
+
+    fboWidth = width;
+    fboHeight = height;
+}
+
+void GLFWindow::CollectPassTimings()
+{
+    for (int i = 0; i < 2; i++) {
+        if (!queryPending[i]) continue;
+
+        GLint available = 0;
+        glGetQueryObjectiv(passQueries[i], GL_QUERY_RESULT_AVAILABLE, &available);
+        if (!available) continue;
+
+        GLuint64 elapsed = 0;
+        glGetQueryObjectui64v(passQueries[i], GL_QUERY_RESULT, &elapsed);
+        refinement.passTimed(queryPasses[i], elapsed * 1e-6);
+        lastPassTime = float(elapsed * 1e-6);
+        queryPending[i] = false;
+    }
+}
+
+void GLFWindow::RenderVolumePass(const RefinementPass& pass)
+{
+    ProfileScope drawScope(profiler, ProfileVolumeDraw);
+    profiler.begin(ProfileSetUniforms);
+    SetUniforms(pass.stepScale, pass.width, pass.height);
+    profiler.end(ProfileSetUniforms);
+
+    double cpuStart = 0.0;
+    if (timerQueriesSupported) {
+        if (queryPending[queryIndex]) {
+            // Both queries are still in flight: wait for the older one rather than dropping its result
+            GLuint64 elapsed = 0;
+            glGetQueryObjectui64v(passQueries[queryIndex], GL_QUERY_RESULT, &elapsed);
+            refinement.passTimed(queryPasses[queryIndex], elapsed * 1e-6);
+        }
+        glBeginQuery(GL_TIME_ELAPSED, passQueries[queryIndex]);
+    }
+    else {
+        glFinish();
+        cpuStart = glfwGetTime();
+    }
+
+    // Each level is ray cast into the lower left corner of the refinement target, band by band
+    glBindFramebuffer(GL_FRAMEBUFFER, refineFBO);
+    glViewport(0, 0, pass.width, pass.height);
+    glEnable(GL_SCISSOR_TEST);
+    glScissor(0, pass.rowBegin, pass.width, pass.rowEnd - pass.rowBegin);
+    glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
+    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+
+    // All box faces wind clockwise seen from outside, so culling back faces keeps only the far side:
+    // exactly one fragment (and one blend) per covered pixel, also with the camera inside the box
+    glEnable(GL_CULL_FACE);
+    glCullFace(GL_BACK);
+    glBindVertexArray(VAO);
+
+    glDrawArrays(GL_TRIANGLES, 0, 36);
+
+    glBindVertexArray(0);
+    glDisable(GL_CULL_FACE);
+    glDisable(GL_SCISSOR_TEST);
+
+    if (timerQueriesSupported) {
+        glEndQuery(GL_TIME_ELAPSED);
+        queryPasses[queryIndex] = pass;
+        queryPending[queryIndex] = true;
+        queryIndex = 1 - queryIndex;
+    }
+    else {
+        glFinish();
+        lastPassTime = float(glfwGetTime() - cpuStart) * 1000.0f;
+        refinement.passTimed(pass, lastPassTime);
+    }
+
+    // A finished level replaces the displayed image, upscaled to the window
+    if (pass.completesLevel) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, refineFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, volumeFBO);
+        bool fullSize = pass.width == Width && pass.height == Height;
+        glBlitFramebuffer(0, 0, pass.width, pass.height, 0, 0, Width, Height, GL_COLOR_BUFFER_BIT, fullSize ? GL_NEAREST : GL_LINEAR);
+    }
+    glBindFramebuffer(GL_FRAMEBUFFER, 0);
+
+    refinement.passRendered(pass);
+    volumeFrames++;
+}
+
 bool GLFWindow::Run()
 {
     if (glfwWindowShouldClose(Window)) return false;
 
     currentFrameTime = glfwGetTime();
-    deltaTime = currentFrameTime - lastFrameTime;
+    deltaTime = glm::min(currentFrameTime - lastFrameTime, 0.1f);     // Idle waits must not turn into camera jumps
+
+    profiler.collect();
+    profiler.begin(ProfileFrame);
 
     // Start the Dear ImGui frame
+    profiler.begin(ProfileImGuiBuild);
     ImGui_ImplOpenGL3_NewFrame();
     ImGui_ImplGlfw_NewFrame();
     ImGui::NewFrame();
 
     RenderGUI();
     DrawTransferFunctionEditor();
+    profiler.end(ProfileImGuiBuild);
+
+    // The volume is only ray cast again when the camera, transfer function or window changed, progressively
+    // refined while the view stays still; otherwise the cached image is composited under the GUI
+    bool minimized = Width <= 0 || Height <= 0;
+    if (!minimized) {
+        if (fboWidth != Width || fboHeight != Height) {
+            CreateVolumeFramebuffer(Width, Height);
+            renderParamsChanged = true;
+        }
+        // Whatever invalidates the image may also change which bricks are visible; arriving bricks invalidate it too
+        if (renderParamsChanged) streamingRequestsStale = true;
+        profiler.begin(ProfileUploads);
+        UpdateStreaming();
+        if (volumeUploader.isActive() && volumeUploader.update()) {
+            uploadTime = float(glfwGetTime() - uploadStartTime) * 1000.0f;
+            uploadPersistent = volumeUploader.isPersistent();
+            profiler.recordEvent("Volume upload", uploadTime);
+            renderParamsChanged = true;
+        }
+        if (gradientUploader.isActive() && gradientUploader.update()) {
+            renderParamsChanged = true;
+        }
+        profiler.end(ProfileUploads);
+        if (renderParamsChanged) {
+            refinement.invalidate(currentFrameTime);
+            renderParamsChanged = false;
+        }
 
-    SetUniforms();                         // This will set all the uniform variable inside shaders
-
-    glViewport(0, 0, Width, Height);
-    glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
-    glClear(GL_COLOR_BUFFER_BIT | GL_DEPTH_BUFFER_BIT);
+        CollectPassTimings();
 
-    glBindVertexArray(VAO);
+        // Until the volume is on the GPU only the GUI (with the loading progress) is drawn
+        RefinementPass pass;
+        bool volumeReady = brickedVolume || (volumeTex != 0 && !volumeUploader.isActive());
+        if (!volumeReady) {
+            glBindFramebuffer(GL_FRAMEBUFFER, volumeFBO);
+            glClearColor(clearColor.x, clearColor.y, clearColor.z, clearColor.w);
+            glClear(GL_COLOR_BUFFER_BIT);
+            glBindFramebuffer(GL_FRAMEBUFFER, 0);
+        }
+        else if (!renderOnDemand) {
+            refinement.finalPass(Width, Height, pass);
+            RenderVolumePass(pass);
+        }
+        else if (refinement.nextPass(currentFrameTime, Width, Height, pass)) {
+            RenderVolumePass(pass);
+        }
+    }
 
-    glDrawArrays(GL_TRIANGLES, 0, 36);
+    glViewport(0, 0, Width, Height);
+    if (!minimized) {
+        glBindFramebuffer(GL_READ_FRAMEBUFFER, volumeFBO);
+        glBindFramebuffer(GL_DRAW_FRAMEBUFFER, 0);
+        glBlitFramebuffer(0, 0, fboWidth, fboHeight, 0, 0, Width, Height, GL_COLOR_BUFFER_BIT, GL_NEAREST);
+        glBindFramebuffer(GL_FRAMEBUFFER, 0);
+    }
 
+    profiler.begin(ProfileImGuiRender);
     ImGui::Render();
     ImGui::EndFrame();
     ImGui_ImplOpenGL3_RenderDrawData(ImGui::GetDrawData());
+    profiler.end(ProfileImGuiRender);
 
+    // A GPU timestamp around the swap would only measure when the driver got to it
+    profiler.begin(ProfileSwap, false);
     glfwSwapBuffers(Window);
     glfwSwapInterval(0);
-    glfwPollEvents();
-
+    profiler.end(ProfileSwap);
+    profiler.end(ProfileFrame);
+
+    // Keep drawing a few frames after input so ImGui can settle (hover, release, ...), then sleep until
+    // the next event or until the refinement passes may start
+    if (inputReceived) {
+        guiFramesPending = 3;
+        inputReceived = false;
+    }
     lastFrameTime = currentFrameTime;
+    double untilWork = refinement.timeUntilWork(glfwGetTime());
+    if (renderOnDemand && !renderParamsChanged && guiFramesPending == 0 && untilWork != 0.0) {
+        if (untilWork > 0.0) {
+            glfwWaitEventsTimeout(untilWork);
+        }
+        else if (ImGui::GetIO().WantTextInput) {
+            glfwWaitEventsTimeout(0.25);       // Keeps the text cursor blinking
+        }
+        else {
+            glfwWaitEvents();
+        }
+        if (inputReceived) {
+            guiFramesPending = 3;
+            inputReceived = false;
+        }
+    }
+    else {
+        glfwPollEvents();
+        if (guiFramesPending > 0) guiFramesPending--;
+    }
 
     return true;
 }
 
-bool GLFWindow::SaveTransferFunction(std::string filename)
+bool GLFWindow::RenderFrame()
 {
-    std::ofstream ofs(filename, std::ios::binary);
-    if (!ofs) {
-        std::cerr << "Failed to open file for saving: " << filename << std::endl;
-        return false;
-    }
-
-    size_t size = controlPoints.size();
-    ofs.write(reinterpret_cast<const char*>(&size), sizeof(size));
+    if (Width <= 0 || Height <= 0) return false;
 
-    for (const auto& point : controlPoints) {
-        ofs.write(reinterpret_cast<const char*>(&point.position), sizeof(point.position));
-        ofs.write(reinterpret_cast<const char*>(&point.color), sizeof(point.color));
+    if (fboWidth != Width || fboHeight != Height) {
+        CreateVolumeFramebuffer(Width, Height);
     }
+    FinishVolumeUpload();
+    FinishStreaming();                             // Every visible brick that fits the atlas is resident
+    renderParamsChanged = false;
+    while (glGetError() != GL_NO_ERROR) {}         // Only errors raised by this frame fail it
 
-    ofs.close();
-    return true;
+    RefinementPass pass;
+    refinement.finalPass(Width, Height, pass);
+    RenderVolumePass(pass);
+    CollectPassTimings();
+
+    return glGetError() == GL_NO_ERROR;
 }
 
-bool GLFWindow::LoadTransferFunction(std::string filename)
+bool GLFWindow::RenderToImage(std::vector<unsigned char>& rgba)
 {
-    std::ifstream ifs(filename, std::ios::binary);
-    if (!ifs) {
-        std::cerr << "Failed to open file for loading: " << filename << std::endl;
-        return false;
-    }
+    if (!RenderFrame()) return false;
 
-    size_t size = 0;
-    ifs.read(reinterpret_cast<char*>(&size), sizeof(size));  // Read the size of the array
+    rgba.resize(size_t(Width) * Height * 4);
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, volumeFBO);
+    glPixelStorei(GL_PACK_ALIGNMENT, 1);
+    glReadPixels(0, 0, Width, Height, GL_RGBA, GL_UNSIGNED_BYTE, rgba.data());
+    glBindFramebuffer(GL_READ_FRAMEBUFFER, 0);
 
-    controlPoints.resize(size);  // Resize the vector to hold the data
-    for (auto& point : controlPoints) {
-        ifs.read(reinterpret_cast<char*>(&point.position), sizeof(point.position));  // Read position
-        ifs.read(reinterpret_cast<char*>(&point.color), sizeof(point.color));        // Read color
-    }
+    return glGetError() == GL_NO_ERROR;
+}
 
-    ifs.close();
-    return true;
+bool GLFWindow::SaveTransferFunction(std::string filename)
+{
+    return saveTransferFunction(filename, controlPoints);
+}
+
+bool GLFWindow::LoadTransferFunction(std::string filename)
+{
+    return loadTransferFunction(filename, controlPoints);
 }
 
 void GLFWindow::ResizeWindow(int width, int height)
 {
     Width = width;
     Height = height;
+    renderParamsChanged = true;
 
     SetupProjectionTransformation();
 }
 
 void GLFWindow::cleanup() {
-    ImGui_ImplOpenGL3_Shutdown();
-    ImGui_ImplGlfw_Shutdown();
-    ImGui::DestroyContext();
+    if (volumeFBO) {
+        glDeleteFramebuffers(1, &volumeFBO);
+        glDeleteTextures(1, &volumeColorTex);
+        glDeleteRenderbuffers(1, &volumeDepthRB);
+        glDeleteFramebuffers(1, &refineFBO);
+        glDeleteTextures(1, &refineColorTex);
+        glDeleteRenderbuffers(1, &refineDepthRB);
+    }
+    if (passQueries[0]) {
+        glDeleteQueries(2, passQueries);
+    }
+    profiler.release();
+    if (tfTex) {
+        glDeleteTextures(1, &tfTex);
+        glDeleteBuffers(2, tfPixelBuffers);
+    }
+    if (preIntegrationTex) {
+        glDeleteTextures(1, &preIntegrationTex);
+    }
+    volumeUploader.stop();
+    gradientUploader.stop();
+    if (gradientTex) {
+        glDeleteTextures(1, &gradientTex);
+    }
+    if (brickedVolume) {
+        streamer.stop();
+        glDeleteTextures(1, &brickAtlasTex);
+        glDeleteTextures(1, &pageTableTex);
+    }
+
+    if (!headless) {
+        ImGui_ImplOpenGL3_Shutdown();
+        ImGui_ImplGlfw_Shutdown();
+        ImGui::DestroyContext();
+    }
 
     glfwDestroyWindow(Window);
     glfwTerminate();
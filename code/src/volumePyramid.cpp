@@ -0,0 +1,87 @@
+#include "volumePyramid.h"
+#include "parallel.h"
+#include "trace.h"
+#include <cmath>
+#include <type_traits>
+
+const char* mipFilterName(MipFilter filter)
+{
+    return filter == MipFilter::Max ? "max" : "average";
+}
+
+template<typename T>
+void VolumePyramid::downsample(const VoxelAccessor<T>& source, T* target, const int* dims) const
+{
+    // Each target voxel covers two source voxels per axis; the last one also takes the odd voxel left over
+    auto sourceRange = [&](int axis, int i, int& begin, int& end) {
+        begin = 2 * i;
+        end = i == dims[axis] - 1 ? source.dims[axis] : std::min(2 * i + 2, source.dims[axis]);
+    };
+
+    parallelFor(0, dims[2], [&](int zBegin, int zEnd) {
+        for (int z = zBegin; z < zEnd; z++) {
+            int z0, z1;
+            sourceRange(2, z, z0, z1);
+            for (int y = 0; y < dims[1]; y++) {
+                int y0, y1;
+                sourceRange(1, y, y0, y1);
+                T* row = target + (size_t(z) * dims[1] + y) * dims[0];
+                for (int x = 0; x < dims[0]; x++) {
+                    int x0, x1;
+                    sourceRange(0, x, x0, x1);
+
+                    double sum = 0.0;
+                    T highest = source(x0, y0, z0);
+                    for (int k = z0; k < z1; k++) {
+                        for (int j = y0; j < y1; j++) {
+                            for (int i = x0; i < x1; i++) {
+                                T value = source(i, j, k);
+                                sum += value;
+                                highest = std::max(highest, value);
+                            }
+                        }
+                    }
+
+                    if (filter == MipFilter::Max) {
+                        row[x] = highest;
+                    }
+                    else {
+                        double mean = sum / double((x1 - x0) * (y1 - y0) * (z1 - z0));
+                        row[x] = std::is_floating_point<T>::value ? T(mean) : T(std::lround(mean));
+                    }
+                }
+            }
+        }
+    });
+}
+
+void VolumePyramid::build(const void* volume, VoxelType type, const VoxelLayout& layout, MipFilter mipFilter, int maxLevels)
+{
+    TraceScope scope("Build mip pyramid");
+    voxelType = type;
+    filter = mipFilter;
+    levels.assign(1, volume);
+    layouts.assign(1, layout);
+    storage.clear();
+    storage.reserve(std::max(maxLevels - 1, 0));
+
+    while (int(levels.size()) < maxLevels) {
+        const int* previous = layouts.back().getDims();
+        if (previous[0] == 1 && previous[1] == 1 && previous[2] == 1) break;
+
+        int dims[3];
+        for (int axis = 0; axis < 3; axis++) {
+            dims[axis] = std::max(previous[axis] / 2, 1);
+        }
+        VoxelLayout next;
+        next.build(VoxelOrder::Linear, dims[0], dims[1], dims[2]);
+        storage.emplace_back(next.getStorageSize() * voxelTypeSize(type));
+
+        dispatchVoxelType(type, [&](auto zero) {
+            using T = decltype(zero);
+            downsample(VoxelAccessor<T>(levels.back(), layouts.back()), reinterpret_cast<T*>(storage.back().data()), dims);
+        });
+        levels.push_back(storage.back().data());
+        layouts.push_back(next);
+    }
+}
@@ -1,20 +1,317 @@
 #include "volumeReader.h"
+#include "trace.h"
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <algorithm>
 
-bool VolumeReader::readVolume(std::string filename)
+static VoxelType metaElementType(const std::string& elementType)
+{
+    if (elementType == "MET_UCHAR") return VoxelType::UInt8;
+    if (elementType == "MET_USHORT") return VoxelType::UInt16;
+    if (elementType == "MET_SHORT") return VoxelType::Int16;
+    if (elementType == "MET_FLOAT") return VoxelType::Float32;
+    return VoxelType::Unknown;
+}
+
+static std::string trim(const std::string& s)
+{
+    size_t begin = s.find_first_not_of(" \t\r\n");
+    if (begin == std::string::npos) return "";
+    size_t end = s.find_last_not_of(" \t\r\n");
+    return s.substr(begin, end - begin + 1);
+}
+
+static bool parseBool(const std::string& value)
 {
-    FILE* file = fopen(filename.c_str(), "rb");
-    if (NULL == file)
+    return value == "True" || value == "true" || value == "TRUE" || value == "1";
+}
+
+static bool hasExtension(const std::string& filename, const char* extension)
+{
+    size_t dot = filename.find_last_of('.');
+    if (dot == std::string::npos) return false;
+    std::string ext = filename.substr(dot);
+    std::transform(ext.begin(), ext.end(), ext.begin(), ::tolower);
+    return ext == extension;
+}
+
+void VolumeReader::setVolumeDimensions(int x, int y, int z)
+{
+    x_size = x;
+    y_size = y;
+    z_size = z;
+}
+
+void VolumeReader::setVoxelLayout(VoxelOrder order, int tileSize)
+{
+    layoutOrder = order;
+    layoutTileSize = tileSize;
+}
+
+void VolumeReader::setVoxelType(VoxelType type)
+{
+    voxelType = type;
+    voxelTypeGiven = true;
+}
+
+bool VolumeReader::inferDimensions(const std::string& filename, size_t fileSize)
+{
+    if (x_size > 0 && y_size > 0 && z_size > 0) return true;
+
+    // Look for a "<X>x<Y>x<Z>" token in the file name
+    std::string name = filename.substr(filename.find_last_of("/\\") + 1);
+    for (size_t i = 0; i < name.size(); i++) {
+        int x, y, z, consumed = 0;
+        if (isdigit(name[i]) && (i == 0 || !isdigit(name[i - 1]))
+            && sscanf(name.c_str() + i, "%dx%dx%d%n", &x, &y, &z, &consumed) == 3 && consumed > 0
+            && x > 0 && y > 0 && z > 0) {
+            setVolumeDimensions(x, y, z);
+            return true;
+        }
+    }
+
+    // Fall back to a cubic volume when the size is a perfect cube
+    size_t voxels = fileSize / voxelTypeSize(voxelType);
+    int side = int(std::round(std::cbrt(double(voxels))));
+    if (side > 0 && size_t(side) * side * side == voxels) {
+        setVolumeDimensions(side, side, side);
+        return true;
+    }
+
+    return false;
+}
+
+bool VolumeReader::readMHDHeader(const std::string& filename, MHDHeader& header)
+{
+    std::ifstream ifs(filename, std::ios::binary);
+    if (!ifs) {
+        return false;
+    }
+
+    int nDims = 3, nChannels = 1;
+    bool compressed = false;
+    std::string line;
+    while (std::getline(ifs, line)) {
+        size_t eq = line.find('=');
+        if (eq == std::string::npos) continue;
+
+        std::string key = trim(line.substr(0, eq));
+        std::istringstream value(trim(line.substr(eq + 1)));
+
+        if (key == "NDims") {
+            value >> nDims;
+        }
+        else if (key == "DimSize") {
+            value >> header.dims[0] >> header.dims[1] >> header.dims[2];
+        }
+        else if (key == "ElementSpacing") {
+            value >> header.spacing[0] >> header.spacing[1] >> header.spacing[2];
+        }
+        else if (key == "ElementType") {
+            value >> header.elementType;
+        }
+        else if (key == "HeaderSize") {
+            value >> header.headerSize;
+        }
+        else if (key == "ElementByteOrderMSB" || key == "BinaryDataByteOrderMSB") {
+            header.byteOrderMSB = parseBool(value.str());
+        }
+        else if (key == "ElementNumberOfChannels") {
+            value >> nChannels;
+        }
+        else if (key == "CompressedData") {
+            compressed = parseBool(value.str());
+        }
+        else if (key == "ElementDataFile") {
+            // ElementDataFile is always the last field; for LOCAL the payload starts right after this line
+            header.elementDataFile = value.str();
+            header.localDataOffset = size_t(ifs.tellg());
+            break;
+        }
+    }
+
+    if (nDims != 3 || nChannels != 1 || compressed) {
+        std::cout << filename << ": only uncompressed, single channel 3D MetaImages are supported" << std::endl;
+        return false;
+    }
+    if (header.dims[0] <= 0 || header.dims[1] <= 0 || header.dims[2] <= 0 || header.elementDataFile.empty()) {
+        std::cout << filename << ": missing DimSize or ElementDataFile" << std::endl;
+        return false;
+    }
+    return true;
+}
+
+bool VolumeReader::mapPayload(const std::string& filename, size_t offset, bool swapBytes)
+{
+    size_t voxelSize = voxelTypeSize(voxelType);
+    if (vol_size == 0) {
+        // MappedFile::open maps the whole file for a length of 0
+        std::cout << filename << ": the volume has no voxels" << std::endl;
+        return false;
+    }
+    if (!volumeFile.open(filename, offset, vol_size * voxelSize, swapBytes))
     {
+        std::cout << "Could not map " << vol_size * voxelSize << " bytes at offset " << offset << " of " << filename << std::endl;
         return false;
     }
-    fread(volume, sizeof(GLubyte), vol_size, file);
-    fclose(file);
+
+    // Big endian payloads are swapped in the private copy-on-write pages of the mapping
+    if (swapBytes) {
+        unsigned char* bytes = volumeFile.getMutableData();
+        for (size_t i = 0; i < vol_size; i++, bytes += voxelSize) {
+            std::reverse(bytes, bytes + voxelSize);
+        }
+    }
     return true;
 }
 
-unsigned char* VolumeReader::getVolume()
+bool VolumeReader::readRawVolume(const std::string& filename)
 {
-    return volume;
+    size_t fileSize = 0;
+    if (!MappedFile::fileSize(filename, fileSize))
+    {
+        return false;
+    }
+
+    if (!voxelTypeGiven) {
+        // Look for an element type token such as "_uint16" in the file name
+        voxelType = voxelTypeFromFileName(filename);
+    }
+
+    if (!inferDimensions(filename, fileSize))
+    {
+        std::cout << "Could not determine the dimensions of " << filename << ", pass them with -dims X Y Z" << std::endl;
+        return false;
+    }
+
+    vol_size = size_t(x_size) * y_size * z_size;
+    if (fileSize < vol_size * voxelTypeSize(voxelType))
+    {
+        std::cout << "Volume file is " << fileSize << " bytes, expected " << vol_size * voxelTypeSize(voxelType) << " for "
+            << x_size << "x" << y_size << "x" << z_size << " " << voxelTypeName(voxelType) << std::endl;
+        return false;
+    }
+
+    return mapPayload(filename, 0, false);
+}
+
+bool VolumeReader::readMHDVolume(const std::string& filename)
+{
+    MHDHeader header;
+    if (!readMHDHeader(filename, header))
+    {
+        return false;
+    }
+
+    voxelType = metaElementType(header.elementType);
+    if (voxelType == VoxelType::Unknown)
+    {
+        std::cout << filename << ": unsupported ElementType " << header.elementType << std::endl;
+        return false;
+    }
+
+    setVolumeDimensions(header.dims[0], header.dims[1], header.dims[2]);
+    vol_size = size_t(x_size) * y_size * z_size;
+    std::copy(header.spacing, header.spacing + 3, spacing);
+
+    std::string dataFile;
+    size_t offset = 0;
+    if (header.elementDataFile == "LOCAL") {
+        dataFile = filename;
+        offset = header.localDataOffset;
+    }
+    else {
+        // Relative data file names are resolved against the header's directory
+        dataFile = header.elementDataFile;
+        size_t slash = filename.find_last_of("/\\");
+        bool absolute = dataFile[0] == '/' || dataFile[0] == '\\' || dataFile.find(':') != std::string::npos;
+        if (!absolute && slash != std::string::npos) {
+            dataFile = filename.substr(0, slash + 1) + dataFile;
+        }
+
+        if (header.headerSize >= 0) {
+            offset = size_t(header.headerSize);
+        }
+        else {
+            size_t fileSize = 0;
+            if (!MappedFile::fileSize(dataFile, fileSize) || fileSize < vol_size * voxelTypeSize(voxelType)) {
+                std::cout << "Data file " << dataFile << " is missing or too small" << std::endl;
+                return false;
+            }
+            offset = fileSize - vol_size * voxelTypeSize(voxelType);
+        }
+    }
+
+    const uint16_t endianProbe = 1;
+    bool hostLittleEndian = *reinterpret_cast<const unsigned char*>(&endianProbe) == 1;
+    bool swapBytes = voxelTypeSize(voxelType) > 1 && header.byteOrderMSB == hostLittleEndian;
+
+    return mapPayload(dataFile, offset, swapBytes);
+}
+
+bool VolumeReader::readVolume(std::string filename)
+{
+    TraceScope scope("Read volume");
+    bool status = (hasExtension(filename, ".mhd") || hasExtension(filename, ".mha"))
+        ? readMHDVolume(filename)
+        : readRawVolume(filename);
+
+    if (status) {
+        filePath = filename;
+        valueRangeValid = false;
+
+        layout.build(layoutOrder, x_size, y_size, z_size, layoutTileSize);
+        swizzled.clear();
+        if (layoutOrder != VoxelOrder::Linear) {
+            swizzled.resize(layout.getStorageSize() * voxelTypeSize(voxelType));
+            layout.swizzle(getVolume(), voxelType, swizzled.data());
+            std::cout << "Voxel layout " << layout.describe() << " ("
+                << (layout.getStorageSize() * voxelTypeSize(voxelType)) / (1024.0 * 1024.0) << " MB)" << std::endl;
+        }
+    }
+    return status;
+}
+
+template<typename T>
+void VolumeReader::computeValueRange()
+{
+    // The order of the voxels does not matter here, so scan the mapped file rather than the (padded) CPU layout
+    const T* voxels = getVolumeAs<T>();
+    auto range = std::minmax_element(voxels, voxels + vol_size);
+    valueRange[0] = float(*range.first);
+    valueRange[1] = float(*range.second);
+}
+
+void VolumeReader::getValueRange(float& minValue, float& maxValue)
+{
+    if (!valueRangeValid) {
+        if (voxelType == VoxelType::UInt8) {
+            valueRange[0] = 0;
+            valueRange[1] = 255;
+        }
+        else {
+            dispatchVoxelType(voxelType, [this](auto zero) { computeValueRange<decltype(zero)>(); });
+        }
+        valueRangeValid = true;
+    }
+    minValue = valueRange[0];
+    maxValue = valueRange[1];
+}
+
+const void* VolumeReader::getVolume()
+{
+    return volumeFile.getData();
+}
+
+const void* VolumeReader::getCPUVolume()
+{
+    return swizzled.empty() ? getVolume() : swizzled.data();
+}
+
+VoxelType VolumeReader::getVoxelType()
+{
+    return voxelType;
 }
 
 float VolumeReader::getVolumeDimensionX() {
@@ -27,4 +324,8 @@ float VolumeReader::getVolumeDimensionY() {
 
 float VolumeReader::getVolumeDimensionZ() {
     return z_size;
+}
+
+glm::vec3 VolumeReader::getVolumeSpacing() {
+    return glm::vec3(spacing[0], spacing[1], spacing[2]);
 }
\ No newline at end of file
@@ -0,0 +1,166 @@
+#include "volumeUploader.h"
+#include "trace.h"
+#include <algorithm>
+#include <cstring>
+
+void VolumeUploader::start(GLuint targetTexture, const void* voxels, int x, int y, int z, size_t voxelBytes, GLenum pixelFormat, GLenum type,
+    std::function<void()> filledCallback, size_t slabBytes, int ringSize)
+{
+    stop();
+    texture = targetTexture;
+    source = static_cast<const unsigned char*>(voxels);
+    format = pixelFormat;
+    dataType = type;
+    dims[0] = x;
+    dims[1] = y;
+    dims[2] = z;
+    layerBytes = size_t(x) * y * voxelBytes;
+    slabLayers = int(std::max<size_t>(slabBytes / std::max<size_t>(layerBytes, 1), 1));
+    slabLayers = std::min(slabLayers, z);
+    slabCount = (z + slabLayers - 1) / slabLayers;
+    nextUpload = 0;
+    uploadedSlabs = 0;
+    onFilled = std::move(filledCallback);
+
+    persistent = GLEW_ARB_buffer_storage || GLEW_VERSION_4_4;
+    slots.assign(std::min(ringSize, slabCount), Slot());
+    const GLsizeiptr bufferSize = GLsizeiptr(layerBytes * slabLayers);
+    for (Slot& slot : slots) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        if (persistent) {
+            const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+            glBufferStorage(GL_PIXEL_UNPACK_BUFFER, bufferSize, NULL, flags);
+            slot.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, bufferSize, flags);
+        }
+        else {
+            glBufferData(GL_PIXEL_UNPACK_BUFFER, bufferSize, NULL, GL_STREAM_DRAW);
+            mapSlot(slot);
+        }
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+
+    stopping = false;
+    reader = std::thread(&VolumeUploader::readerLoop, this);
+}
+
+void VolumeUploader::mapSlot(Slot& slot)
+{
+    // Invalidating orphans the storage the GPU may still be reading, so no fence is needed here
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+    slot.mapped = glMapBufferRange(GL_PIXEL_UNPACK_BUFFER, 0, GLsizeiptr(layerBytes * slabLayers), GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT);
+}
+
+void VolumeUploader::readerLoop()
+{
+    trace::setThreadName("Volume uploader");
+    for (int slab = 0; slab < slabCount; slab++) {
+        Slot* slot;
+        {
+            std::unique_lock<std::mutex> lock(mutex);
+            slot = &slots[slab % slots.size()];
+            slotFreed.wait(lock, [&]() { return stopping || slot->state == Free; });
+            if (stopping) return;
+            slot->state = Filling;
+            slot->zBegin = slab * slabLayers;
+            slot->zEnd = std::min(slot->zBegin + slabLayers, dims[2]);
+        }
+
+        {
+            TraceScope scope("Fill slab");
+            memcpy(slot->mapped, source + slot->zBegin * layerBytes, (slot->zEnd - slot->zBegin) * layerBytes);
+        }
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            slot->state = Filled;
+        }
+        if (onFilled) onFilled();
+    }
+}
+
+bool VolumeUploader::update()
+{
+    if (!isActive()) return false;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    bool freed = false;
+    for (Slot& slot : slots) {
+        if (slot.state != InFlight) continue;
+        if (persistent) {
+            if (glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, 0) == GL_TIMEOUT_EXPIRED) continue;
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+        else {
+            mapSlot(slot);
+        }
+        slot.state = Free;
+        freed = true;
+    }
+
+    glActiveTexture(GL_TEXTURE0);
+    glBindTexture(GL_TEXTURE_3D, texture);
+    glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+    for (;;) {
+        Slot& slot = slots[nextUpload % slots.size()];
+        if (nextUpload >= slabCount || slot.state != Filled) break;
+
+        glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+        if (!persistent) {
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+            slot.mapped = nullptr;
+        }
+        TraceScope scope("Upload slab");
+        glTexSubImage3D(GL_TEXTURE_3D, 0, 0, 0, slot.zBegin, dims[0], dims[1], slot.zEnd - slot.zBegin, format, dataType, (const void*)0);
+        if (persistent) {
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        }
+        slot.state = InFlight;
+        nextUpload++;
+        uploadedSlabs++;
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    glBindTexture(GL_TEXTURE_3D, 0);
+    if (freed) slotFreed.notify_all();
+
+    if (uploadedSlabs < slabCount) return false;
+    reader.join();
+    releaseBuffers();
+    return true;
+}
+
+void VolumeUploader::finish()
+{
+    while (isActive()) {
+        if (!update()) std::this_thread::yield();
+    }
+}
+
+void VolumeUploader::stop()
+{
+    if (reader.joinable()) {
+        {
+            std::lock_guard<std::mutex> lock(mutex);
+            stopping = true;
+        }
+        slotFreed.notify_all();
+        reader.join();
+    }
+    releaseBuffers();
+    slabCount = 0;
+}
+
+void VolumeUploader::releaseBuffers()
+{
+    // The texture keeps its own copy, the staging buffers can go once the last copies were submitted
+    for (Slot& slot : slots) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        if (slot.mapped) {
+            glBindBuffer(GL_PIXEL_UNPACK_BUFFER, slot.buffer);
+            glUnmapBuffer(GL_PIXEL_UNPACK_BUFFER);
+        }
+        glDeleteBuffers(1, &slot.buffer);
+    }
+    glBindBuffer(GL_PIXEL_UNPACK_BUFFER, 0);
+    slots.clear();
+}
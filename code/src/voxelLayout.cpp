@@ -0,0 +1,117 @@
+#include "voxelLayout.h"
+#include "parallel.h"
+#include <cstring>
+
+const char* voxelOrderName(VoxelOrder order)
+{
+    switch (order) {
+    case VoxelOrder::Linear: return "linear";
+    case VoxelOrder::Tiled: return "tiled";
+    case VoxelOrder::Morton: return "morton";
+    default: return "unknown";
+    }
+}
+
+void VoxelLayout::build(VoxelOrder layoutOrder, int x_size, int y_size, int z_size, int size)
+{
+    order = layoutOrder;
+    dims[0] = x_size;
+    dims[1] = y_size;
+    dims[2] = z_size;
+    for (int axis = 0; axis < 3; axis++) {
+        offsets[axis].resize(dims[axis]);
+    }
+
+    if (order == VoxelOrder::Tiled) {
+        tileSize = std::max(size, 1);
+        size_t tileVoxels = size_t(tileSize) * tileSize * tileSize;
+        size_t tiles[3];
+        for (int axis = 0; axis < 3; axis++) {
+            tiles[axis] = (size_t(dims[axis]) + tileSize - 1) / tileSize;
+        }
+        // Brick strides (linear order of bricks) and voxel strides inside a brick, per axis
+        const size_t brickStride[3] = { tileVoxels, tiles[0] * tileVoxels, tiles[0] * tiles[1] * tileVoxels };
+        const size_t voxelStride[3] = { 1, size_t(tileSize), size_t(tileSize) * tileSize };
+        for (int axis = 0; axis < 3; axis++) {
+            for (int i = 0; i < dims[axis]; i++) {
+                offsets[axis][i] = (i / tileSize) * brickStride[axis] + (i % tileSize) * voxelStride[axis];
+            }
+        }
+        storageSize = tiles[0] * tiles[1] * tiles[2] * tileVoxels;
+    }
+    else if (order == VoxelOrder::Morton) {
+        // Interleave the coordinate bits x, y, z from the least significant bit up. An axis that runs out of bits
+        // drops out of the interleaving, so only each axis is padded to a power of two, not the whole volume to a cube.
+        tileSize = 1;
+        int bits[3] = { 0, 0, 0 };
+        for (int axis = 0; axis < 3; axis++) {
+            while ((size_t(1) << bits[axis]) < size_t(dims[axis])) bits[axis]++;
+        }
+        int bitPosition[3][32];
+        int next = 0;
+        for (int bit = 0; bit < 32; bit++) {
+            for (int axis = 0; axis < 3; axis++) {
+                if (bit < bits[axis]) bitPosition[axis][bit] = next++;
+            }
+        }
+        for (int axis = 0; axis < 3; axis++) {
+            for (int i = 0; i < dims[axis]; i++) {
+                size_t offset = 0;
+                for (int bit = 0; bit < bits[axis]; bit++) {
+                    if ((i >> bit) & 1) offset |= size_t(1) << bitPosition[axis][bit];
+                }
+                offsets[axis][i] = offset;
+            }
+        }
+        storageSize = size_t(1) << next;
+    }
+    else {
+        tileSize = 1;
+        const size_t stride[3] = { 1, size_t(dims[0]), size_t(dims[0]) * dims[1] };
+        for (int axis = 0; axis < 3; axis++) {
+            for (int i = 0; i < dims[axis]; i++) {
+                offsets[axis][i] = i * stride[axis];
+            }
+        }
+        storageSize = size_t(dims[0]) * dims[1] * dims[2];
+    }
+}
+
+void VoxelLayout::swizzle(const void* linear, VoxelType type, void* out) const
+{
+    const size_t elementSize = voxelTypeSize(type);
+    const size_t voxelCount = size_t(dims[0]) * dims[1] * dims[2];
+    if (order == VoxelOrder::Linear) {
+        memcpy(out, linear, voxelCount * elementSize);
+        return;
+    }
+    if (storageSize > voxelCount) {
+        memset(out, 0, storageSize * elementSize);
+    }
+
+    dispatchVoxelType(type, [&](auto zero) {
+        using T = decltype(zero);
+        const T* src = static_cast<const T*>(linear);
+        T* dst = static_cast<T*>(out);
+        parallelFor(0, dims[2], [&](int zBegin, int zEnd) {
+            for (int z = zBegin; z < zEnd; z++) {
+                for (int y = 0; y < dims[1]; y++) {
+                    const T* row = src + (size_t(z) * dims[1] + y) * dims[0];
+                    size_t base = offsets[1][y] + offsets[2][z];
+                    for (int x = 0; x < dims[0]; x++) {
+                        dst[base + offsets[0][x]] = row[x];
+                    }
+                }
+            }
+        });
+    });
+}
+
+std::string VoxelLayout::describe() const
+{
+    std::string name = voxelOrderName(order);
+    if (order == VoxelOrder::Tiled) {
+        name += " " + std::to_string(tileSize) + "^3";
+    }
+    return name;
+}